@@ -3,6 +3,9 @@
 
 #include "microsoft/gsl.h"
 #include "vdr/wipe.h"
+#include "vdr/cipher/aesni.h"
+#include "vdr/cipher/vaes.h"
+#include "vdr/cipher/unkeyed.h"
 
 #include <openssl/aes.h>
 
@@ -28,13 +31,19 @@ namespace vdr
 
         public:
             aes();
+            explicit aes( unkeyed_t );
             ~aes();
 
             aes & set_enc_key( gsl::span< gsl::byte const, key_bytes > enckey );
             aes & set_dec_key( gsl::span< gsl::byte const, key_bytes > deckey );
 
-            aes & enc( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out );
-            aes & dec( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out );
+            /// Encryption and decryption only read the key schedule, many threads may share one instance.
+            aes const & enc( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const;
+            aes const & dec( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const;
+
+            /// ECB over whole number of blocks, `in` and `out` must have the same size.
+            aes const & enc_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const;
+            aes const & dec_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const;
 
             aes & clear();
 
@@ -47,8 +56,25 @@ namespace vdr
             static constexpr size_t get_block_bytes() { return block_bytes; }
             static constexpr size_t get_block_bits() { return block_bits; }
 
+            /// Whether AES-NI is used instead of OpenSSL low level AES (decided once by CPUID).
+            bool uses_aesni() const { return _aesni; }
+
+            /// Whether `enc_blocks`/`dec_blocks` use VAES on 512 bit registers for large enough inputs.
+            bool uses_vaes() const { return _vaes; }
+
+        private:
+            union schedule_t
+            {
+                AES_KEY openssl_key;
+            #ifdef VDR_CIPHER_HAVE_AESNI
+                __m128i aesni_keys[ aesni::traits< key_bits >::round_keys ];
+            #endif
+            };
+
         private:
-            AES_KEY _key;
+            bool _aesni;
+            bool _vaes;
+            schedule_t _schedule;
 
         };
 
@@ -74,10 +100,37 @@ namespace vdr
 
         template< size_t KeyBits >
         aes<KeyBits>::aes()
+        #ifdef VDR_CIPHER_HAVE_AESNI
+            : _aesni( aesni::is_supported() )
+        #else
+            : _aesni( false )
+        #endif
+        #ifdef VDR_CIPHER_HAVE_VAES
+            , _vaes( _aesni and vaes::is_supported() )
+        #else
+            , _vaes( false )
+        #endif
         {
             clear();
         }
 
+        /// Zeroed schedule, not expanded from the zero key.
+        template< size_t KeyBits >
+        aes<KeyBits>::aes( unkeyed_t )
+        #ifdef VDR_CIPHER_HAVE_AESNI
+            : _aesni( aesni::is_supported() )
+        #else
+            : _aesni( false )
+        #endif
+        #ifdef VDR_CIPHER_HAVE_VAES
+            , _vaes( _aesni and vaes::is_supported() )
+        #else
+            , _vaes( false )
+        #endif
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &_schedule, 1 ) ) );
+        }
+
         
         template< size_t KeyBits >
         aes<KeyBits>::~aes()
@@ -90,7 +143,14 @@ namespace vdr
         aes<KeyBits> & 
         aes<KeyBits>::set_enc_key( gsl::span< gsl::byte const, key_bytes > enckey )
         {
-            if( openssl::failure == AES_set_encrypt_key( reinterpret_cast< unsigned char const * >( enckey.data() ), enckey.size_bytes() * 8, &_key ) )
+        #ifdef VDR_CIPHER_HAVE_AESNI
+            if( _aesni )
+            {
+                aesni::expand_enc_key< key_bits >( reinterpret_cast< uint8_t const * >( enckey.data() ), _schedule.aesni_keys );
+                return *this;
+            }
+        #endif
+            if( openssl::failure == AES_set_encrypt_key( reinterpret_cast< unsigned char const * >( enckey.data() ), enckey.size_bytes() * 8, &_schedule.openssl_key ) )
             {
                 throw std::runtime_error("Can't set encryption AES key.");
             }
@@ -103,7 +163,15 @@ namespace vdr
         aes<KeyBits> & 
         aes<KeyBits>::set_dec_key( gsl::span< gsl::byte const, key_bytes > deckey )
         {
-            if( openssl::failure == AES_set_decrypt_key( reinterpret_cast< unsigned char const * >( deckey.data() ), deckey.size_bytes() * 8, &_key ) )
+        #ifdef VDR_CIPHER_HAVE_AESNI
+            if( _aesni )
+            {
+                aesni::expand_enc_key< key_bits >( reinterpret_cast< uint8_t const * >( deckey.data() ), _schedule.aesni_keys );
+                aesni::enc_to_dec_key< key_bits >( _schedule.aesni_keys );
+                return *this;
+            }
+        #endif
+            if( openssl::failure == AES_set_decrypt_key( reinterpret_cast< unsigned char const * >( deckey.data() ), deckey.size_bytes() * 8, &_schedule.openssl_key ) )
             {
                 throw std::runtime_error("Can't set decrypion AES key.");
             }
@@ -111,34 +179,128 @@ namespace vdr
         }
 
         template< size_t KeyBits >
-        aes<KeyBits> & 
-        aes<KeyBits>::enc( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out )
+        aes<KeyBits> const &
+        aes<KeyBits>::enc( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const
         {
+        #ifdef VDR_CIPHER_HAVE_AESNI
+            if( _aesni )
+            {
+                aesni::encrypt_block< key_bits >( _schedule.aesni_keys, reinterpret_cast< uint8_t const * >( in.data() ), reinterpret_cast< uint8_t * >( out.data() ) );
+                return *this;
+            }
+        #endif
             AES_encrypt( 
                 reinterpret_cast< unsigned char const * >( in.data() ), 
                 reinterpret_cast< unsigned char * >( out.data() ),
-                &_key
+                &_schedule.openssl_key
             );
             return *this;
         }
 
         template< size_t KeyBits >
-        aes<KeyBits> & 
-        aes<KeyBits>::dec( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out )
+        aes<KeyBits> const &
+        aes<KeyBits>::dec( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const
         {
+        #ifdef VDR_CIPHER_HAVE_AESNI
+            if( _aesni )
+            {
+                aesni::decrypt_block< key_bits >( _schedule.aesni_keys, reinterpret_cast< uint8_t const * >( in.data() ), reinterpret_cast< uint8_t * >( out.data() ) );
+                return *this;
+            }
+        #endif
             AES_decrypt( 
                 reinterpret_cast< unsigned char const * >( in.data() ),
                 reinterpret_cast< unsigned char * >( out.data() ), 
-                &_key
+                &_schedule.openssl_key
             );
             return *this;
         }
 
+        template< size_t KeyBits >
+        aes<KeyBits> const &
+        aes<KeyBits>::enc_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const
+        {
+            Expects( in.size_bytes() == out.size_bytes() and in.size_bytes() % block_bytes == 0 );
+
+        #ifdef VDR_CIPHER_HAVE_VAES
+            if( _vaes and in.size_bytes() >= vaes::lanes * block_bytes )
+            {
+                vaes::encrypt_blocks< key_bits >(
+                    _schedule.aesni_keys,
+                    reinterpret_cast< uint8_t const * >( in.data() ), reinterpret_cast< uint8_t * >( out.data() ),
+                    in.size_bytes() / block_bytes
+                );
+                return *this;
+            }
+        #endif
+        #ifdef VDR_CIPHER_HAVE_AESNI
+            if( _aesni )
+            {
+                aesni::encrypt_blocks< key_bits >(
+                    _schedule.aesni_keys,
+                    reinterpret_cast< uint8_t const * >( in.data() ), reinterpret_cast< uint8_t * >( out.data() ),
+                    in.size_bytes() / block_bytes
+                );
+                return *this;
+            }
+        #endif
+
+            for( size_t offset = 0; offset < in.size_bytes(); offset += block_bytes )
+            {
+                AES_encrypt( 
+                    reinterpret_cast< unsigned char const * >( in.data() ) + offset, 
+                    reinterpret_cast< unsigned char * >( out.data() ) + offset,
+                    &_schedule.openssl_key
+                );
+            }
+            return *this;
+        }
+
+        template< size_t KeyBits >
+        aes<KeyBits> const &
+        aes<KeyBits>::dec_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const
+        {
+            Expects( in.size_bytes() == out.size_bytes() and in.size_bytes() % block_bytes == 0 );
+
+        #ifdef VDR_CIPHER_HAVE_VAES
+            if( _vaes and in.size_bytes() >= vaes::lanes * block_bytes )
+            {
+                vaes::decrypt_blocks< key_bits >(
+                    _schedule.aesni_keys,
+                    reinterpret_cast< uint8_t const * >( in.data() ), reinterpret_cast< uint8_t * >( out.data() ),
+                    in.size_bytes() / block_bytes
+                );
+                return *this;
+            }
+        #endif
+        #ifdef VDR_CIPHER_HAVE_AESNI
+            if( _aesni )
+            {
+                aesni::decrypt_blocks< key_bits >(
+                    _schedule.aesni_keys,
+                    reinterpret_cast< uint8_t const * >( in.data() ), reinterpret_cast< uint8_t * >( out.data() ),
+                    in.size_bytes() / block_bytes
+                );
+                return *this;
+            }
+        #endif
+
+            for( size_t offset = 0; offset < in.size_bytes(); offset += block_bytes )
+            {
+                AES_decrypt( 
+                    reinterpret_cast< unsigned char const * >( in.data() ) + offset, 
+                    reinterpret_cast< unsigned char * >( out.data() ) + offset,
+                    &_schedule.openssl_key
+                );
+            }
+            return *this;
+        }
+
         template< size_t KeyBits >
         aes<KeyBits> & 
         aes<KeyBits>::clear()
         {
-            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &_key, 1 ) ) );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &_schedule, 1 ) ) );
             {
                 // NOTE: Following is just in case, if somebody will `enc`/`dec` something right
                 //   after `clear`. Not sure if all will be ok in this case after zerofying AES_KEY.
@@ -0,0 +1,515 @@
+#ifndef INCLUDED__VDR_CIPHER_AES_BITSLICED_H
+#define INCLUDED__VDR_CIPHER_AES_BITSLICED_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+#include "microsoft/gsl.h"
+#include "vdr/wipe.h"
+#include "vdr/cipher/unkeyed.h"
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// Constant time software AES-128, encryption only (that is all FPE F-functions need).
+        ///
+        /// Blocks are bitsliced: bit `b` of state byte `k` of all blocks lives in one `Word`,
+        /// one block per bit of the word, so `lanes` blocks (8, 32 or 64) are encrypted at once
+        /// with plain integer operations and without any data dependent memory access.
+        /// S-box is the Boyar-Peralta circuit.
+        ///
+        /// Interface follows `vdr::cipher::aes`, so it plugs into `basic_thorp_shuffle`.
+        /// Single block `enc` costs as much as a whole group of `lanes` blocks, use `enc_blocks`.
+        template< class Word = uint64_t >
+        class aes_bitsliced
+        {
+            static_assert( std::is_unsigned< Word >::value, "Word must be an unsigned integer type." );
+
+        public:
+            enum : size_t { key_bits = 128 };
+            enum : size_t { key_bytes = key_bits / 8 };
+            enum : size_t { block_bytes = 16 };
+            enum : size_t { block_bits = block_bytes * 8 };
+            enum : size_t { lanes = std::numeric_limits< Word >::digits };
+            enum : size_t { rounds = 10 };
+
+        public:
+            typedef std::array< gsl::byte, key_bytes > key_arr;
+            typedef std::array< gsl::byte, block_bytes > block_arr;
+
+        public:
+            aes_bitsliced();
+            explicit aes_bitsliced( unkeyed_t );
+            ~aes_bitsliced();
+
+            aes_bitsliced & set_enc_key( gsl::span< gsl::byte const, key_bytes > enckey );
+
+            /// Encryption only reads round keys, many threads may share one instance.
+            aes_bitsliced const & enc( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const;
+
+            /// ECB over whole number of blocks, `in` and `out` must have the same size.
+            aes_bitsliced const & enc_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const;
+
+            aes_bitsliced & clear();
+
+        public:
+            static constexpr key_arr get_empty_key() { return key_arr{}; }
+            static constexpr block_arr get_empty_block() { return block_arr{}; }
+
+            static constexpr size_t get_key_bits() { return key_bits; }
+            static constexpr size_t get_key_bytes() { return key_bytes; }
+            static constexpr size_t get_block_bytes() { return block_bytes; }
+            static constexpr size_t get_block_bits() { return block_bits; }
+
+        private:
+            typedef std::array< Word, block_bits > state_t;
+
+        private:
+            void encrypt_group( uint8_t const * in, uint8_t * out, size_t count ) const;
+
+            void add_round_key( state_t & state, size_t round ) const;
+
+            static void sub_bytes( state_t & state );
+            static void shift_rows( state_t const & in, state_t & out );
+            static void shift_rows_mix_columns( state_t const & in, state_t & out );
+
+            template< class SliceWord >
+            static void sbox( SliceWord * q );
+
+            static void transpose( Word * rows );
+
+            static uint8_t sub_byte( uint8_t byte );
+
+        private:
+            std::array< uint8_t, ( rounds + 1 ) * block_bytes > _round_keys;
+        };
+
+        typedef aes_bitsliced< uint64_t > aes128_bitsliced;
+
+    }
+}
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        template< class Word >
+        aes_bitsliced<Word>::aes_bitsliced()
+        {
+            clear();
+        }
+
+        template< class Word >
+        aes_bitsliced<Word>::aes_bitsliced( unkeyed_t )
+            : _round_keys()
+        {
+        }
+
+        template< class Word >
+        aes_bitsliced<Word>::~aes_bitsliced()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _round_keys ) ) );
+        }
+
+        template< class Word >
+        aes_bitsliced<Word> &
+        aes_bitsliced<Word>::clear()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _round_keys ) ) );
+            {
+                // NOTE: Same as `aes::clear`, keep object usable right after `clear`.
+                std::array< gsl::byte, key_bytes > zero_key{};
+                this->set_enc_key( zero_key );
+            }
+            return *this;
+        }
+
+
+        /// Boyar-Peralta S-box circuit. `q[ 0 ]` is the least significant bit of the byte.
+        template< class Word >
+        template< class SliceWord >
+        void aes_bitsliced<Word>::sbox( SliceWord * q )
+        {
+            SliceWord const x0 = q[ 7 ], x1 = q[ 6 ], x2 = q[ 5 ], x3 = q[ 4 ];
+            SliceWord const x4 = q[ 3 ], x5 = q[ 2 ], x6 = q[ 1 ], x7 = q[ 0 ];
+
+            // Top linear transformation.
+            SliceWord const y14 = x3 ^ x5;
+            SliceWord const y13 = x0 ^ x6;
+            SliceWord const y9 = x0 ^ x3;
+            SliceWord const y8 = x0 ^ x5;
+            SliceWord const t0 = x1 ^ x2;
+            SliceWord const y1 = t0 ^ x7;
+            SliceWord const y4 = y1 ^ x3;
+            SliceWord const y12 = y13 ^ y14;
+            SliceWord const y2 = y1 ^ x0;
+            SliceWord const y5 = y1 ^ x6;
+            SliceWord const y3 = y5 ^ y8;
+            SliceWord const t1 = x4 ^ y12;
+            SliceWord const y15 = t1 ^ x5;
+            SliceWord const y20 = t1 ^ x1;
+            SliceWord const y6 = y15 ^ x7;
+            SliceWord const y10 = y15 ^ t0;
+            SliceWord const y11 = y20 ^ y9;
+            SliceWord const y7 = x7 ^ y11;
+            SliceWord const y17 = y10 ^ y11;
+            SliceWord const y19 = y10 ^ y8;
+            SliceWord const y16 = t0 ^ y11;
+            SliceWord const y21 = y13 ^ y16;
+            SliceWord const y18 = x0 ^ y16;
+
+            // Non-linear section.
+            SliceWord const t2 = y12 & y15;
+            SliceWord const t3 = y3 & y6;
+            SliceWord const t4 = t3 ^ t2;
+            SliceWord const t5 = y4 & x7;
+            SliceWord const t6 = t5 ^ t2;
+            SliceWord const t7 = y13 & y16;
+            SliceWord const t8 = y5 & y1;
+            SliceWord const t9 = t8 ^ t7;
+            SliceWord const t10 = y2 & y7;
+            SliceWord const t11 = t10 ^ t7;
+            SliceWord const t12 = y9 & y11;
+            SliceWord const t13 = y14 & y17;
+            SliceWord const t14 = t13 ^ t12;
+            SliceWord const t15 = y8 & y10;
+            SliceWord const t16 = t15 ^ t12;
+            SliceWord const t17 = t4 ^ t14;
+            SliceWord const t18 = t6 ^ t16;
+            SliceWord const t19 = t9 ^ t14;
+            SliceWord const t20 = t11 ^ t16;
+            SliceWord const t21 = t17 ^ y20;
+            SliceWord const t22 = t18 ^ y19;
+            SliceWord const t23 = t19 ^ y21;
+            SliceWord const t24 = t20 ^ y18;
+
+            SliceWord const t25 = t21 ^ t22;
+            SliceWord const t26 = t21 & t23;
+            SliceWord const t27 = t24 ^ t26;
+            SliceWord const t28 = t25 & t27;
+            SliceWord const t29 = t28 ^ t22;
+            SliceWord const t30 = t23 ^ t24;
+            SliceWord const t31 = t22 ^ t26;
+            SliceWord const t32 = t31 & t30;
+            SliceWord const t33 = t32 ^ t24;
+            SliceWord const t34 = t23 ^ t33;
+            SliceWord const t35 = t27 ^ t33;
+            SliceWord const t36 = t24 & t35;
+            SliceWord const t37 = t36 ^ t34;
+            SliceWord const t38 = t27 ^ t36;
+            SliceWord const t39 = t29 & t38;
+            SliceWord const t40 = t25 ^ t39;
+
+            SliceWord const t41 = t40 ^ t37;
+            SliceWord const t42 = t29 ^ t33;
+            SliceWord const t43 = t29 ^ t40;
+            SliceWord const t44 = t33 ^ t37;
+            SliceWord const t45 = t42 ^ t41;
+            SliceWord const z0 = t44 & y15;
+            SliceWord const z1 = t37 & y6;
+            SliceWord const z2 = t33 & x7;
+            SliceWord const z3 = t43 & y16;
+            SliceWord const z4 = t40 & y1;
+            SliceWord const z5 = t29 & y7;
+            SliceWord const z6 = t42 & y11;
+            SliceWord const z7 = t45 & y17;
+            SliceWord const z8 = t41 & y10;
+            SliceWord const z9 = t44 & y12;
+            SliceWord const z10 = t37 & y3;
+            SliceWord const z11 = t33 & y4;
+            SliceWord const z12 = t43 & y13;
+            SliceWord const z13 = t40 & y5;
+            SliceWord const z14 = t29 & y2;
+            SliceWord const z15 = t42 & y9;
+            SliceWord const z16 = t45 & y14;
+            SliceWord const z17 = t41 & y8;
+
+            // Bottom linear transformation.
+            SliceWord const t46 = z15 ^ z16;
+            SliceWord const t47 = z10 ^ z11;
+            SliceWord const t48 = z5 ^ z13;
+            SliceWord const t49 = z9 ^ z10;
+            SliceWord const t50 = z2 ^ z12;
+            SliceWord const t51 = z2 ^ z5;
+            SliceWord const t52 = z7 ^ z8;
+            SliceWord const t53 = z0 ^ z3;
+            SliceWord const t54 = z6 ^ z7;
+            SliceWord const t55 = z16 ^ z17;
+            SliceWord const t56 = z12 ^ t48;
+            SliceWord const t57 = t50 ^ t53;
+            SliceWord const t58 = z4 ^ t46;
+            SliceWord const t59 = z3 ^ t54;
+            SliceWord const t60 = t46 ^ t57;
+            SliceWord const t61 = z14 ^ t57;
+            SliceWord const t62 = t52 ^ t58;
+            SliceWord const t63 = t49 ^ t58;
+            SliceWord const t64 = z4 ^ t59;
+            SliceWord const t65 = t61 ^ t62;
+            SliceWord const t66 = z1 ^ t63;
+            SliceWord const s0 = t59 ^ t63;
+            SliceWord const s6 = t56 ^ SliceWord( ~t62 );
+            SliceWord const s7 = t48 ^ SliceWord( ~t60 );
+            SliceWord const t67 = t64 ^ t65;
+            SliceWord const s3 = t53 ^ t66;
+            SliceWord const s4 = t51 ^ t66;
+            SliceWord const s5 = t47 ^ t65;
+            SliceWord const s1 = t64 ^ SliceWord( ~s3 );
+            SliceWord const s2 = t55 ^ SliceWord( ~t67 );
+
+            q[ 7 ] = s0; q[ 6 ] = s1; q[ 5 ] = s2; q[ 4 ] = s3;
+            q[ 3 ] = s4; q[ 2 ] = s5; q[ 1 ] = s6; q[ 0 ] = s7;
+        }
+
+        /// Single byte S-box through the same circuit, so key schedule is constant time too.
+        template< class Word >
+        uint8_t aes_bitsliced<Word>::sub_byte( uint8_t const byte )
+        {
+            uint8_t q[ 8 ];
+            for( size_t bit = 0; bit < 8; ++bit )
+            {
+                q[ bit ] = uint8_t( ( byte >> bit ) & 1 );
+            }
+            sbox( q );
+
+            uint8_t result = 0;
+            for( size_t bit = 0; bit < 8; ++bit )
+            {
+                result |= uint8_t( ( q[ bit ] & 1 ) << bit );
+            }
+            return result;
+        }
+
+        /// In place transpose of `lanes` x `lanes` bit matrix, bit `c` of `rows[ r ]` is element ( r, c ).
+        /// Off-diagonal halves are swapped, then quarters inside them and so on.
+        template< class Word >
+        void aes_bitsliced<Word>::transpose( Word * rows )
+        {
+            for( size_t half = lanes / 2; half != 0; half /= 2 )
+            {
+                Word const mask = Word( ~Word( 0 ) ) / Word( ( Word( 1 ) << half ) + 1 );
+                for( size_t row = 0; row < lanes; ++row )
+                {
+                    if( ( row & half ) == 0 )
+                    {
+                        Word const swap = ( ( rows[ row ] >> half ) ^ rows[ row | half ] ) & mask;
+                        rows[ row | half ] ^= swap;
+                        rows[ row ] ^= Word( swap << half );
+                    }
+                }
+            }
+        }
+
+        template< class Word >
+        aes_bitsliced<Word> &
+        aes_bitsliced<Word>::set_enc_key( gsl::span< gsl::byte const, key_bytes > enckey )
+        {
+            for( size_t i = 0; i < key_bytes; ++i )
+            {
+                _round_keys[ i ] = static_cast< uint8_t >( enckey[ i ] );
+            }
+
+            uint8_t rcon = 1;
+            for( size_t i = key_bytes; i < _round_keys.size(); i += 4 )
+            {
+                uint8_t temp[ 4 ] = { _round_keys[ i - 4 ], _round_keys[ i - 3 ], _round_keys[ i - 2 ], _round_keys[ i - 1 ] };
+                if( i % key_bytes == 0 )
+                {
+                    uint8_t const first = temp[ 0 ];
+                    temp[ 0 ] = sub_byte( temp[ 1 ] ) ^ rcon;
+                    temp[ 1 ] = sub_byte( temp[ 2 ] );
+                    temp[ 2 ] = sub_byte( temp[ 3 ] );
+                    temp[ 3 ] = sub_byte( first );
+                    rcon = uint8_t( ( rcon << 1 ) ^ ( 0x1b & -( rcon >> 7 ) ) );
+                }
+                for( size_t j = 0; j < 4; ++j )
+                {
+                    _round_keys[ i + j ] = _round_keys[ i + j - key_bytes ] ^ temp[ j ];
+                }
+                vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( temp ) ) );
+            }
+            return *this;
+        }
+
+        template< class Word >
+        void aes_bitsliced<Word>::add_round_key( state_t & state, size_t const round ) const
+        {
+            uint8_t const * round_key = _round_keys.data() + round * block_bytes;
+            for( size_t byte = 0; byte < block_bytes; ++byte )
+            {
+                Word const key_byte = round_key[ byte ];
+                Word * const slices = state.data() + byte * 8;
+                for( size_t bit = 0; bit < 8; ++bit )
+                {
+                    slices[ bit ] ^= Word( 0 ) - Word( ( key_byte >> bit ) & 1 );
+                }
+            }
+        }
+
+        template< class Word >
+        void aes_bitsliced<Word>::sub_bytes( state_t & state )
+        {
+            for( size_t byte = 0; byte < block_bytes; ++byte )
+            {
+                sbox( state.data() + byte * 8 );
+            }
+        }
+
+        /// State byte `4 * column + row`; row `r` is rotated left by `r` columns.
+        template< class Word >
+        void aes_bitsliced<Word>::shift_rows( state_t const & in, state_t & out )
+        {
+            for( size_t column = 0; column < 4; ++column )
+            {
+                for( size_t row = 0; row < 4; ++row )
+                {
+                    Word const * const from = in.data() + ( 4 * ( ( column + row ) % 4 ) + row ) * 8;
+                    Word * const to = out.data() + ( 4 * column + row ) * 8;
+                    for( size_t bit = 0; bit < 8; ++bit )
+                    {
+                        to[ bit ] = from[ bit ];
+                    }
+                }
+            }
+        }
+
+        /// ShiftRows is folded into MixColumns by reading the rotated bytes of every column.
+        template< class Word >
+        void aes_bitsliced<Word>::shift_rows_mix_columns( state_t const & in, state_t & out )
+        {
+            for( size_t column = 0; column < 4; ++column )
+            {
+                Word a[ 4 ][ 8 ];
+                for( size_t row = 0; row < 4; ++row )
+                {
+                    Word const * const from = in.data() + ( 4 * ( ( column + row ) % 4 ) + row ) * 8;
+                    for( size_t bit = 0; bit < 8; ++bit )
+                    {
+                        a[ row ][ bit ] = from[ bit ];
+                    }
+                }
+
+                Word all[ 8 ];
+                for( size_t bit = 0; bit < 8; ++bit )
+                {
+                    all[ bit ] = a[ 0 ][ bit ] ^ a[ 1 ][ bit ] ^ a[ 2 ][ bit ] ^ a[ 3 ][ bit ];
+                }
+
+                // b[ r ] = 2 a[ r ] ^ 3 a[ r + 1 ] ^ a[ r + 2 ] ^ a[ r + 3 ] = xtime( a[ r ] ^ a[ r + 1 ] ) ^ a[ r ] ^ all
+                for( size_t row = 0; row < 4; ++row )
+                {
+                    Word const * const a0 = a[ row ];
+                    Word const * const a1 = a[ ( row + 1 ) % 4 ];
+                    Word * const to = out.data() + ( 4 * column + row ) * 8;
+
+                    Word sum[ 8 ];
+                    for( size_t bit = 0; bit < 8; ++bit )
+                    {
+                        sum[ bit ] = a0[ bit ] ^ a1[ bit ];
+                    }
+
+                    // xtime: multiply by x modulo x^8 + x^4 + x^3 + x + 1.
+                    Word const high = sum[ 7 ];
+                    to[ 0 ] = high ^ a0[ 0 ] ^ all[ 0 ];
+                    to[ 1 ] = sum[ 0 ] ^ high ^ a0[ 1 ] ^ all[ 1 ];
+                    to[ 2 ] = sum[ 1 ] ^ a0[ 2 ] ^ all[ 2 ];
+                    to[ 3 ] = sum[ 2 ] ^ high ^ a0[ 3 ] ^ all[ 3 ];
+                    to[ 4 ] = sum[ 3 ] ^ high ^ a0[ 4 ] ^ all[ 4 ];
+                    to[ 5 ] = sum[ 4 ] ^ a0[ 5 ] ^ all[ 5 ];
+                    to[ 6 ] = sum[ 5 ] ^ a0[ 6 ] ^ all[ 6 ];
+                    to[ 7 ] = sum[ 6 ] ^ a0[ 7 ] ^ all[ 7 ];
+                }
+            }
+        }
+
+        template< class Word >
+        void aes_bitsliced<Word>::encrypt_group( uint8_t const * in, uint8_t * out, size_t const count ) const
+        {
+            enum : size_t { word_bytes = sizeof( Word ) };
+
+            // Every `lanes` bits wide column of the blocks is a square bit matrix, transposed at once.
+            state_t state{};
+            for( size_t column = 0; column < block_bits; column += lanes )
+            {
+                Word * const rows = state.data() + column;
+                for( size_t lane = 0; lane < count; ++lane )
+                {
+                    for( size_t byte = 0; byte < word_bytes; ++byte )
+                    {
+                        rows[ lane ] |= Word( in[ lane * block_bytes + column / 8 + byte ] ) << ( byte * 8 );
+                    }
+                }
+                transpose( rows );
+            }
+
+            state_t mixed;
+            state_t * current = &state;
+            state_t * next = &mixed;
+
+            add_round_key( *current, 0 );
+            for( size_t round = 1; round < rounds; ++round )
+            {
+                sub_bytes( *current );
+                shift_rows_mix_columns( *current, *next );
+                add_round_key( *next, round );
+                std::swap( current, next );
+            }
+            sub_bytes( *current );
+            shift_rows( *current, *next );
+            add_round_key( *next, rounds );
+
+            for( size_t column = 0; column < block_bits; column += lanes )
+            {
+                Word * const rows = next->data() + column;
+                transpose( rows );
+                for( size_t lane = 0; lane < count; ++lane )
+                {
+                    for( size_t byte = 0; byte < word_bytes; ++byte )
+                    {
+                        out[ lane * block_bytes + column / 8 + byte ] = uint8_t( rows[ lane ] >> ( byte * 8 ) );
+                    }
+                }
+            }
+
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( state ) ) );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( mixed ) ) );
+        }
+
+        template< class Word >
+        aes_bitsliced<Word> const &
+        aes_bitsliced<Word>::enc( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const
+        {
+            encrypt_group( reinterpret_cast< uint8_t const * >( in.data() ), reinterpret_cast< uint8_t * >( out.data() ), 1 );
+            return *this;
+        }
+
+        template< class Word >
+        aes_bitsliced<Word> const &
+        aes_bitsliced<Word>::enc_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const
+        {
+            Expects( in.size_bytes() == out.size_bytes() and in.size_bytes() % block_bytes == 0 );
+
+            uint8_t const * in_bytes = reinterpret_cast< uint8_t const * >( in.data() );
+            uint8_t * out_bytes = reinterpret_cast< uint8_t * >( out.data() );
+            for( size_t blocks = in.size_bytes() / block_bytes; blocks > 0; )
+            {
+                size_t const count = std::min< size_t >( blocks, lanes );
+                encrypt_group( in_bytes, out_bytes, count );
+                in_bytes += count * block_bytes;
+                out_bytes += count * block_bytes;
+                blocks -= count;
+            }
+            return *this;
+        }
+
+    }
+}
+
+
+#endif // INCLUDED__VDR_CIPHER_AES_BITSLICED_H
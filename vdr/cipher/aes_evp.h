@@ -0,0 +1,354 @@
+#ifndef INCLUDED__VDR_CIPHER_AES_EVP_H
+#define INCLUDED__VDR_CIPHER_AES_EVP_H
+
+#include "microsoft/gsl.h"
+#include "vdr/cipher/unkeyed.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+#include <openssl/evp.h>
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// Same interface as `vdr::cipher::aes`, but goes through OpenSSL EVP (ECB, no padding),
+        /// so multi-block `enc_blocks`/`dec_blocks` get OpenSSL's AES-NI/VAES pipelined code paths.
+        template< size_t KeyBits = 128 >
+        class aes_evp
+        {
+            static_assert( KeyBits == 128 or KeyBits == 192 or KeyBits == 256, "Invalid AES key length value." );
+
+        public:
+            enum : size_t { key_bits = KeyBits };
+            enum : size_t { key_bytes = key_bits / 8 };
+            enum : size_t { block_bytes = 16 };
+            enum : size_t { block_bits = block_bytes * 8 };
+        
+        public:
+            typedef std::array< gsl::byte, key_bytes > key_arr;
+            typedef std::array< gsl::byte, block_bytes > block_arr;
+
+        public:
+            aes_evp();
+            explicit aes_evp( unkeyed_t );
+            aes_evp( aes_evp const & other );
+            ~aes_evp();
+
+            aes_evp & operator = ( aes_evp const & other );
+
+            aes_evp & set_enc_key( gsl::span< gsl::byte const, key_bytes > enckey );
+            aes_evp & set_dec_key( gsl::span< gsl::byte const, key_bytes > deckey );
+
+            /// EVP context changes on every update, so each call runs on a copy of it taken from
+            /// `_ctx_copies` and given back after. Up to `ctx_copy_slots` copies are kept until the
+            /// key changes. Many threads may encrypt with one instance at once.
+            aes_evp const & enc( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const;
+            aes_evp const & dec( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const;
+
+            /// ECB over whole number of blocks, `in` and `out` must have the same size.
+            aes_evp const & enc_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const;
+            aes_evp const & dec_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const;
+
+            aes_evp & clear();
+
+        public:
+            static constexpr key_arr get_empty_key() { return key_arr{}; }
+            static constexpr block_arr get_empty_block() { return block_arr{}; }
+
+            static constexpr size_t get_key_bits() { return key_bits; }
+            static constexpr size_t get_key_bytes() { return key_bytes; }
+            static constexpr size_t get_block_bytes() { return block_bytes; }
+            static constexpr size_t get_block_bits() { return block_bits; }
+
+        private:
+            /// Enough for as many threads as cores sharing one instance; more threads go on, with
+            /// a new copy per call.
+            enum : size_t { ctx_copy_slots = 16 };
+
+        private:
+            static EVP_CIPHER const * get_evp_cipher();
+
+            EVP_CIPHER_CTX * take_ctx_copy() const;
+            void give_ctx_copy( EVP_CIPHER_CTX * ctx ) const;
+            void free_ctx_copies();
+            void update( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const;
+
+        private:
+            EVP_CIPHER_CTX * _ctx;
+
+            /// Copies of `_ctx` not in use right now, empty slots are null. Freed (and cleansed)
+            /// whenever `_ctx` changes.
+            mutable std::array< std::atomic< EVP_CIPHER_CTX * >, ctx_copy_slots > _ctx_copies;
+
+        };
+
+        typedef aes_evp<128> aes_evp128;
+
+    }
+}
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        namespace
+        { 
+            namespace openssl_evp
+            {
+                enum : int { success = 1 };
+                enum : int { failure = 0 };
+            }
+        }
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits>::aes_evp()
+            : _ctx( EVP_CIPHER_CTX_new() )
+        {
+            for( auto & copy : _ctx_copies )
+            {
+                copy = nullptr;
+            }
+            if( _ctx == nullptr )
+            {
+                throw std::bad_alloc();
+            }
+            clear();
+        }
+
+        /// Fresh context, no cipher set up.
+        template< size_t KeyBits >
+        aes_evp<KeyBits>::aes_evp( unkeyed_t )
+            : _ctx( EVP_CIPHER_CTX_new() )
+        {
+            for( auto & copy : _ctx_copies )
+            {
+                copy = nullptr;
+            }
+            if( _ctx == nullptr )
+            {
+                throw std::bad_alloc();
+            }
+        }
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits>::aes_evp( aes_evp const & other )
+            : _ctx( EVP_CIPHER_CTX_new() )
+        {
+            for( auto & copy : _ctx_copies )
+            {
+                copy = nullptr;
+            }
+            if( _ctx == nullptr )
+            {
+                throw std::bad_alloc();
+            }
+            *this = other;
+        }
+
+        
+        template< size_t KeyBits >
+        aes_evp<KeyBits>::~aes_evp()
+        {
+            // NOTE: Context cleanup cleanses key schedule.
+            free_ctx_copies();
+            EVP_CIPHER_CTX_free( _ctx );
+        }
+
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits> & 
+        aes_evp<KeyBits>::operator = ( aes_evp const & other )
+        {
+            if( this != &other and openssl_evp::failure == EVP_CIPHER_CTX_copy( _ctx, other._ctx ) )
+            {
+                throw std::runtime_error("Can't copy EVP AES context.");
+            }
+            free_ctx_copies();
+            return *this;
+        }
+
+
+        template< size_t KeyBits >
+        EVP_CIPHER const *
+        aes_evp<KeyBits>::get_evp_cipher()
+        {
+            switch( KeyBits )
+            {
+                case 128: return EVP_aes_128_ecb();
+                case 192: return EVP_aes_192_ecb();
+                default:  return EVP_aes_256_ecb();
+            }
+        }
+
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits> & 
+        aes_evp<KeyBits>::set_enc_key( gsl::span< gsl::byte const, key_bytes > enckey )
+        {
+            if( 
+                openssl_evp::failure == EVP_EncryptInit_ex( _ctx, get_evp_cipher(), nullptr, reinterpret_cast< unsigned char const * >( enckey.data() ), nullptr )
+                or
+                openssl_evp::failure == EVP_CIPHER_CTX_set_padding( _ctx, 0 )
+            )
+            {
+                throw std::runtime_error("Can't set encryption EVP AES key.");
+            }
+            free_ctx_copies();
+            return *this;
+        }
+
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits> & 
+        aes_evp<KeyBits>::set_dec_key( gsl::span< gsl::byte const, key_bytes > deckey )
+        {
+            if( 
+                openssl_evp::failure == EVP_DecryptInit_ex( _ctx, get_evp_cipher(), nullptr, reinterpret_cast< unsigned char const * >( deckey.data() ), nullptr )
+                or
+                openssl_evp::failure == EVP_CIPHER_CTX_set_padding( _ctx, 0 )
+            )
+            {
+                throw std::runtime_error("Can't set decryption EVP AES key.");
+            }
+            free_ctx_copies();
+            return *this;
+        }
+
+
+        template< size_t KeyBits >
+        EVP_CIPHER_CTX * aes_evp<KeyBits>::take_ctx_copy() const
+        {
+            for( auto & copy : _ctx_copies )
+            {
+                if( copy.load( std::memory_order_relaxed ) != nullptr )
+                {
+                    if( EVP_CIPHER_CTX * const ctx = copy.exchange( nullptr, std::memory_order_acquire ) )
+                    {
+                        return ctx;
+                    }
+                }
+            }
+
+            EVP_CIPHER_CTX * const ctx = EVP_CIPHER_CTX_new();
+            if( ctx == nullptr )
+            {
+                throw std::bad_alloc();
+            }
+            if( openssl_evp::failure == EVP_CIPHER_CTX_copy( ctx, _ctx ) )
+            {
+                EVP_CIPHER_CTX_free( ctx );
+                throw std::runtime_error("Can't copy EVP AES context.");
+            }
+            return ctx;
+        }
+
+        template< size_t KeyBits >
+        void aes_evp<KeyBits>::give_ctx_copy( EVP_CIPHER_CTX * ctx ) const
+        {
+            for( auto & copy : _ctx_copies )
+            {
+                EVP_CIPHER_CTX * empty = nullptr;
+                if( copy.load( std::memory_order_relaxed ) == nullptr and copy.compare_exchange_strong( empty, ctx, std::memory_order_release ) )
+                {
+                    return;
+                }
+            }
+            EVP_CIPHER_CTX_free( ctx );
+        }
+
+        /// Not thread safe, as nothing that changes `_ctx` is.
+        template< size_t KeyBits >
+        void aes_evp<KeyBits>::free_ctx_copies()
+        {
+            for( auto & copy : _ctx_copies )
+            {
+                // NOTE: Context cleanup cleanses key schedule.
+                EVP_CIPHER_CTX_free( copy.exchange( nullptr ) );
+            }
+        }
+
+
+        template< size_t KeyBits >
+        void aes_evp<KeyBits>::update( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const
+        {
+            Expects( in.size_bytes() == out.size_bytes() and in.size_bytes() % block_bytes == 0 );
+
+            // NOTE: Whichever of Encrypt/Decrypt was initialized last decides the direction.
+            EVP_CIPHER_CTX * const ctx = take_ctx_copy();
+            int out_size = 0;
+            bool const updated = openssl_evp::success == EVP_CipherUpdate(
+                ctx,
+                reinterpret_cast< unsigned char * >( out.data() ), &out_size,
+                reinterpret_cast< unsigned char const * >( in.data() ), static_cast< int >( in.size_bytes() )
+            );
+            give_ctx_copy( ctx );
+            if( not updated or static_cast< size_t >( out_size ) != in.size_bytes() )
+            {
+                throw std::runtime_error("Can't update EVP AES.");
+            }
+        }
+
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits> const &
+        aes_evp<KeyBits>::enc( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const
+        {
+            update( in, out );
+            return *this;
+        }
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits> const &
+        aes_evp<KeyBits>::dec( gsl::span< gsl::byte const, block_bytes > in, gsl::span< gsl::byte, block_bytes > out ) const
+        {
+            update( in, out );
+            return *this;
+        }
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits> const &
+        aes_evp<KeyBits>::enc_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const
+        {
+            update( in, out );
+            return *this;
+        }
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits> const &
+        aes_evp<KeyBits>::dec_blocks( gsl::span< gsl::byte const > in, gsl::span< gsl::byte > out ) const
+        {
+            update( in, out );
+            return *this;
+        }
+
+        template< size_t KeyBits >
+        aes_evp<KeyBits> & 
+        aes_evp<KeyBits>::clear()
+        {
+            free_ctx_copies();
+            if( openssl_evp::failure == EVP_CIPHER_CTX_reset( _ctx ) )
+            {
+                throw std::runtime_error("Can't reset EVP AES context.");
+            }
+            {
+                // NOTE: Same as `aes::clear`, keep context usable right after `clear`.
+                std::array< gsl::byte, aes_evp<KeyBits>::key_bytes > zero_key{};
+                this->set_enc_key( zero_key ); 
+            }
+            return *this;
+        }
+
+
+    }
+}
+
+
+#endif // INCLUDED__VDR_CIPHER_AES_EVP_H
@@ -0,0 +1,231 @@
+#ifndef INCLUDED__VDR_CIPHER_AESNI_H
+#define INCLUDED__VDR_CIPHER_AESNI_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "microsoft/gsl.h"
+#include "vdr/wipe.h"
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+    #define VDR_CIPHER_HAVE_AESNI 1
+#endif
+
+#ifdef VDR_CIPHER_HAVE_AESNI
+
+#include <wmmintrin.h>
+#include <emmintrin.h>
+
+/// Functions are compiled for AES-NI regardless of global compiler flags. They are inlined
+/// into callers which are compiled with `-maes` (or `-march` implying it), otherwise they are
+/// called after runtime check `vdr::cipher::aesni::is_supported()`.
+#define VDR_CIPHER_AESNI_TARGET __attribute__(( target( "aes,sse2" ) ))
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+        namespace aesni
+        {
+
+            template< size_t KeyBits >
+            struct traits
+            {
+                enum : size_t { key_words = KeyBits / 32 };
+                enum : size_t { rounds = key_words + 6 };
+                enum : size_t { round_keys = rounds + 1 };
+            };
+
+            inline bool is_supported()
+            {
+                #ifdef __AES__
+                    return true;
+                #else
+                    static bool const supported = __builtin_cpu_supports( "aes" ) and __builtin_cpu_supports( "sse2" );
+                    return supported;
+                #endif
+            }
+
+
+            VDR_CIPHER_AESNI_TARGET
+            inline uint32_t sub_word( uint32_t const word )
+            {
+                // AESKEYGENASSIST puts SubWord of the second dword into the first one.
+                return static_cast< uint32_t >( _mm_cvtsi128_si32( _mm_aeskeygenassist_si128( _mm_set_epi32( 0, 0, static_cast< int >( word ), 0 ), 0 ) ) );
+            }
+
+            /// FIPS-197 key expansion, words are little endian.
+            template< size_t KeyBits >
+            VDR_CIPHER_AESNI_TARGET
+            inline void expand_enc_key( uint8_t const * key, __m128i * round_keys )
+            {
+                enum : size_t { nk = traits< KeyBits >::key_words };
+                enum : size_t { words = traits< KeyBits >::round_keys * 4 };
+
+                uint32_t w[ words ];
+                std::memcpy( w, key, nk * sizeof( uint32_t ) );
+
+                uint32_t rcon = 1;
+                for( size_t i = nk; i < words; ++i )
+                {
+                    uint32_t temp = w[ i - 1 ];
+                    if( i % nk == 0 )
+                    {
+                        temp = sub_word( ( temp >> 8 ) | ( temp << 24 ) ) ^ rcon;
+                        rcon = ( ( rcon << 1 ) ^ ( ( rcon & 0x80 ) ? 0x1b : 0 ) ) & 0xff;
+                    }
+                    else if( nk > 6 and i % nk == 4 )
+                    {
+                        temp = sub_word( temp );
+                    }
+                    w[ i ] = w[ i - nk ] ^ temp;
+                }
+
+                for( size_t round = 0; round < traits< KeyBits >::round_keys; ++round )
+                {
+                    round_keys[ round ] = _mm_loadu_si128( reinterpret_cast< __m128i const * >( w + round * 4 ) );
+                }
+
+                vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( w ) ) );
+            }
+
+            /// Equivalent inverse cipher schedule, may be done in place.
+            template< size_t KeyBits >
+            VDR_CIPHER_AESNI_TARGET
+            inline void enc_to_dec_key( __m128i * round_keys )
+            {
+                enum : size_t { rounds = traits< KeyBits >::rounds };
+
+                for( size_t i = 0, j = rounds; i < j; ++i, --j )
+                {
+                    __m128i const tmp = round_keys[ i ];
+                    round_keys[ i ] = round_keys[ j ];
+                    round_keys[ j ] = tmp;
+                }
+                for( size_t round = 1; round < rounds; ++round )
+                {
+                    round_keys[ round ] = _mm_aesimc_si128( round_keys[ round ] );
+                }
+            }
+
+            template< size_t KeyBits >
+            VDR_CIPHER_AESNI_TARGET
+            inline __m128i encrypt( __m128i const * round_keys, __m128i block )
+            {
+                block = _mm_xor_si128( block, round_keys[ 0 ] );
+                for( size_t round = 1; round < traits< KeyBits >::rounds; ++round )
+                {
+                    block = _mm_aesenc_si128( block, round_keys[ round ] );
+                }
+                return _mm_aesenclast_si128( block, round_keys[ traits< KeyBits >::rounds ] );
+            }
+
+            template< size_t KeyBits >
+            VDR_CIPHER_AESNI_TARGET
+            inline __m128i decrypt( __m128i const * round_keys, __m128i block )
+            {
+                block = _mm_xor_si128( block, round_keys[ 0 ] );
+                for( size_t round = 1; round < traits< KeyBits >::rounds; ++round )
+                {
+                    block = _mm_aesdec_si128( block, round_keys[ round ] );
+                }
+                return _mm_aesdeclast_si128( block, round_keys[ traits< KeyBits >::rounds ] );
+            }
+
+            template< size_t KeyBits >
+            VDR_CIPHER_AESNI_TARGET
+            inline void encrypt_block( __m128i const * round_keys, uint8_t const * in, uint8_t * out )
+            {
+                __m128i const block = _mm_loadu_si128( reinterpret_cast< __m128i const * >( in ) );
+                _mm_storeu_si128( reinterpret_cast< __m128i * >( out ), encrypt< KeyBits >( round_keys, block ) );
+            }
+
+            template< size_t KeyBits >
+            VDR_CIPHER_AESNI_TARGET
+            inline void decrypt_block( __m128i const * round_keys, uint8_t const * in, uint8_t * out )
+            {
+                __m128i const block = _mm_loadu_si128( reinterpret_cast< __m128i const * >( in ) );
+                _mm_storeu_si128( reinterpret_cast< __m128i * >( out ), decrypt< KeyBits >( round_keys, block ) );
+            }
+
+            /// ECB, independent blocks are interleaved to hide AESENC latency.
+            template< size_t KeyBits >
+            VDR_CIPHER_AESNI_TARGET
+            inline void encrypt_blocks( __m128i const * round_keys, uint8_t const * in, uint8_t * out, size_t count )
+            {
+                enum : size_t { lanes = 8 };
+                enum : size_t { rounds = traits< KeyBits >::rounds };
+
+                __m128i const * in_blocks = reinterpret_cast< __m128i const * >( in );
+                __m128i * out_blocks = reinterpret_cast< __m128i * >( out );
+
+                for( ; count >= lanes; count -= lanes, in_blocks += lanes, out_blocks += lanes )
+                {
+                    __m128i blocks[ lanes ];
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        blocks[ lane ] = _mm_xor_si128( _mm_loadu_si128( in_blocks + lane ), round_keys[ 0 ] );
+                    }
+                    for( size_t round = 1; round < rounds; ++round )
+                    {
+                        for( size_t lane = 0; lane < lanes; ++lane )
+                        {
+                            blocks[ lane ] = _mm_aesenc_si128( blocks[ lane ], round_keys[ round ] );
+                        }
+                    }
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        _mm_storeu_si128( out_blocks + lane, _mm_aesenclast_si128( blocks[ lane ], round_keys[ rounds ] ) );
+                    }
+                }
+
+                for( ; count > 0; --count, ++in_blocks, ++out_blocks )
+                {
+                    _mm_storeu_si128( out_blocks, encrypt< KeyBits >( round_keys, _mm_loadu_si128( in_blocks ) ) );
+                }
+            }
+
+            template< size_t KeyBits >
+            VDR_CIPHER_AESNI_TARGET
+            inline void decrypt_blocks( __m128i const * round_keys, uint8_t const * in, uint8_t * out, size_t count )
+            {
+                enum : size_t { lanes = 8 };
+                enum : size_t { rounds = traits< KeyBits >::rounds };
+
+                __m128i const * in_blocks = reinterpret_cast< __m128i const * >( in );
+                __m128i * out_blocks = reinterpret_cast< __m128i * >( out );
+
+                for( ; count >= lanes; count -= lanes, in_blocks += lanes, out_blocks += lanes )
+                {
+                    __m128i blocks[ lanes ];
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        blocks[ lane ] = _mm_xor_si128( _mm_loadu_si128( in_blocks + lane ), round_keys[ 0 ] );
+                    }
+                    for( size_t round = 1; round < rounds; ++round )
+                    {
+                        for( size_t lane = 0; lane < lanes; ++lane )
+                        {
+                            blocks[ lane ] = _mm_aesdec_si128( blocks[ lane ], round_keys[ round ] );
+                        }
+                    }
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        _mm_storeu_si128( out_blocks + lane, _mm_aesdeclast_si128( blocks[ lane ], round_keys[ rounds ] ) );
+                    }
+                }
+
+                for( ; count > 0; --count, ++in_blocks, ++out_blocks )
+                {
+                    _mm_storeu_si128( out_blocks, decrypt< KeyBits >( round_keys, _mm_loadu_si128( in_blocks ) ) );
+                }
+            }
+
+        }
+    }
+}
+
+#endif // VDR_CIPHER_HAVE_AESNI
+
+#endif // INCLUDED__VDR_CIPHER_AESNI_H
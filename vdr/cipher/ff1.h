@@ -0,0 +1,647 @@
+#ifndef INCLUDED__VDR_CIPHER_FF1_H
+#define INCLUDED__VDR_CIPHER_FF1_H
+
+#include "vdr/cipher/fpe_feistel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// FF1 format-preserving encryption (NIST SP 800-38G): balanced Feistel with 10 rounds and
+        /// CBC-MAC based round function. Numeral string halves are kept as integers, so
+        /// `radix ^ ceil( length / 2 )` must fit in 64 bits.
+        ///
+        /// Has the same integer surface as `basic_fpe_feistel` and can replace it per domain. For
+        /// integer domains values are radix 2 numeral strings and values out of domain are cycle walked.
+        ///
+        /// BlockCipher is a policy with `aes`-like interface, see `basic_thorp_shuffle`.
+        template< class BlockCipher = vdr::cipher::aes128 >
+        class basic_fpe_ff1
+        {
+        public:
+            typedef BlockCipher block_cipher;
+            typedef uintmax_t value_type;
+            typedef uint16_t numeral_t;
+
+        public:
+            enum : size_t { rounds = 10 };
+            enum : size_t { batch_lanes = 64 };
+            enum : uint32_t { min_radix = 2 };
+            enum : uint32_t { max_radix = uint32_t(1) << 16 };
+            /// SP 800-38G Rev. 1 lower bound for `radix ^ length`.
+            enum : uintmax_t { min_domain_size = 1000000 };
+
+        public:
+            /// Integer domain [0, domain_size), key is derived from `raw_key` like in `basic_thorp_shuffle`.
+            basic_fpe_ff1( uintmax_t domain_size, std::string const & raw_key );
+
+            /// Numeral strings of `length` digits in `radix`, `key` is used as AES key as is.
+            basic_fpe_ff1( uint32_t radix, size_t length, gsl::span< gsl::byte const, block_cipher::key_bytes > key );
+
+            ~basic_fpe_ff1();
+
+            /// All calls only read the key schedule and empty tweak state, and may run in parallel.
+            uintmax_t encrypt( uintmax_t value ) const;
+            uintmax_t decrypt( uintmax_t value ) const;
+
+            /// Batch versions, same contract as in `basic_fpe_feistel`.
+            void encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+            void decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+
+            /// Numeral string versions with tweak. `numerals` and `results` must have `get_length()`
+            /// numerals and may be the same buffer.
+            void encrypt( gsl::span< numeral_t const > numerals, gsl::span< gsl::byte const > tweak, gsl::span< numeral_t > results ) const;
+            void decrypt( gsl::span< numeral_t const > numerals, gsl::span< gsl::byte const > tweak, gsl::span< numeral_t > results ) const;
+
+            /// Zero if `radix ^ length` does not fit `uintmax_t`, then only numeral strings are usable.
+            uintmax_t get_domain_size() const { return _params.domain_size; }
+            uint32_t get_radix() const { return _params.radix; }
+            size_t get_length() const { return _params.length; }
+
+        private:
+            typedef block_cipher block_cipher_t;
+            typedef std::array< uint8_t, block_cipher_t::block_bytes > block_t;
+            typedef unsigned __int128 wide_t;
+
+            struct params_t
+            {
+                uint32_t radix;
+                size_t length;
+                size_t u;
+                size_t v;
+                uint64_t modulus_u;
+                uint64_t modulus_v;
+                size_t b;
+                size_t d;
+                uintmax_t domain_size;
+            };
+
+            /// CBC-MAC state after `P` and all but last block of `Q`, and the last block of `Q` with
+            /// round number and numeral still unset. Depends on tweak only.
+            struct tweak_state_t
+            {
+                block_t state;
+                block_t last_block;
+            };
+
+        private:
+            static params_t make_params( uint32_t radix, size_t length, uintmax_t domain_size );
+            static size_t domain_length( uintmax_t domain_size );
+
+            void make_tweak_state( gsl::span< gsl::byte const > tweak, tweak_state_t & tweak_state ) const;
+
+            block_t round_block( tweak_state_t const & tweak_state, size_t const round, uint64_t const numeral ) const;
+            wide_t block_to_y( block_t const & block ) const;
+
+            void encrypt_halves( tweak_state_t const & tweak_state, uint64_t & a, uint64_t & b ) const;
+            void decrypt_halves( tweak_state_t const & tweak_state, uint64_t & a, uint64_t & b ) const;
+
+            uint64_t numerals_to_int( gsl::span< numeral_t const > numerals ) const;
+            void int_to_numerals( uint64_t value, gsl::span< numeral_t > numerals ) const;
+
+            void check_integer( std::string const & function ) const;
+            void check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const;
+            void check_numerals( gsl::span< numeral_t const > numerals, gsl::span< numeral_t > results, std::string const & function ) const;
+
+        private:
+            const params_t _params;
+
+            block_cipher_t _cipher;
+
+            /// State for empty tweak, used by integer interface.
+            tweak_state_t _empty_tweak_state;
+        };
+
+        typedef basic_fpe_ff1< vdr::cipher::aes128 > fpe_ff1;
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        #define TO_STR(x) #x
+
+        template< class BlockCipher >
+        basic_fpe_ff1<BlockCipher>::basic_fpe_ff1( uintmax_t domain_size, std::string const & raw_key )
+            : _params( make_params( 2, domain_length( domain_size ), domain_size ) )
+            , _cipher( unkeyed )
+        {
+            vdr::mac::hmac< vdr::hash::sha256 > mac( gsl::as_bytes( gsl::as_span(raw_key) ) );
+            auto derived_key = mac.get_empty_digest();
+            mac
+                << gsl::as_bytes( gsl::ensure_z("for ff1 key") )
+                >> derived_key;
+            _cipher.set_enc_key( derived_key );
+            vdr::wipe( derived_key );
+
+            make_tweak_state( gsl::span< gsl::byte const >(), _empty_tweak_state );
+        }
+
+        template< class BlockCipher >
+        basic_fpe_ff1<BlockCipher>::basic_fpe_ff1( uint32_t radix, size_t length, gsl::span< gsl::byte const, block_cipher::key_bytes > key )
+            : _params( make_params( radix, length, 0 ) )
+            , _cipher( unkeyed )
+        {
+            _cipher.set_enc_key( key );
+
+            make_tweak_state( gsl::span< gsl::byte const >(), _empty_tweak_state );
+        }
+
+        template< class BlockCipher >
+        basic_fpe_ff1<BlockCipher>::~basic_fpe_ff1()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &_empty_tweak_state, 1 ) ) );
+        }
+
+
+        /// `domain_size` is zero for numeral string constructor, then it is `radix ^ length` if fits.
+        template< class BlockCipher >
+        typename basic_fpe_ff1<BlockCipher>::params_t basic_fpe_ff1<BlockCipher>::make_params( uint32_t radix, size_t length, uintmax_t domain_size )
+        {
+            if( radix < min_radix or radix > max_radix )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff1 ) "::" + std::string( __FUNCTION__ ) + ": radix is out of range" );
+            }
+            if( length < 2 )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff1 ) "::" + std::string( __FUNCTION__ ) + ": numeral strings are too short" );
+            }
+
+            params_t params;
+            params.radix = radix;
+            params.length = length;
+            params.u = length / 2;
+            params.v = length - params.u;
+
+            uintmax_t const saturated = std::numeric_limits< uintmax_t >::max();
+            params.modulus_u = saturated_pow( radix, params.u );
+            params.modulus_v = saturated_pow( radix, params.v );
+            if( params.modulus_v == saturated )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff1 ) "::" + std::string( __FUNCTION__ ) + ": half of numeral string does not fit 64 bits" );
+            }
+
+            uintmax_t const full_domain_size = saturated_pow( radix, length );
+            if( full_domain_size < min_domain_size )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff1 ) "::" + std::string( __FUNCTION__ ) + ": domain is too small, use basic_fpe_feistel" );
+            }
+
+            // b = ceil( ceil( v * log2( radix ) ) / 8 ), the bit length of `radix ^ v - 1`
+            size_t const v_bits = int_log2( params.modulus_v - 1 ) + 1;
+            params.b = ( v_bits + bits_in_byte - 1 ) / bits_in_byte;
+            params.d = 4 * ( ( params.b + 3 ) / 4 ) + 4;
+            static_assert( block_cipher_t::block_bytes >= 12, "`y` must come from first block, half fits 64 bits" );
+
+            if( domain_size == 0 )
+            {
+                params.domain_size = ( full_domain_size == saturated ? 0 : full_domain_size );
+            }
+            else
+            {
+                params.domain_size = domain_size;
+            }
+
+            return params;
+        }
+
+        template< class BlockCipher >
+        size_t basic_fpe_ff1<BlockCipher>::domain_length( uintmax_t domain_size )
+        {
+            if( domain_size > ( uintmax_t(1) << ( std::numeric_limits< uintmax_t >::digits - 1 ) ) )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff1 ) "::" + std::string( __FUNCTION__ ) + ": domain is too large" );
+            }
+            return int_log2( up_to_pow2( domain_size ) );
+        }
+
+
+        /// P || Q, where P = [1]^1 || [2]^1 || [1]^1 || [radix]^3 || [10]^1 || [u mod 256]^1 || [n]^4 || [t]^4
+        /// and Q = T || [0]^((-t-b-1) mod 16) || [i]^1 || [NUM(B)]^b. Everything but the last block of Q
+        /// is the same for all rounds, so it is run through CBC-MAC once.
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::make_tweak_state( gsl::span< gsl::byte const > tweak, tweak_state_t & tweak_state ) const
+        {
+            size_t const t = tweak.size_bytes();
+            if( t > std::numeric_limits< uint32_t >::max() )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff1 ) "::" + std::string( __FUNCTION__ ) + ": tweak is too long" );
+            }
+
+            size_t const n = _params.length;
+            block_t p = {{
+                1, 2, 1,
+                uint8_t( _params.radix >> 16 ), uint8_t( _params.radix >> 8 ), uint8_t( _params.radix ),
+                rounds, uint8_t( _params.u ),
+                uint8_t( n >> 24 ), uint8_t( n >> 16 ), uint8_t( n >> 8 ), uint8_t( n ),
+                uint8_t( t >> 24 ), uint8_t( t >> 16 ), uint8_t( t >> 8 ), uint8_t( t ),
+            }};
+            _cipher.enc( gsl::as_bytes( gsl::as_span( p ) ), gsl::as_writeable_bytes( gsl::as_span( tweak_state.state ) ) );
+
+            size_t const block_bytes = block_cipher_t::block_bytes;
+            size_t const q_size = ( t + 1 + _params.b + block_bytes - 1 ) / block_bytes * block_bytes;
+            size_t const last_offset = q_size - block_bytes;
+
+            // T || [0]^pad, numeral and round bytes never reach past the last block
+            auto const q_byte = [ & ]( size_t const offset )
+            {
+                return offset < t ? static_cast< uint8_t >( tweak[ offset ] ) : uint8_t(0);
+            };
+
+            for( size_t offset = 0; offset < last_offset; offset += block_bytes )
+            {
+                block_t block;
+                for( size_t i = 0; i < block_bytes; ++i )
+                {
+                    block[ i ] = tweak_state.state[ i ] ^ q_byte( offset + i );
+                }
+                _cipher.enc( gsl::as_bytes( gsl::as_span( block ) ), gsl::as_writeable_bytes( gsl::as_span( tweak_state.state ) ) );
+                vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( block ) ) );
+            }
+
+            for( size_t i = 0; i < block_bytes; ++i )
+            {
+                tweak_state.last_block[ i ] = q_byte( last_offset + i );
+            }
+        }
+
+        /// Last CBC-MAC input block of round `round`, already xor-ed with the chaining state.
+        template< class BlockCipher >
+        typename basic_fpe_ff1<BlockCipher>::block_t basic_fpe_ff1<BlockCipher>::round_block( tweak_state_t const & tweak_state, size_t const round, uint64_t const numeral ) const
+        {
+            block_t block = tweak_state.last_block;
+
+            size_t const block_bytes = block_cipher_t::block_bytes;
+            block[ block_bytes - _params.b - 1 ] = uint8_t( round );
+            for( size_t i = 0; i < _params.b; ++i )
+            {
+                block[ block_bytes - 1 - i ] = uint8_t( numeral >> ( i * bits_in_byte ) );
+            }
+
+            for( size_t i = 0; i < block_bytes; ++i )
+            {
+                block[ i ] ^= tweak_state.state[ i ];
+            }
+
+            return block;
+        }
+
+        /// y = NUM( first d bytes of R ), d <= 12 while halves fit 64 bits, so S is R itself.
+        template< class BlockCipher >
+        typename basic_fpe_ff1<BlockCipher>::wide_t basic_fpe_ff1<BlockCipher>::block_to_y( block_t const & block ) const
+        {
+            wide_t y = 0;
+            for( size_t i = 0; i < _params.d; ++i )
+            {
+                y = ( y << bits_in_byte ) | block[ i ];
+            }
+            return y;
+        }
+
+
+        /// [[A][B]]
+        /// [[B][(A + y(B)) mod radix^m]]
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::encrypt_halves( tweak_state_t const & tweak_state, uint64_t & a, uint64_t & b ) const
+        {
+            for( size_t round = 0; round < rounds; ++round )
+            {
+                block_t block = round_block( tweak_state, round, b );
+                _cipher.enc( gsl::as_bytes( gsl::as_span( block ) ), gsl::as_writeable_bytes( gsl::as_span( block ) ) );
+
+                uint64_t const modulus = ( round % 2 == 0 ? _params.modulus_u : _params.modulus_v );
+                uint64_t const c = ( wide_t( a ) + wide_mod( block_to_y( block ), modulus ) ) % modulus;
+                a = b;
+                b = c;
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::decrypt_halves( tweak_state_t const & tweak_state, uint64_t & a, uint64_t & b ) const
+        {
+            for( ssize_t round = rounds - 1; round >= 0; --round )
+            {
+                block_t block = round_block( tweak_state, round, a );
+                _cipher.enc( gsl::as_bytes( gsl::as_span( block ) ), gsl::as_writeable_bytes( gsl::as_span( block ) ) );
+
+                uint64_t const modulus = ( round % 2 == 0 ? _params.modulus_u : _params.modulus_v );
+                uint64_t const c = ( wide_t( b ) + modulus - wide_mod( block_to_y( block ), modulus ) ) % modulus;
+                b = a;
+                a = c;
+            }
+        }
+
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff1<BlockCipher>::encrypt( uintmax_t value ) const
+        {
+            check_integer( __FUNCTION__ );
+            if( value >= _params.domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_fpe_ff1 ) "::" + std::string( __FUNCTION__ ) + ": value is out of domain" );
+            }
+
+            do
+            {
+                uint64_t a = value / _params.modulus_v;
+                uint64_t b = value % _params.modulus_v;
+                encrypt_halves( _empty_tweak_state, a, b );
+                value = a * _params.modulus_v + b;
+            }
+            while( value >= _params.domain_size );
+
+            return value;
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff1<BlockCipher>::decrypt( uintmax_t value ) const
+        {
+            check_integer( __FUNCTION__ );
+            if( value >= _params.domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_fpe_ff1 ) "::" + std::string( __FUNCTION__ ) + ": value is out of domain" );
+            }
+
+            do
+            {
+                uint64_t a = value / _params.modulus_v;
+                uint64_t b = value % _params.modulus_v;
+                decrypt_halves( _empty_tweak_state, a, b );
+                value = a * _params.modulus_v + b;
+            }
+            while( value >= _params.domain_size );
+
+            return value;
+        }
+
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+
+            std::array< uint64_t, batch_lanes > lane_as;
+            std::array< uint64_t, batch_lanes > lane_bs;
+            std::array< size_t, batch_lanes > lane_indexes;
+            std::array< block_t, batch_lanes > blocks;
+
+            size_t lanes = 0;
+            size_t next = 0;
+            while( lanes != 0 or next != values.size() )
+            {
+                for( ; lanes < batch_lanes and next < values.size(); ++lanes, ++next )
+                {
+                    lane_as[ lanes ] = values[ next ] / _params.modulus_v;
+                    lane_bs[ lanes ] = values[ next ] % _params.modulus_v;
+                    lane_indexes[ lanes ] = next;
+                }
+
+                for( size_t round = 0; round < rounds; ++round )
+                {
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        blocks[ lane ] = round_block( _empty_tweak_state, round, lane_bs[ lane ] );
+                    }
+
+                    _cipher.enc_blocks(
+                        gsl::as_bytes( gsl::as_span( blocks ).first( lanes ) ),
+                        gsl::as_writeable_bytes( gsl::as_span( blocks ).first( lanes ) )
+                    );
+
+                    uint64_t const modulus = ( round % 2 == 0 ? _params.modulus_u : _params.modulus_v );
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        uint64_t const c = ( wide_t( lane_as[ lane ] ) + wide_mod( block_to_y( blocks[ lane ] ), modulus ) ) % modulus;
+                        lane_as[ lane ] = lane_bs[ lane ];
+                        lane_bs[ lane ] = c;
+                    }
+                }
+
+                // Retire lanes which walked into the domain, the rest walk one more cycle.
+                size_t walking = 0;
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    uintmax_t const value = lane_as[ lane ] * _params.modulus_v + lane_bs[ lane ];
+                    if( value < _params.domain_size )
+                    {
+                        results[ lane_indexes[ lane ] ] = value;
+                    }
+                    else
+                    {
+                        lane_as[ walking ] = lane_as[ lane ];
+                        lane_bs[ walking ] = lane_bs[ lane ];
+                        lane_indexes[ walking ] = lane_indexes[ lane ];
+                        ++walking;
+                    }
+                }
+                lanes = walking;
+            }
+
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( blocks ) ) );
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+
+            std::array< uint64_t, batch_lanes > lane_as;
+            std::array< uint64_t, batch_lanes > lane_bs;
+            std::array< size_t, batch_lanes > lane_indexes;
+            std::array< block_t, batch_lanes > blocks;
+
+            size_t lanes = 0;
+            size_t next = 0;
+            while( lanes != 0 or next != values.size() )
+            {
+                for( ; lanes < batch_lanes and next < values.size(); ++lanes, ++next )
+                {
+                    lane_as[ lanes ] = values[ next ] / _params.modulus_v;
+                    lane_bs[ lanes ] = values[ next ] % _params.modulus_v;
+                    lane_indexes[ lanes ] = next;
+                }
+
+                for( ssize_t round = rounds - 1; round >= 0; --round )
+                {
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        blocks[ lane ] = round_block( _empty_tweak_state, round, lane_as[ lane ] );
+                    }
+
+                    _cipher.enc_blocks(
+                        gsl::as_bytes( gsl::as_span( blocks ).first( lanes ) ),
+                        gsl::as_writeable_bytes( gsl::as_span( blocks ).first( lanes ) )
+                    );
+
+                    uint64_t const modulus = ( round % 2 == 0 ? _params.modulus_u : _params.modulus_v );
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        uint64_t const c = ( wide_t( lane_bs[ lane ] ) + modulus - wide_mod( block_to_y( blocks[ lane ] ), modulus ) ) % modulus;
+                        lane_bs[ lane ] = lane_as[ lane ];
+                        lane_as[ lane ] = c;
+                    }
+                }
+
+                // Retire lanes which walked into the domain, the rest walk one more cycle.
+                size_t walking = 0;
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    uintmax_t const value = lane_as[ lane ] * _params.modulus_v + lane_bs[ lane ];
+                    if( value < _params.domain_size )
+                    {
+                        results[ lane_indexes[ lane ] ] = value;
+                    }
+                    else
+                    {
+                        lane_as[ walking ] = lane_as[ lane ];
+                        lane_bs[ walking ] = lane_bs[ lane ];
+                        lane_indexes[ walking ] = lane_indexes[ lane ];
+                        ++walking;
+                    }
+                }
+                lanes = walking;
+            }
+
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( blocks ) ) );
+        }
+
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::encrypt( gsl::span< numeral_t const > numerals, gsl::span< gsl::byte const > tweak, gsl::span< numeral_t > results ) const
+        {
+            check_numerals( numerals, results, __FUNCTION__ );
+
+            uint64_t a = numerals_to_int( numerals.first( _params.u ) );
+            uint64_t b = numerals_to_int( numerals.last( _params.v ) );
+
+            if( tweak.empty() )
+            {
+                encrypt_halves( _empty_tweak_state, a, b );
+            }
+            else
+            {
+                tweak_state_t tweak_state;
+                make_tweak_state( tweak, tweak_state );
+                encrypt_halves( tweak_state, a, b );
+                vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &tweak_state, 1 ) ) );
+            }
+
+            int_to_numerals( a, results.first( _params.u ) );
+            int_to_numerals( b, results.last( _params.v ) );
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::decrypt( gsl::span< numeral_t const > numerals, gsl::span< gsl::byte const > tweak, gsl::span< numeral_t > results ) const
+        {
+            check_numerals( numerals, results, __FUNCTION__ );
+
+            uint64_t a = numerals_to_int( numerals.first( _params.u ) );
+            uint64_t b = numerals_to_int( numerals.last( _params.v ) );
+
+            if( tweak.empty() )
+            {
+                decrypt_halves( _empty_tweak_state, a, b );
+            }
+            else
+            {
+                tweak_state_t tweak_state;
+                make_tweak_state( tweak, tweak_state );
+                decrypt_halves( tweak_state, a, b );
+                vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &tweak_state, 1 ) ) );
+            }
+
+            int_to_numerals( a, results.first( _params.u ) );
+            int_to_numerals( b, results.last( _params.v ) );
+        }
+
+
+        /// NUM_radix: first numeral is the most significant.
+        template< class BlockCipher >
+        uint64_t basic_fpe_ff1<BlockCipher>::numerals_to_int( gsl::span< numeral_t const > numerals ) const
+        {
+            uint64_t result = 0;
+            for( auto const numeral : numerals )
+            {
+                result = result * _params.radix + numeral;
+            }
+            return result;
+        }
+
+        /// STR^m_radix, m is size of `numerals`.
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::int_to_numerals( uint64_t value, gsl::span< numeral_t > numerals ) const
+        {
+            for( ssize_t i = numerals.size() - 1; i >= 0; --i )
+            {
+                numerals[ i ] = numeral_t( value % _params.radix );
+                value /= _params.radix;
+            }
+        }
+
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::check_integer( std::string const & function ) const
+        {
+            if( _params.domain_size == 0 )
+            {
+                throw std::domain_error( TO_STR( basic_fpe_ff1 ) "::" + function + ": numeral strings do not fit integer values" );
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const
+        {
+            check_integer( function );
+
+            if( values.size() != results.size() )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff1 ) "::" + function + ": values and results sizes differ" );
+            }
+
+            for( auto const value : values )
+            {
+                if( value >= _params.domain_size )
+                {
+                    throw std::overflow_error( TO_STR( basic_fpe_ff1 ) "::" + function + ": value is out of domain" );
+                }
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff1<BlockCipher>::check_numerals( gsl::span< numeral_t const > numerals, gsl::span< numeral_t > results, std::string const & function ) const
+        {
+            if( size_t( numerals.size() ) != _params.length or size_t( results.size() ) != _params.length )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff1 ) "::" + function + ": numeral string length differs from domain" );
+            }
+
+            for( auto const numeral : numerals )
+            {
+                if( numeral >= _params.radix )
+                {
+                    throw std::overflow_error( TO_STR( basic_fpe_ff1 ) "::" + function + ": numeral is out of radix" );
+                }
+            }
+        }
+
+    }
+}
+
+
+#undef TO_STR
+
+#endif // INCLUDED__VDR_CIPHER_FF1_H
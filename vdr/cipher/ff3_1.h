@@ -0,0 +1,676 @@
+#ifndef INCLUDED__VDR_CIPHER_FF3_1_H
+#define INCLUDED__VDR_CIPHER_FF3_1_H
+
+#include "vdr/cipher/fpe_feistel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// FF3-1 format-preserving encryption (NIST SP 800-38G Rev. 1): balanced Feistel with 8 rounds,
+        /// one block cipher call per round and 56 bit tweak. Numeral string halves are kept as integers
+        /// of reversed numerals, so `radix ^ ceil( length / 2 )` must fit in 64 bits.
+        ///
+        /// Has the same integer surface as `basic_fpe_feistel` and can replace it per domain. For
+        /// integer domains values are radix 2 numeral strings and values out of domain are cycle walked.
+        ///
+        /// BlockCipher is a policy with `aes`-like interface, see `basic_thorp_shuffle`.
+        template< class BlockCipher = vdr::cipher::aes128 >
+        class basic_fpe_ff3_1
+        {
+        public:
+            typedef BlockCipher block_cipher;
+            typedef uintmax_t value_type;
+            typedef uint16_t numeral_t;
+
+        public:
+            enum : size_t { rounds = 8 };
+            enum : size_t { tweak_bytes = 7 };
+            enum : size_t { batch_lanes = 64 };
+            enum : uint32_t { min_radix = 2 };
+            enum : uint32_t { max_radix = uint32_t(1) << 16 };
+            /// SP 800-38G Rev. 1 lower bound for `radix ^ length`.
+            enum : uintmax_t { min_domain_size = 1000000 };
+
+        public:
+            typedef std::array< gsl::byte, tweak_bytes > tweak_arr;
+
+        public:
+            /// Integer domain [0, domain_size), key is derived from `raw_key` like in `basic_thorp_shuffle`.
+            basic_fpe_ff3_1( uintmax_t domain_size, std::string const & raw_key );
+
+            /// Numeral strings of `length` digits in `radix`, `key` is used as AES key as is.
+            basic_fpe_ff3_1( uint32_t radix, size_t length, gsl::span< gsl::byte const, block_cipher::key_bytes > key );
+
+            /// Integer versions use zero tweak unless one is given. All calls are const and may run
+            /// in parallel on one instance.
+            uintmax_t encrypt( uintmax_t value ) const;
+            uintmax_t decrypt( uintmax_t value ) const;
+            uintmax_t encrypt( uintmax_t value, gsl::span< gsl::byte const, tweak_bytes > tweak ) const;
+            uintmax_t decrypt( uintmax_t value, gsl::span< gsl::byte const, tweak_bytes > tweak ) const;
+
+            /// Batch versions, same contract as in `basic_fpe_feistel`.
+            void encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+            void decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+
+            /// Numeral string versions. `numerals` and `results` must have `get_length()` numerals and
+            /// may be the same buffer.
+            void encrypt( gsl::span< numeral_t const > numerals, gsl::span< gsl::byte const, tweak_bytes > tweak, gsl::span< numeral_t > results ) const;
+            void decrypt( gsl::span< numeral_t const > numerals, gsl::span< gsl::byte const, tweak_bytes > tweak, gsl::span< numeral_t > results ) const;
+
+            /// Zero if `radix ^ length` does not fit `uintmax_t`, then only numeral strings are usable.
+            uintmax_t get_domain_size() const { return _params.domain_size; }
+            uint32_t get_radix() const { return _params.radix; }
+            size_t get_length() const { return _params.length; }
+
+            static constexpr tweak_arr get_empty_tweak() { return tweak_arr{}; }
+
+        private:
+            typedef block_cipher block_cipher_t;
+            typedef std::array< uint8_t, block_cipher_t::block_bytes > block_t;
+            typedef unsigned __int128 wide_t;
+
+            struct params_t
+            {
+                uint32_t radix;
+                size_t length;
+                size_t u;
+                size_t v;
+                uint64_t modulus_u;
+                uint64_t modulus_v;
+                uintmax_t domain_size;
+            };
+
+            /// T_L and T_R, byte reversed and xor-ed into the high end of every round block.
+            struct tweak_state_t
+            {
+                std::array< uint8_t, 4 > left;
+                std::array< uint8_t, 4 > right;
+            };
+
+            /// Halves as NUM_radix( REV( A ) ) and NUM_radix( REV( B ) ).
+            struct halves_t
+            {
+                uint64_t a;
+                uint64_t b;
+            };
+
+        private:
+            static params_t make_params( uint32_t radix, size_t length, uintmax_t domain_size );
+            static size_t domain_length( uintmax_t domain_size );
+            static tweak_state_t make_tweak_state( gsl::span< gsl::byte const, tweak_bytes > tweak );
+
+            void set_key( gsl::span< gsl::byte const, block_cipher::key_bytes > key );
+
+            block_t round_block( tweak_state_t const & tweak_state, size_t const round, uint64_t const numeral ) const;
+            wide_t block_to_y( block_t const & block ) const;
+
+            void encrypt_halves( tweak_state_t const & tweak_state, halves_t & halves ) const;
+            void decrypt_halves( tweak_state_t const & tweak_state, halves_t & halves ) const;
+
+            uint64_t reverse_numerals( uint64_t value, size_t length ) const;
+            halves_t int_to_halves( uintmax_t value ) const;
+            uintmax_t halves_to_int( halves_t const & halves ) const;
+
+            uintmax_t encrypt_int( uintmax_t value, tweak_state_t const & tweak_state, std::string const & function ) const;
+            uintmax_t decrypt_int( uintmax_t value, tweak_state_t const & tweak_state, std::string const & function ) const;
+
+            void check_integer( std::string const & function ) const;
+            void check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const;
+            void check_numerals( gsl::span< numeral_t const > numerals, gsl::span< numeral_t > results, std::string const & function ) const;
+
+        private:
+            const params_t _params;
+
+            block_cipher_t _cipher;
+        };
+
+        typedef basic_fpe_ff3_1< vdr::cipher::aes128 > fpe_ff3_1;
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        #define TO_STR(x) #x
+
+        template< class BlockCipher >
+        basic_fpe_ff3_1<BlockCipher>::basic_fpe_ff3_1( uintmax_t domain_size, std::string const & raw_key )
+            : _params( make_params( 2, domain_length( domain_size ), domain_size ) )
+            , _cipher( unkeyed )
+        {
+            vdr::mac::hmac< vdr::hash::sha256 > mac( gsl::as_bytes( gsl::as_span(raw_key) ) );
+            auto derived_key = mac.get_empty_digest();
+            mac
+                << gsl::as_bytes( gsl::ensure_z("for ff3-1 key") )
+                >> derived_key;
+            set_key( derived_key );
+            vdr::wipe( derived_key );
+        }
+
+        template< class BlockCipher >
+        basic_fpe_ff3_1<BlockCipher>::basic_fpe_ff3_1( uint32_t radix, size_t length, gsl::span< gsl::byte const, block_cipher::key_bytes > key )
+            : _params( make_params( radix, length, 0 ) )
+            , _cipher( unkeyed )
+        {
+            set_key( key );
+        }
+
+
+        /// `domain_size` is zero for numeral string constructor, then it is `radix ^ length` if fits.
+        template< class BlockCipher >
+        typename basic_fpe_ff3_1<BlockCipher>::params_t basic_fpe_ff3_1<BlockCipher>::make_params( uint32_t radix, size_t length, uintmax_t domain_size )
+        {
+            if( radix < min_radix or radix > max_radix )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff3_1 ) "::" + std::string( __FUNCTION__ ) + ": radix is out of range" );
+            }
+            if( length < 2 )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff3_1 ) "::" + std::string( __FUNCTION__ ) + ": numeral strings are too short" );
+            }
+
+            params_t params;
+            params.radix = radix;
+            params.length = length;
+            params.u = length - length / 2;
+            params.v = length / 2;
+
+            // Also keeps `length` under SP 800-38G maximum of 2 * floor( log_radix( 2 ^ 96 ) ).
+            uintmax_t const saturated = std::numeric_limits< uintmax_t >::max();
+            params.modulus_u = saturated_pow( radix, params.u );
+            params.modulus_v = saturated_pow( radix, params.v );
+            if( params.modulus_u == saturated )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff3_1 ) "::" + std::string( __FUNCTION__ ) + ": half of numeral string does not fit 64 bits" );
+            }
+
+            uintmax_t const full_domain_size = saturated_pow( radix, length );
+            if( full_domain_size < min_domain_size )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff3_1 ) "::" + std::string( __FUNCTION__ ) + ": domain is too small, use basic_fpe_feistel" );
+            }
+
+            if( domain_size == 0 )
+            {
+                params.domain_size = ( full_domain_size == saturated ? 0 : full_domain_size );
+            }
+            else
+            {
+                params.domain_size = domain_size;
+            }
+
+            return params;
+        }
+
+        template< class BlockCipher >
+        size_t basic_fpe_ff3_1<BlockCipher>::domain_length( uintmax_t domain_size )
+        {
+            if( domain_size > ( uintmax_t(1) << ( std::numeric_limits< uintmax_t >::digits - 1 ) ) )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff3_1 ) "::" + std::string( __FUNCTION__ ) + ": domain is too large" );
+            }
+            return int_log2( up_to_pow2( domain_size ) );
+        }
+
+        /// T_L = T[0..27] || 0^4, T_R = T[32..55] || T[28..31] || 0^4.
+        template< class BlockCipher >
+        typename basic_fpe_ff3_1<BlockCipher>::tweak_state_t basic_fpe_ff3_1<BlockCipher>::make_tweak_state( gsl::span< gsl::byte const, tweak_bytes > tweak )
+        {
+            auto const t = [ & ]( size_t const i ) { return static_cast< uint8_t >( tweak[ i ] ); };
+
+            tweak_state_t tweak_state;
+            tweak_state.left = {{ uint8_t( t( 3 ) & 0xf0 ), t( 2 ), t( 1 ), t( 0 ) }};
+            tweak_state.right = {{ uint8_t( t( 3 ) << 4 ), t( 6 ), t( 5 ), t( 4 ) }};
+            return tweak_state;
+        }
+
+        /// FF3-1 encrypts under REVB( K ).
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::set_key( gsl::span< gsl::byte const, block_cipher::key_bytes > key )
+        {
+            std::array< gsl::byte, block_cipher::key_bytes > reversed_key;
+            std::reverse_copy( key.begin(), key.end(), reversed_key.begin() );
+            _cipher.set_enc_key( reversed_key );
+            vdr::wipe( reversed_key );
+        }
+
+
+        /// REVB( W ^ [i]^4 || [NUM_radix( REV( B ) )]^12 ): the numeral goes little endian into the
+        /// low 12 bytes, the reversed tweak half into the high 4 bytes.
+        template< class BlockCipher >
+        typename basic_fpe_ff3_1<BlockCipher>::block_t basic_fpe_ff3_1<BlockCipher>::round_block( tweak_state_t const & tweak_state, size_t const round, uint64_t const numeral ) const
+        {
+            block_t block;
+            std::fill( block.begin(), block.end(), 0 );
+
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            std::memcpy( block.data(), &numeral, sizeof( numeral ) );
+        #else
+            for( size_t i = 0; i < sizeof( numeral ); ++i )
+            {
+                block[ i ] = uint8_t( numeral >> ( i * bits_in_byte ) );
+            }
+        #endif
+
+            auto const & w = ( round % 2 == 0 ? tweak_state.right : tweak_state.left );
+            std::copy( w.begin(), w.end(), block.end() - w.size() );
+            block[ block.size() - w.size() ] ^= uint8_t( round );
+
+            return block;
+        }
+
+        /// y = NUM( REVB( block ) ), i.e. the block read little endian.
+        template< class BlockCipher >
+        typename basic_fpe_ff3_1<BlockCipher>::wide_t basic_fpe_ff3_1<BlockCipher>::block_to_y( block_t const & block ) const
+        {
+            static_assert( sizeof( wide_t ) == std::tuple_size< block_t >::value, "" );
+
+            wide_t y = 0;
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            std::memcpy( &y, block.data(), sizeof( y ) );
+        #else
+            for( size_t i = block.size(); i > 0; --i )
+            {
+                y = ( y << bits_in_byte ) | block[ i - 1 ];
+            }
+        #endif
+            return y;
+        }
+
+
+        /// [[A][B]]
+        /// [[B][(A + y(B)) mod radix^m]]
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::encrypt_halves( tweak_state_t const & tweak_state, halves_t & halves ) const
+        {
+            for( size_t round = 0; round < rounds; ++round )
+            {
+                block_t block = round_block( tweak_state, round, halves.b );
+                _cipher.enc( gsl::as_bytes( gsl::as_span( block ) ), gsl::as_writeable_bytes( gsl::as_span( block ) ) );
+
+                uint64_t const modulus = ( round % 2 == 0 ? _params.modulus_u : _params.modulus_v );
+                uint64_t const c = ( wide_t( halves.a ) + wide_mod( block_to_y( block ), modulus ) ) % modulus;
+                halves.a = halves.b;
+                halves.b = c;
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::decrypt_halves( tweak_state_t const & tweak_state, halves_t & halves ) const
+        {
+            for( ssize_t round = rounds - 1; round >= 0; --round )
+            {
+                block_t block = round_block( tweak_state, round, halves.a );
+                _cipher.enc( gsl::as_bytes( gsl::as_span( block ) ), gsl::as_writeable_bytes( gsl::as_span( block ) ) );
+
+                uint64_t const modulus = ( round % 2 == 0 ? _params.modulus_u : _params.modulus_v );
+                uint64_t const c = ( wide_t( halves.b ) + modulus - wide_mod( block_to_y( block ), modulus ) ) % modulus;
+                halves.b = halves.a;
+                halves.a = c;
+            }
+        }
+
+
+        /// NUM_radix( REV( STR^length_radix( value ) ) )
+        template< class BlockCipher >
+        uint64_t basic_fpe_ff3_1<BlockCipher>::reverse_numerals( uint64_t value, size_t length ) const
+        {
+            uint64_t result = 0;
+            for( size_t i = 0; i < length; ++i )
+            {
+                result = result * _params.radix + value % _params.radix;
+                value /= _params.radix;
+            }
+            return result;
+        }
+
+        /// Value is NUM_radix( A || B ), A is the longer half.
+        template< class BlockCipher >
+        typename basic_fpe_ff3_1<BlockCipher>::halves_t basic_fpe_ff3_1<BlockCipher>::int_to_halves( uintmax_t value ) const
+        {
+            halves_t halves;
+            halves.a = reverse_numerals( value / _params.modulus_v, _params.u );
+            halves.b = reverse_numerals( value % _params.modulus_v, _params.v );
+            return halves;
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff3_1<BlockCipher>::halves_to_int( halves_t const & halves ) const
+        {
+            return reverse_numerals( halves.a, _params.u ) * _params.modulus_v + reverse_numerals( halves.b, _params.v );
+        }
+
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff3_1<BlockCipher>::encrypt( uintmax_t value ) const
+        {
+            return encrypt_int( value, make_tweak_state( get_empty_tweak() ), __FUNCTION__ );
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff3_1<BlockCipher>::decrypt( uintmax_t value ) const
+        {
+            return decrypt_int( value, make_tweak_state( get_empty_tweak() ), __FUNCTION__ );
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff3_1<BlockCipher>::encrypt( uintmax_t value, gsl::span< gsl::byte const, tweak_bytes > tweak ) const
+        {
+            return encrypt_int( value, make_tweak_state( tweak ), __FUNCTION__ );
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff3_1<BlockCipher>::decrypt( uintmax_t value, gsl::span< gsl::byte const, tweak_bytes > tweak ) const
+        {
+            return decrypt_int( value, make_tweak_state( tweak ), __FUNCTION__ );
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff3_1<BlockCipher>::encrypt_int( uintmax_t value, tweak_state_t const & tweak_state, std::string const & function ) const
+        {
+            check_integer( function );
+            if( value >= _params.domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_fpe_ff3_1 ) "::" + function + ": value is out of domain" );
+            }
+
+            halves_t halves = int_to_halves( value );
+            do
+            {
+                encrypt_halves( tweak_state, halves );
+                value = halves_to_int( halves );
+            }
+            while( value >= _params.domain_size );
+
+            return value;
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_ff3_1<BlockCipher>::decrypt_int( uintmax_t value, tweak_state_t const & tweak_state, std::string const & function ) const
+        {
+            check_integer( function );
+            if( value >= _params.domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_fpe_ff3_1 ) "::" + function + ": value is out of domain" );
+            }
+
+            halves_t halves = int_to_halves( value );
+            do
+            {
+                decrypt_halves( tweak_state, halves );
+                value = halves_to_int( halves );
+            }
+            while( value >= _params.domain_size );
+
+            return value;
+        }
+
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+
+            tweak_state_t const tweak_state = make_tweak_state( get_empty_tweak() );
+
+            std::array< halves_t, batch_lanes > lane_halves;
+            std::array< size_t, batch_lanes > lane_indexes;
+            std::array< block_t, batch_lanes > blocks;
+
+            size_t lanes = 0;
+            size_t next = 0;
+            while( lanes != 0 or next != values.size() )
+            {
+                for( ; lanes < batch_lanes and next < values.size(); ++lanes, ++next )
+                {
+                    lane_halves[ lanes ] = int_to_halves( values[ next ] );
+                    lane_indexes[ lanes ] = next;
+                }
+
+                for( size_t round = 0; round < rounds; ++round )
+                {
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        blocks[ lane ] = round_block( tweak_state, round, lane_halves[ lane ].b );
+                    }
+
+                    _cipher.enc_blocks(
+                        gsl::as_bytes( gsl::as_span( blocks ).first( lanes ) ),
+                        gsl::as_writeable_bytes( gsl::as_span( blocks ).first( lanes ) )
+                    );
+
+                    uint64_t const modulus = ( round % 2 == 0 ? _params.modulus_u : _params.modulus_v );
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        halves_t & halves = lane_halves[ lane ];
+                        uint64_t const c = ( wide_t( halves.a ) + wide_mod( block_to_y( blocks[ lane ] ), modulus ) ) % modulus;
+                        halves.a = halves.b;
+                        halves.b = c;
+                    }
+                }
+
+                // Retire lanes which walked into the domain, the rest walk one more cycle.
+                size_t walking = 0;
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    uintmax_t const value = halves_to_int( lane_halves[ lane ] );
+                    if( value < _params.domain_size )
+                    {
+                        results[ lane_indexes[ lane ] ] = value;
+                    }
+                    else
+                    {
+                        lane_halves[ walking ] = lane_halves[ lane ];
+                        lane_indexes[ walking ] = lane_indexes[ lane ];
+                        ++walking;
+                    }
+                }
+                lanes = walking;
+            }
+
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( blocks ) ) );
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+
+            tweak_state_t const tweak_state = make_tweak_state( get_empty_tweak() );
+
+            std::array< halves_t, batch_lanes > lane_halves;
+            std::array< size_t, batch_lanes > lane_indexes;
+            std::array< block_t, batch_lanes > blocks;
+
+            size_t lanes = 0;
+            size_t next = 0;
+            while( lanes != 0 or next != values.size() )
+            {
+                for( ; lanes < batch_lanes and next < values.size(); ++lanes, ++next )
+                {
+                    lane_halves[ lanes ] = int_to_halves( values[ next ] );
+                    lane_indexes[ lanes ] = next;
+                }
+
+                for( ssize_t round = rounds - 1; round >= 0; --round )
+                {
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        blocks[ lane ] = round_block( tweak_state, round, lane_halves[ lane ].a );
+                    }
+
+                    _cipher.enc_blocks(
+                        gsl::as_bytes( gsl::as_span( blocks ).first( lanes ) ),
+                        gsl::as_writeable_bytes( gsl::as_span( blocks ).first( lanes ) )
+                    );
+
+                    uint64_t const modulus = ( round % 2 == 0 ? _params.modulus_u : _params.modulus_v );
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        halves_t & halves = lane_halves[ lane ];
+                        uint64_t const c = ( wide_t( halves.b ) + modulus - wide_mod( block_to_y( blocks[ lane ] ), modulus ) ) % modulus;
+                        halves.b = halves.a;
+                        halves.a = c;
+                    }
+                }
+
+                // Retire lanes which walked into the domain, the rest walk one more cycle.
+                size_t walking = 0;
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    uintmax_t const value = halves_to_int( lane_halves[ lane ] );
+                    if( value < _params.domain_size )
+                    {
+                        results[ lane_indexes[ lane ] ] = value;
+                    }
+                    else
+                    {
+                        lane_halves[ walking ] = lane_halves[ lane ];
+                        lane_indexes[ walking ] = lane_indexes[ lane ];
+                        ++walking;
+                    }
+                }
+                lanes = walking;
+            }
+
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( blocks ) ) );
+        }
+
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::encrypt( gsl::span< numeral_t const > numerals, gsl::span< gsl::byte const, tweak_bytes > tweak, gsl::span< numeral_t > results ) const
+        {
+            check_numerals( numerals, results, __FUNCTION__ );
+
+            // NUM_radix( REV( X ) ): last numeral is the most significant.
+            auto const reversed_num = [ & ]( gsl::span< numeral_t const > part )
+            {
+                uint64_t result = 0;
+                for( ssize_t i = part.size() - 1; i >= 0; --i )
+                {
+                    result = result * _params.radix + part[ i ];
+                }
+                return result;
+            };
+
+            halves_t halves;
+            halves.a = reversed_num( numerals.first( _params.u ) );
+            halves.b = reversed_num( numerals.last( _params.v ) );
+
+            encrypt_halves( make_tweak_state( tweak ), halves );
+
+            // REV( STR^m_radix( c ) ): least significant numeral goes first.
+            auto const reversed_str = [ & ]( uint64_t value, gsl::span< numeral_t > part )
+            {
+                for( auto & numeral : part )
+                {
+                    numeral = numeral_t( value % _params.radix );
+                    value /= _params.radix;
+                }
+            };
+
+            reversed_str( halves.a, results.first( _params.u ) );
+            reversed_str( halves.b, results.last( _params.v ) );
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::decrypt( gsl::span< numeral_t const > numerals, gsl::span< gsl::byte const, tweak_bytes > tweak, gsl::span< numeral_t > results ) const
+        {
+            check_numerals( numerals, results, __FUNCTION__ );
+
+            auto const reversed_num = [ & ]( gsl::span< numeral_t const > part )
+            {
+                uint64_t result = 0;
+                for( ssize_t i = part.size() - 1; i >= 0; --i )
+                {
+                    result = result * _params.radix + part[ i ];
+                }
+                return result;
+            };
+
+            halves_t halves;
+            halves.a = reversed_num( numerals.first( _params.u ) );
+            halves.b = reversed_num( numerals.last( _params.v ) );
+
+            decrypt_halves( make_tweak_state( tweak ), halves );
+
+            auto const reversed_str = [ & ]( uint64_t value, gsl::span< numeral_t > part )
+            {
+                for( auto & numeral : part )
+                {
+                    numeral = numeral_t( value % _params.radix );
+                    value /= _params.radix;
+                }
+            };
+
+            reversed_str( halves.a, results.first( _params.u ) );
+            reversed_str( halves.b, results.last( _params.v ) );
+        }
+
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::check_integer( std::string const & function ) const
+        {
+            if( _params.domain_size == 0 )
+            {
+                throw std::domain_error( TO_STR( basic_fpe_ff3_1 ) "::" + function + ": numeral strings do not fit integer values" );
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const
+        {
+            check_integer( function );
+
+            if( values.size() != results.size() )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff3_1 ) "::" + function + ": values and results sizes differ" );
+            }
+
+            for( auto const value : values )
+            {
+                if( value >= _params.domain_size )
+                {
+                    throw std::overflow_error( TO_STR( basic_fpe_ff3_1 ) "::" + function + ": value is out of domain" );
+                }
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_ff3_1<BlockCipher>::check_numerals( gsl::span< numeral_t const > numerals, gsl::span< numeral_t > results, std::string const & function ) const
+        {
+            if( size_t( numerals.size() ) != _params.length or size_t( results.size() ) != _params.length )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_ff3_1 ) "::" + function + ": numeral string length differs from domain" );
+            }
+
+            for( auto const numeral : numerals )
+            {
+                if( numeral >= _params.radix )
+                {
+                    throw std::overflow_error( TO_STR( basic_fpe_ff3_1 ) "::" + function + ": numeral is out of radix" );
+                }
+            }
+        }
+
+    }
+}
+
+
+#undef TO_STR
+
+#endif // INCLUDED__VDR_CIPHER_FF3_1_H
@@ -0,0 +1,181 @@
+#ifndef INCLUDED__VDR_CIPHER_FPE_CACHE_H
+#define INCLUDED__VDR_CIPHER_FPE_CACHE_H
+
+#include "vdr/cipher/fpe_feistel.h"
+#include "vdr/hash/sha2.h"
+#include "vdr/sharded_lru.h"
+#include "vdr/wipe.h"
+
+#include <array>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <openssl/rand.h>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// Bounded cache of ready engines, for services which see many keys and construct an engine
+        /// (key derivation and key schedules) per key otherwise.
+        ///
+        /// Engines are found by fingerprint of (domain size, raw key): SHA-256 prefixed by a random
+        /// per-cache salt, so raw keys are not kept and fingerprints mean nothing outside of the
+        /// cache. It takes one or two compressions, a hit costs little more than that.
+        ///
+        /// Fingerprints are spread over `shards` LRU lists of `vdr::sharded_lru`, so threads asking
+        /// for different keys rarely wait for each other. A full shard evicts its least recently
+        /// used engine, so shards fill unevenly: leave some room above the number of keys which
+        /// should stay cached.
+        ///
+        /// Engine is anything with `( domain_size, raw_key )` constructor. Engines are handed out
+        /// as shared pointers to const, so an evicted engine stays valid while in use, and should
+        /// have const `encrypt`/`decrypt` (see `basic_fpe_feistel`) to be shared between threads.
+        /// On a miss the engine is constructed outside of the shard lock.
+        template< class Engine = vdr::cipher::fpe_feistel >
+        class basic_fpe_cache
+        {
+        private:
+            typedef std::array< uint8_t, vdr::hash::sha256::digest_bytes > fingerprint_t;
+
+            struct fingerprint_hash
+            {
+                size_t operator () ( fingerprint_t const & fingerprint ) const
+                {
+                    size_t result;
+                    static_assert( sizeof( result ) <= sizeof( fingerprint ), "" );
+                    std::memcpy( &result, fingerprint.data(), sizeof( result ) );
+                    return result;
+                }
+            };
+
+            /// Bytes other than the ones `fingerprint_hash` takes, so shards do not skew hash buckets.
+            struct fingerprint_shard
+            {
+                uint64_t operator () ( fingerprint_t const & fingerprint ) const
+                {
+                    uint64_t result;
+                    static_assert( sizeof( size_t ) + sizeof( result ) <= sizeof( fingerprint ), "" );
+                    std::memcpy( &result, fingerprint.data() + sizeof( size_t ), sizeof( result ) );
+                    return result;
+                }
+            };
+
+        public:
+            typedef Engine engine;
+            typedef std::shared_ptr< engine const > engine_ptr;
+
+        private:
+            typedef vdr::sharded_lru< fingerprint_t, engine_ptr, fingerprint_hash, fingerprint_shard > engines_t;
+
+        public:
+            enum : size_t { default_shards = engines_t::default_shards };
+
+            typedef typename engines_t::stats_t stats_t;
+
+        public:
+            /// At most `capacity` engines in all; `shards` is clamped to `capacity`.
+            explicit basic_fpe_cache( size_t capacity, size_t shards = default_shards );
+            ~basic_fpe_cache();
+
+            basic_fpe_cache( basic_fpe_cache const & ) = delete;
+            basic_fpe_cache & operator = ( basic_fpe_cache const & ) = delete;
+
+            /// Engine of `raw_key` over `domain_size`, constructed on a miss.
+            engine_ptr get( uintmax_t domain_size, std::string const & raw_key );
+
+            /// Drops all engines, counters are kept.
+            void clear() { _engines.clear(); }
+
+            size_t size() const { return _engines.size(); }
+            size_t get_capacity() const { return _engines.get_capacity(); }
+
+            /// Counters since construction, each one read atomically.
+            stats_t get_stats() const { return _engines.get_stats(); }
+
+        private:
+            enum : size_t { salt_bytes = 32 };
+
+        private:
+            fingerprint_t fingerprint( uintmax_t domain_size, std::string const & raw_key ) const;
+
+        private:
+            std::array< uint8_t, salt_bytes > _salt;
+
+            engines_t _engines;
+        };
+
+        typedef basic_fpe_cache< vdr::cipher::fpe_feistel > fpe_cache;
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        #define TO_STR(x) #x
+
+        template< class Engine >
+        basic_fpe_cache<Engine>::basic_fpe_cache( size_t capacity, size_t shards )
+            : _engines( capacity, shards )
+        {
+            if( 1 != RAND_bytes( _salt.data(), static_cast< int >( _salt.size() ) ) )
+            {
+                throw std::runtime_error( TO_STR( basic_fpe_cache ) "::" + std::string( __FUNCTION__ ) + ": can't get random salt" );
+            }
+        }
+
+        template< class Engine >
+        basic_fpe_cache<Engine>::~basic_fpe_cache()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _salt ) ) );
+        }
+
+        template< class Engine >
+        typename basic_fpe_cache<Engine>::engine_ptr basic_fpe_cache<Engine>::get( uintmax_t domain_size, std::string const & raw_key )
+        {
+            return _engines.get( fingerprint( domain_size, raw_key ), [ & ]()
+            {
+                return std::make_shared< engine const >( typename engine::value_type( domain_size ), raw_key );
+            } );
+        }
+
+        /// SHA-256( salt | domain size as 8 little endian bytes | raw key ).
+        template< class Engine >
+        typename basic_fpe_cache<Engine>::fingerprint_t basic_fpe_cache<Engine>::fingerprint( uintmax_t domain_size, std::string const & raw_key ) const
+        {
+            std::array< uint8_t, sizeof( uint64_t ) > domain_bytes;
+            for( size_t i = 0; i < domain_bytes.size(); ++i )
+            {
+                domain_bytes[ i ] = uint8_t( uint64_t( domain_size ) >> ( i * 8 ) );
+            }
+
+            vdr::hash::sha256 hash;
+            auto digest = hash.get_empty_digest();
+            hash
+                << gsl::as_bytes( gsl::as_span( _salt ) )
+                << gsl::as_bytes( gsl::as_span( domain_bytes ) )
+                << gsl::as_bytes( gsl::as_span( raw_key ) )
+                >> digest;
+
+            fingerprint_t result;
+            static_assert( sizeof( result ) == sizeof( digest ), "" );
+            std::memcpy( result.data(), digest.data(), result.size() );
+            vdr::wipe( digest );
+            return result;
+        }
+
+    }
+}
+
+
+#undef TO_STR
+
+#endif // INCLUDED__VDR_CIPHER_FPE_CACHE_H
@@ -0,0 +1,202 @@
+#ifndef INCLUDED__VDR_CIPHER_FPE_COMPACT_H
+#define INCLUDED__VDR_CIPHER_FPE_COMPACT_H
+
+#include "vdr/cipher/fpe_feistel.h"
+#include "vdr/sharded_lru.h"
+#include "vdr/wipe.h"
+
+#include <atomic>
+#include <memory>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        template< class FFunction >
+        class basic_compact_fpe_feistel;
+
+
+        /// Bounded pool of expanded engines of `basic_compact_fpe_feistel`, shared by any number
+        /// of them: only the ones in use hold key schedules and round masks.
+        ///
+        /// Engines are found by compact engine id in a `vdr::sharded_lru`, as in `basic_fpe_cache`;
+        /// only compact engines look them up. Engines are handed out as shared pointers to const,
+        /// so an evicted engine stays valid while in use.
+        template< class Engine = vdr::cipher::fpe_feistel >
+        class basic_fpe_pool
+        {
+        public:
+            typedef Engine engine;
+            typedef std::shared_ptr< engine const > engine_ptr;
+
+        private:
+            typedef vdr::sharded_lru< uint64_t, engine_ptr > engines_t;
+
+        public:
+            enum : size_t { default_shards = engines_t::default_shards };
+
+            typedef typename engines_t::stats_t stats_t;
+
+        public:
+            /// At most `capacity` engines in all; `shards` is clamped to `capacity`.
+            explicit basic_fpe_pool( size_t capacity, size_t shards = default_shards )
+                : _engines( capacity, shards )
+            {}
+
+            basic_fpe_pool( basic_fpe_pool const & ) = delete;
+            basic_fpe_pool & operator = ( basic_fpe_pool const & ) = delete;
+
+            /// Drops all engines, counters are kept. Compact engines expand again on next use.
+            void clear() { _engines.clear(); }
+
+            size_t size() const { return _engines.size(); }
+            size_t get_capacity() const { return _engines.get_capacity(); }
+
+            /// Counters since construction, each one read atomically.
+            stats_t get_stats() const { return _engines.get_stats(); }
+
+        private:
+            template< class FFunction >
+            friend class basic_compact_fpe_feistel;
+
+            /// Engine of compact engine `id`, made by `expand()` outside of the shard lock on a miss.
+            template< class Expand >
+            engine_ptr get( uint64_t id, Expand const & expand ) { return _engines.get( id, expand ); }
+
+            void erase( uint64_t id ) { _engines.erase( id ); }
+
+        private:
+            engines_t _engines;
+        };
+
+
+        /// `basic_fpe_feistel` which keeps only the seed of F-function key (for thorp shuffle three
+        /// block cipher keys, 48 bytes) and domain parameters, for many keys which are rarely used
+        /// but must stay at hand. Key schedules and round masks, a few kilobytes, are expanded on
+        /// first use, not at construction, into `pool` and shared by calls until evicted. Gives
+        /// the same permutation as `basic_fpe_feistel` of the same raw key with cycle walking.
+        ///
+        /// Every call looks the engine up in the pool; callers with many values take it once by
+        /// `expand()`. Calls are const and may come from many threads, as the pool is locked.
+        /// Pool must outlive the compact engine, which drops its expanded engine when destroyed.
+        /// F-function must have `key_type` with `seed_t`, see `basic_thorp_shuffle_key`, and static
+        /// `check_layout`, see `basic_thorp_shuffle`.
+        template< class FFunction = vdr::cipher::thorp_shuffle >
+        class basic_compact_fpe_feistel
+        {
+        public:
+            typedef FFunction f_function;
+            typedef basic_fpe_feistel< f_function > engine;
+            typedef typename engine::value_type value_type;
+            typedef basic_fpe_pool< engine > pool;
+            typedef typename pool::engine_ptr engine_ptr;
+
+        public:
+            basic_compact_fpe_feistel( pool & expanded, value_type domain_size, std::string const & raw_key, size_t target_bits = 1 );
+            ~basic_compact_fpe_feistel();
+
+            basic_compact_fpe_feistel( basic_compact_fpe_feistel const & ) = delete;
+            basic_compact_fpe_feistel & operator = ( basic_compact_fpe_feistel const & ) = delete;
+
+            /// Expanded engine, from the pool or expanded into it.
+            engine_ptr expand() const;
+
+            value_type encrypt( value_type value ) const { return expand()->encrypt( value ); }
+            value_type decrypt( value_type value ) const { return expand()->decrypt( value ); }
+
+            void encrypt( gsl::span< value_type const > values, gsl::span< value_type > results ) const { expand()->encrypt( values, results ); }
+            void decrypt( gsl::span< value_type const > values, gsl::span< value_type > results ) const { expand()->decrypt( values, results ); }
+
+            value_type encrypt( value_type value, gsl::span< gsl::byte const > tweak ) const { return expand()->encrypt( value, tweak ); }
+            value_type decrypt( value_type value, gsl::span< gsl::byte const > tweak ) const { return expand()->decrypt( value, tweak ); }
+
+            void encrypt( gsl::span< value_type const > values, gsl::span< value_type > results, gsl::span< gsl::byte const > tweak ) const { expand()->encrypt( values, results, tweak ); }
+            void decrypt( gsl::span< value_type const > values, gsl::span< value_type > results, gsl::span< gsl::byte const > tweak ) const { expand()->decrypt( values, results, tweak ); }
+
+            value_type get_domain_size() const { return _domain_size; }
+            size_t get_target_bits() const { return _target_bits; }
+
+        private:
+            typedef typename f_function::key_type f_function_key;
+            typedef typename f_function_key::seed_t seed_t;
+
+        private:
+            static uint64_t next_id();
+
+        private:
+            pool & _pool;
+
+            const value_type _domain_size;
+            const size_t _target_bits;
+
+            seed_t _seed;
+
+            /// Unique per instance, key of its expanded engine in the pool.
+            const uint64_t _id;
+        };
+
+        typedef basic_fpe_pool< vdr::cipher::fpe_feistel > fpe_pool;
+        typedef basic_compact_fpe_feistel< vdr::cipher::thorp_shuffle > compact_fpe_feistel;
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        template< class FFunction >
+        basic_compact_fpe_feistel<FFunction>::basic_compact_fpe_feistel( pool & expanded, value_type domain_size, std::string const & raw_key, size_t target_bits )
+            : _pool( expanded )
+            , _domain_size( domain_size )
+            , _target_bits( target_bits )
+            , _seed( f_function_key::derive_seed( gsl::as_bytes( gsl::as_span( raw_key ) ) ) )
+            , _id( next_id() )
+        {
+            // Bad parameters throw here rather than on first use, but nothing is expanded until
+            // then: loading many idle keys must not evict the hot ones from the pool.
+            try
+            {
+                f_function::check_layout( domain_size, target_bits, __FUNCTION__ );
+            }
+            catch( ... )
+            {
+                vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &_seed, 1 ) ) );
+                throw;
+            }
+        }
+
+        template< class FFunction >
+        basic_compact_fpe_feistel<FFunction>::~basic_compact_fpe_feistel()
+        {
+            _pool.erase( _id );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &_seed, 1 ) ) );
+        }
+
+        template< class FFunction >
+        uint64_t basic_compact_fpe_feistel<FFunction>::next_id()
+        {
+            static std::atomic< uint64_t > id( 0 );
+            return ++id;
+        }
+
+        template< class FFunction >
+        typename basic_compact_fpe_feistel<FFunction>::engine_ptr basic_compact_fpe_feistel<FFunction>::expand() const
+        {
+            return _pool.get( _id, [ this ]()
+            {
+                auto const key = std::make_shared< f_function_key const >( _seed, f_function::key_rounds( _domain_size, _target_bits ) );
+                return std::make_shared< engine const >( _domain_size, key, _target_bits );
+            } );
+        }
+
+    }
+}
+
+
+#endif // INCLUDED__VDR_CIPHER_FPE_COMPACT_H
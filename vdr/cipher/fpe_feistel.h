@@ -2,8 +2,20 @@
 #define INCLUDED__VDR_CIPHER_FPE_FEISTEL_H
 
 #include "vdr/cipher/aes.h"
+#include "vdr/cipher/aes_evp.h"
+#include "vdr/cipher/aes_bitsliced.h"
 #include "vdr/mac/hmac.h"
 #include "vdr/hash/sha2.h"
+#include "vdr/wide_uint.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 
 namespace vdr
@@ -11,60 +23,675 @@ namespace vdr
     namespace cipher
     {
 
-        class thorp_shuffle
+        /// What `basic_thorp_shuffle` derives from the raw key alone: source cipher key schedule and
+        /// masks of the first `rounds` rounds. Neither depends on domain, so one key serves thorp
+        /// shuffles of every domain whose round count it covers, see `basic_fpe_key`. Immutable.
+        ///
+        /// Round mask r of tweak T is E_round( R( r ) ^ H( T ) ), where R( r ) is the untweaked
+        /// round block and H is CBC-MAC of the tweak length block and the zero padded tweak under
+        /// its own cipher; H of the empty tweak is zero, so it gives the untweaked masks. Masks of
+        /// two tweaks agree only if their H differ in round bytes alone, about 2^-64 for a pair.
+        template< class BlockCipher = vdr::cipher::aes128 >
+        class basic_thorp_shuffle_key
+        {
+        public:
+            typedef BlockCipher block_cipher;
+            typedef std::array< uint8_t, block_cipher::block_bytes > block_t;
+
+            /// Block cipher keys derived from the raw key, all the key is expanded from. Secret,
+            /// whoever keeps one wipes it.
+            struct seed_t
+            {
+                typedef std::array< gsl::byte, block_cipher::key_bytes > cipher_key_t;
+
+                cipher_key_t source_key;
+                cipher_key_t round_key;
+                cipher_key_t tweak_key;
+            };
+
+        public:
+            basic_thorp_shuffle_key( std::string const & raw_key, size_t rounds );
+            basic_thorp_shuffle_key( gsl::span< gsl::byte const > raw_key, size_t rounds );
+
+            /// Same key as of the raw key `seed` is derived from, without key derivation.
+            basic_thorp_shuffle_key( seed_t const & seed, size_t rounds );
+            ~basic_thorp_shuffle_key();
+
+            static seed_t derive_seed( gsl::span< gsl::byte const > raw_key );
+
+            block_cipher const & get_source_cipher() const { return _source_cipher; }
+            block_t const & get_round_mask( size_t round ) const { return _round_masks[ round ]; }
+            std::vector< block_t > const & get_round_masks() const { return _round_masks; }
+            size_t get_rounds() const { return _round_masks.size(); }
+
+            /// Masks of the first `masks.size()` rounds under `tweak`, any number of rounds. Costs
+            /// one block cipher call per started tweak block and one more, plus one per round.
+            void get_tweak_masks( gsl::span< gsl::byte const > tweak, gsl::span< block_t > masks ) const;
+
+            /// Same as a new key of `raw_key`, in place: schedules are overwritten, not cleared, and
+            /// masks reuse their storage. Not while the key is in use.
+            void rekey( gsl::span< gsl::byte const > raw_key, size_t rounds );
+
+            /// Masks of `rounds` rounds, only the missing ones are computed. Not while the key is in use.
+            void set_rounds( size_t rounds );
+
+        private:
+            void expand( seed_t const & seed, size_t rounds );
+            void fill_round_masks( size_t first, size_t rounds );
+
+            static block_t round_to_block( size_t const round );
+
+        private:
+            block_cipher _source_cipher;
+            block_cipher _round_cipher;
+            block_cipher _tweak_cipher;
+
+            /// Round cipher output depends on round only, so it is computed once for every round.
+            std::vector< block_t > _round_masks;
+        };
+
+
+
+        /// BlockCipher is a policy with `aes`-like interface: `unkeyed` constructor, `set_enc_key`,
+        /// single block `enc` and multi-block `enc_blocks`. See `vdr::cipher::aes` and
+        /// `vdr::cipher::aes_evp`.
+        ///
+        /// Every round takes `target_bits` bits of one block cipher output. It is clamped to half
+        /// of domain bits, so source never gets narrower than target.
+        ///
+        /// Value is `uintmax_t`, `unsigned __int128` or `vdr::wide_uint`. Sources up to a whole
+        /// block wide are packed into one block, so 128 bit sources still take one block cipher
+        /// call; wider domains throw.
+        ///
+        /// `round_passes` times `rounds` distinct rounds are served, for callers which take more
+        /// steps than a Feistel network of the domain has rounds (see `reverse_cycle_walking`).
+        ///
+        /// Tweaks only change round masks (see `basic_thorp_shuffle_key`). Each instance remembers
+        /// masks of the last `tweak_cache_entries` tweaks any thread asked, so a tweak seen again
+        /// costs a lookup. They are wiped on `rekey`, `set_domain` and destruction.
+        template< class BlockCipher = vdr::cipher::aes128, class Value = uintmax_t >
+        class basic_thorp_shuffle
+        {
+        public:
+            typedef BlockCipher block_cipher;
+            typedef Value value_type;
+            typedef basic_thorp_shuffle_key< block_cipher > key_type;
+
+        public:
+            basic_thorp_shuffle( value_type domain_size, std::string const & raw_key, size_t target_bits = 1, size_t round_passes = 1 );
+
+            /// Shares `key`, which must cover `key_rounds` of this domain, otherwise throws.
+            basic_thorp_shuffle( value_type domain_size, std::shared_ptr< key_type const > key, size_t target_bits = 1, size_t round_passes = 1 );
+
+            /// Only reads state fixed at construction (or by `rekey`/`set_domain`), so one instance
+            /// may serve many threads at once.
+            value_type operator () ( value_type const source, size_t const round ) const;
+
+            /// Same as above for many sources of one round. Blocks of independent sources are
+            /// encrypted back to back, so block cipher latency is overlapped.
+            void operator () ( gsl::span< value_type const > sources, size_t const round, gsl::span< value_type > targets ) const;
+
+        private:
+            struct tweak_entry_t;
+
+        public:
+            /// Round masks of one tweak. Keeps them alive after the cache lets them go, valid
+            /// until `rekey` or `set_domain`.
+            class tweak_state
+            {
+            public:
+                explicit tweak_state( gsl::span< typename key_type::block_t const > masks, std::shared_ptr< tweak_entry_t const > entry = nullptr )
+                    : _masks( masks )
+                    , _entry( std::move( entry ) )
+                {}
+
+                typename key_type::block_t const & operator [] ( size_t const round ) const { return _masks[ round ]; }
+
+            private:
+                gsl::span< typename key_type::block_t const > _masks;
+                std::shared_ptr< tweak_entry_t const > _entry;
+            };
+
+            /// Empty tweak gives the untweaked F-function.
+            tweak_state tweak( gsl::span< gsl::byte const > tweak ) const;
+
+            value_type operator () ( value_type const source, size_t const round, tweak_state const & tweak ) const;
+            void operator () ( gsl::span< value_type const > sources, size_t const round, gsl::span< value_type > targets, tweak_state const & tweak ) const;
+
+            /// Same as constructing anew with `raw_key`, domain and target bits kept. A key this
+            /// instance made and shares with no copy is rekeyed in place, otherwise a new one is
+            /// made. Neither this nor `set_domain` may run while the instance is in use.
+            void rekey( gsl::span< gsl::byte const > raw_key );
+
+            /// Same as constructing anew over `domain_size`, key and target bits asked kept. A key
+            /// shared with others must cover the new rounds, an own one gets the missing masks.
+            void set_domain( value_type domain_size );
+
+            value_type get_domain_size() const { return _domain_size; }
+            size_t get_source_bits() const { return _source_bits; }
+            size_t get_target_bits() const { return _target_bits; }
+            size_t get_rounds() const { return _rounds; }
+            size_t get_round_passes() const { return _round_passes; }
+
+            /// Round count policy: every bit of the domain is rewritten 4 times, `target_bits` per round.
+            static size_t rounds( size_t domain_bits, size_t target_bits );
+
+            /// Most rounds any domain of `value_type` takes, a key of that many serves all of them.
+            static size_t max_rounds( size_t round_passes = 1 );
+
+            /// Rounds a key must cover for `domain_size`, `target_bits` and `round_passes`.
+            static size_t key_rounds( value_type const & domain_size, size_t target_bits, size_t round_passes = 1 );
+
+            /// Throws as the constructor does on `domain_size` and `target_bits`, for callers which
+            /// build the F-function later.
+            static void check_layout( value_type const & domain_size, size_t target_bits, std::string const & function );
+
+        public:
+            enum : size_t { tweak_cache_entries = 8 };
+
+        private:
+            typedef block_cipher block_cipher_t;
+            typedef std::array< uint8_t, block_cipher_t::block_bytes > block_t;
+
+            enum : size_t { batch_blocks = 64 };
+
+            /// Masks of one tweak, never changed once made. Tweak and masks are wiped when the last
+            /// cache slot or tweak state holding it lets go.
+            struct tweak_entry_t
+            {
+                ~tweak_entry_t();
+
+                std::vector< gsl::byte > tweak;
+                std::vector< typename key_type::block_t > masks;
+            };
+
+            /// Entries of the last tweaks asked, oldest replaced first. Slots are read and swapped
+            /// atomically, a fingerprint tells which slot is worth reading. Copies start empty.
+            struct tweak_cache_t
+            {
+                tweak_cache_t() : next( 0 ) { clear(); }
+                tweak_cache_t( tweak_cache_t const & ) : tweak_cache_t() {}
+                tweak_cache_t & operator = ( tweak_cache_t const & ) { clear(); return *this; }
+
+                void clear();
+
+                std::array< std::shared_ptr< tweak_entry_t const >, tweak_cache_entries > entries;
+                std::array< std::atomic< uint64_t >, tweak_cache_entries > fingerprints;
+                std::atomic< size_t > next;
+            };
+
+        private:
+            static size_t clamp_target_bits( value_type const & domain_size, size_t target_bits );
+
+            bool owns_key_alone() const { return _own_key != nullptr and _own_key.use_count() == 2; }
+
+            /// Rounds callers may ask for, every pass of them.
+            size_t served_rounds() const { return _rounds * _round_passes; }
+
+            static uint64_t tweak_fingerprint( gsl::span< gsl::byte const > tweak );
+
+            block_t source_to_block( value_type const source ) const;
+            block_t masked_source_block( value_type const source, block_t const & mask ) const;
+            uintmax_t block_to_target( block_t const & block ) const;
+
+        private:
+            value_type _domain_size;
+            size_t _asked_target_bits;
+            size_t _target_bits;
+            size_t _source_bits;
+            size_t _rounds;
+            size_t _round_passes;
+
+            std::shared_ptr< key_type const > _key;
+
+            /// Same key as `_key` when this instance made it, so that it may be changed in place.
+            std::shared_ptr< key_type > _own_key;
+
+            mutable tweak_cache_t _tweak_cache;
+        };
+
+        typedef basic_thorp_shuffle< vdr::cipher::aes128 > thorp_shuffle;
+        typedef basic_thorp_shuffle< vdr::cipher::aes128, unsigned __int128 > thorp_shuffle128;
+        typedef basic_thorp_shuffle< vdr::cipher::aes128, vdr::wide_uint< 2 > > thorp_shuffle_wide;
+
+
+
+        /// Thorp shuffle which takes `rounds_per_block` consecutive rounds out of one block cipher
+        /// output: round r of source x is bits [ (r % k) * t, (r % k + 1) * t ) of
+        /// E( x ^ M[ r / k ] ), k = rounds_per_block, t = target_bits, M is a per-group mask.
+        ///
+        /// Security: inputs of distinct (x, group) pairs differ unless two group masks agree in
+        /// their high 64 bits, so up to PRP/PRF switching every (x, group) gets an independent
+        /// uniform block. Disjoint bits of one uniform block are independent uniform values, so
+        /// rounds of one group are independent random functions of x, exactly as if each round
+        /// had its own block cipher call. The bound only gets better, as there are fewer queries.
+        /// It is a different permutation than `basic_thorp_shuffle` though.
+        ///
+        /// A Feistel round changes the source, so the saving needs callers which ask one source
+        /// for several rounds of a group and pass a `memo_t`: a block is remembered per batch
+        /// position and reused while source and group stay the same. Tabulation does so for every
+        /// source. Walking a Feistel value almost never would, so calls without a memo encrypt
+        /// every time and keep nothing. Calls are const, one instance may serve many threads.
+        template< class BlockCipher = vdr::cipher::aes128 >
+        class basic_amortised_thorp_shuffle
         {
         public:
-            thorp_shuffle( uintmax_t domain_size, std::string const & raw_key );
+            typedef BlockCipher block_cipher;
+            typedef uintmax_t value_type;
+
+            /// Blocks of every batch position of previous calls, owned by one caller and used with
+            /// one instance only. Wiped when destroyed.
+            class memo_t
+            {
+            public:
+                ~memo_t();
+
+            private:
+                friend class basic_amortised_thorp_shuffle;
+
+                std::vector< uintmax_t > sources;
+                std::vector< size_t > groups;
+                std::vector< unsigned __int128 > blocks;
+            };
+
+        public:
+            /// `round_passes` as in `basic_thorp_shuffle`.
+            basic_amortised_thorp_shuffle( uintmax_t domain_size, std::string const & raw_key, size_t target_bits = 1, size_t round_passes = 1 );
+            ~basic_amortised_thorp_shuffle();
 
-            uintmax_t operator () ( uintmax_t const source, size_t const round );
+            uintmax_t operator () ( uintmax_t const source, size_t const round ) const;
+            void operator () ( gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets ) const;
+
+            /// Same as above, only positions whose source or group changed since the previous call
+            /// with `memo` are encrypted.
+            void operator () ( gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets, memo_t & memo ) const;
 
             uintmax_t get_domain_size() const { return _domain_size; }
             size_t get_source_bits() const { return _source_bits; }
             size_t get_target_bits() const { return _target_bits; }
+            size_t get_rounds() const { return _rounds; }
+            size_t get_round_passes() const { return _round_passes; }
+            size_t get_rounds_per_block() const { return _rounds_per_block; }
 
         private:
-            typedef vdr::cipher::aes128 block_cipher_t;
+            typedef block_cipher block_cipher_t;
             typedef std::array< uint8_t, block_cipher_t::block_bytes > block_t;
+            typedef unsigned __int128 wide_t;
+
+            enum : size_t { batch_blocks = 64 };
+            enum : size_t { no_group = std::numeric_limits< size_t >::max() };
 
         private:
-            block_t round_to_block( size_t const round );
-            block_t source_to_block( uintmax_t const source );
-            uintmax_t block_to_target( block_t const & block );
+            /// Clamped like in `basic_thorp_shuffle`, after its layout check, so no member is derived
+            /// from zero target bits or a domain of less than two values.
+            static size_t checked_target_bits( uintmax_t domain_size, size_t target_bits );
+
+            block_t masked_source_block( uintmax_t const source, size_t const group ) const;
+            static wide_t to_wide( block_t const & block );
 
         private:
             const uintmax_t _domain_size;
             const size_t _target_bits;
             const size_t _source_bits;
+            const size_t _rounds;
+            const size_t _round_passes;
+            const size_t _rounds_per_block;
 
             block_cipher_t _source_cipher;
-            block_cipher_t _round_cipher;
+
+            std::vector< block_t > _group_masks;
+        };
+
+        typedef basic_amortised_thorp_shuffle< vdr::cipher::aes128 > amortised_thorp_shuffle;
+
+
+
+        /// Memo of F-functions which take none.
+        struct no_memo_t {};
+
+        /// `FFunction::memo_t`, or `no_memo_t` for F-functions without one: batch calls of many
+        /// rounds over the same sources pass it when the F-function takes it.
+        template< class FFunction, class = void >
+        struct f_function_memo_of
+        {
+            typedef no_memo_t type;
+        };
+
+        template< class FFunction >
+        struct f_function_memo_of< FFunction, typename std::conditional< true, void, typename FFunction::memo_t >::type >
+        {
+            typedef typename FFunction::memo_t type;
+        };
+
+
+
+        /// Precomputed mode of a one bit F-function: every round is a bitset over all sources, built
+        /// once with batched calls of `FFunction`, so each Feistel round becomes a bit lookup.
+        /// Takes `rounds * 2 ^ source_bits` bits, see `table_bytes`. `FFunction` is not kept.
+        /// Lookups of consecutive rounds depend on each other, so it pays off only while tables
+        /// stay in cache; with AES-NI that is up to a few hundred KiB.
+        template< class FFunction = thorp_shuffle >
+        class basic_tabulated_f_function
+        {
+        public:
+            typedef FFunction f_function;
+            typedef uintmax_t value_type;
+
+            static_assert( std::is_same< typename f_function::value_type, value_type >::value, "Only uintmax_t F-functions are tabulated." );
+
+        public:
+            enum : size_t { max_source_bits = 22 };
+            enum : size_t { build_chunk = 4096 };
+
+        public:
+            /// Only one bit F-functions are tabulated, `target_bits` other than 1 throws. Every one of
+            /// `round_passes` passes of rounds gets its own tables.
+            basic_tabulated_f_function( uintmax_t domain_size, std::string const & raw_key, size_t target_bits = 1, size_t round_passes = 1 );
+            ~basic_tabulated_f_function();
+
+            uintmax_t operator () ( uintmax_t const source, size_t const round ) const;
+            void operator () ( gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets ) const;
+
+            uintmax_t get_domain_size() const { return _domain_size; }
+            size_t get_source_bits() const { return _source_bits; }
+            size_t get_target_bits() const { return _target_bits; }
+            size_t get_rounds() const { return _rounds; }
+            size_t get_round_passes() const { return _round_passes; }
+
+            /// Memory taken by the tables of this instance, and of any instance for `domain_size`.
+            size_t get_table_bytes() const { return _bits.size() * sizeof( word_t ); }
+            static size_t table_bytes( uintmax_t domain_size, size_t round_passes = 1 );
+
+        private:
+            typedef uint64_t word_t;
+            enum : size_t { word_bits = std::numeric_limits< word_t >::digits };
+
+        private:
+            typedef typename f_function_memo_of< f_function >::type f_function_memo;
+
+        private:
+            static size_t words_per_round( size_t source_bits );
+
+            static void call( f_function const & f, gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets, no_memo_t & );
+            template< class Memo >
+            static void call( f_function const & f, gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets, Memo & memo );
+
+        private:
+            uintmax_t _domain_size;
+            size_t _target_bits;
+            size_t _source_bits;
+            size_t _rounds;
+            size_t _round_passes;
+            size_t _words_per_round;
+
+            /// Round after round, bit `source` of a round is F( source, round ).
+            std::vector< word_t > _bits;
         };
 
+        typedef basic_tabulated_f_function< thorp_shuffle > tabulated_thorp_shuffle;
+        typedef basic_tabulated_f_function< amortised_thorp_shuffle > tabulated_amortised_thorp_shuffle;
 
 
+
+        /// `cycle_walking` repeats the whole round schedule until the value lands in the domain,
+        /// so a few unlucky values take many passes.
+        ///
+        /// `reverse_cycle_walking` never leaves the domain: every step pairs a value with
+        /// `value ^ step_key` and swaps the two by one F-function bit only when both are in the
+        /// domain. Each step is an involution of the domain, so every value takes exactly
+        /// `reverse_walk_passes * rounds` F-function calls both ways. Every step has its own
+        /// F-function round, the F-function is built for that many passes of rounds. Needs one
+        /// target bit.
+        /// The two modes give different permutations, one key must stay with one mode.
+        enum feistel_walking { cycle_walking, reverse_cycle_walking };
+
+        /// What reverse cycle walking step keys of every domain are derived from, HMAC of the raw
+        /// key under its own label. See `basic_fpe_feistel::derive_reverse_walk_seed`.
+        typedef vdr::mac::hmac< vdr::hash::sha256 >::digest_arr reverse_walk_seed_t;
+
+
+
+        /// Domain size, its split into source and target bits and round count of `basic_fpe_feistel`.
+        /// Compile time constants of one target bit per round and `4 * domain_bits` rounds when
+        /// `DomainSize` is not 0, so shifts and masks fold and the round count is known to the
+        /// compiler. F-function must agree with them, otherwise construction throws.
+        template< class Value, uintmax_t DomainSize >
+        class basic_feistel_layout
+        {
+        public:
+            static_assert( std::is_same< Value, uintmax_t >::value, "Compile time domain needs uintmax_t values." );
+            static_assert( DomainSize >= 2, "Compile time domain needs at least 2 values." );
+
+        public:
+            basic_feistel_layout( Value domain_size, size_t source_bits, size_t target_bits, size_t rounds );
+
+            static constexpr Value domain_size() { return DomainSize; }
+            static constexpr size_t domain_bits() { return ceil_log2( DomainSize ); }
+            static constexpr size_t target_bits() { return 1; }
+            static constexpr size_t source_bits() { return domain_bits() - target_bits(); }
+            static constexpr size_t rounds() { return domain_bits() * 4; }
+
+        private:
+            static constexpr size_t ceil_log2( uintmax_t value )
+            {
+                size_t bits = 0;
+                while( bits < std::numeric_limits< uintmax_t >::digits and ( ( value - 1 ) >> bits ) != 0 )
+                {
+                    ++bits;
+                }
+                return bits;
+            }
+        };
+
+        /// Run time layout, as F-function decides it.
+        template< class Value >
+        class basic_feistel_layout< Value, 0 >
+        {
+        public:
+            basic_feistel_layout( Value domain_size, size_t source_bits, size_t target_bits, size_t rounds )
+                : _domain_size( domain_size )
+                , _source_bits( source_bits )
+                , _target_bits( target_bits )
+                , _rounds( rounds )
+            {}
+
+            Value domain_size() const { return _domain_size; }
+            size_t domain_bits() const { return _source_bits + _target_bits; }
+            size_t target_bits() const { return _target_bits; }
+            size_t source_bits() const { return _source_bits; }
+            size_t rounds() const { return _rounds; }
+
+        private:
+            Value _domain_size;
+
+            size_t _source_bits;
+            size_t _target_bits;
+            size_t _rounds;
+        };
+
+
+
+        /// `FFunction::key_type`, or void for F-functions without one: every `basic_fpe_feistel`
+        /// names its key type, and its overloads must not fail to compile on it.
+        template< class FFunction, class = void >
+        struct f_function_key_of
+        {
+            typedef void type;
+        };
+
+        template< class FFunction >
+        struct f_function_key_of< FFunction, typename std::conditional< true, void, typename FFunction::key_type >::type >
+        {
+            typedef typename FFunction::key_type type;
+        };
+
+        /// Key of a family of `basic_fpe_feistel< FFunction, ... >` over many domains. What the
+        /// F-function derives from the raw key alone (for thorp shuffle: key schedule and masks of
+        /// the most rounds any domain takes) is made once here and shared by every engine built
+        /// from this key, so those only set up their layout. An engine gives the same permutation
+        /// whether it is built from the raw key or from this key.
+        ///
+        /// F-function must have `key_type` made of `( raw_key, rounds )`, static
+        /// `max_rounds( round_passes )` and `( domain_size, std::shared_ptr< key_type const >,
+        /// target_bits, round_passes )` constructor. The key covers reverse cycle walking too.
+        /// Immutable, may be shared between threads; engines do not refer to it once built.
+        ///
+        /// The raw key is not kept. Reverse cycle walking step keys depend on domain, so only their
+        /// seed is, the same an engine built from the raw key derives.
         template< class FFunction >
+        class basic_fpe_key
+        {
+        public:
+            typedef FFunction f_function;
+            typedef typename f_function_key_of< f_function >::type f_function_key;
+
+        public:
+            explicit basic_fpe_key( std::string const & raw_key );
+            ~basic_fpe_key();
+
+            std::shared_ptr< f_function_key const > const & get_f_function_key() const { return _f_function_key; }
+
+            /// Seed of what engines still derive per domain, see `basic_fpe_feistel`.
+            reverse_walk_seed_t const & get_reverse_walk_seed() const { return _reverse_walk_seed; }
+
+        private:
+            reverse_walk_seed_t _reverse_walk_seed;
+
+            std::shared_ptr< f_function_key const > _f_function_key;
+        };
+
+        typedef basic_fpe_key< thorp_shuffle > fpe_key;
+
+
+
+        /// `DomainSize` other than 0 fixes the domain at compile time, see `basic_feistel_layout`.
+        template< class FFunction, uintmax_t DomainSize = 0 >
         class basic_fpe_feistel
         {
         public:
             typedef FFunction f_function;
+            typedef typename f_function::value_type value_type;
+            typedef feistel_walking walking;
+            typedef basic_feistel_layout< value_type, DomainSize > layout;
+            typedef basic_fpe_key< f_function > key_type;
+
+        public:
+            /// `target_bits` is passed to F-function, which decides how many bits a round really
+            /// moves and how many rounds it takes. Every `target_bits` gives its own permutation.
+            /// Reverse cycle walking asks F-function for `reverse_walk_passes` passes of rounds.
+            basic_fpe_feistel( value_type domain_size, std::string const & raw_key, walking mode = cycle_walking, size_t target_bits = 1 );
+
+            /// Compile time domain only.
+            explicit basic_fpe_feistel( std::string const & raw_key, walking mode = cycle_walking );
+
+            /// Shares F-function key material of `key`. Reverse cycle walking still derives its step
+            /// keys per domain, from the seed of `key`.
+            basic_fpe_feistel( value_type domain_size, key_type const & key, walking mode = cycle_walking, size_t target_bits = 1 );
+
+            /// Shares F-function key alone, which must cover this domain. Cycle walking only, as
+            /// reverse cycle walking keys come from the raw key.
+            basic_fpe_feistel( value_type domain_size, std::shared_ptr< typename f_function_key_of< f_function >::type const > f_function_key, size_t target_bits = 1 );
+
+            /// Encryption and decryption only read state fixed at construction (or by `rekey` and
+            /// `set_domain`): one instance may be shared by any number of threads, as long as
+            /// F-function is const too.
+            value_type encrypt( value_type value ) const;
+            value_type decrypt( value_type value ) const;
+
+            /// Batch versions. Up to `batch_lanes` values run their rounds in lockstep; every value
+            /// walks its own cycle and its lane is refilled as soon as it lands in the domain.
+            /// `values` and `results` must have the same size and may be the same buffer.
+            void encrypt( gsl::span< value_type const > values, gsl::span< value_type > results ) const;
+            void decrypt( gsl::span< value_type const > values, gsl::span< value_type > results ) const;
+
+            /// Tweaked versions: every tweak gives its own permutation of the domain, the empty
+            /// tweak gives the untweaked one. F-function must take tweaks, see `basic_thorp_shuffle`;
+            /// tweak state is looked up once per call.
+            value_type encrypt( value_type value, gsl::span< gsl::byte const > tweak ) const;
+            value_type decrypt( value_type value, gsl::span< gsl::byte const > tweak ) const;
+            void encrypt( gsl::span< value_type const > values, gsl::span< value_type > results, gsl::span< gsl::byte const > tweak ) const;
+            void decrypt( gsl::span< value_type const > values, gsl::span< value_type > results, gsl::span< gsl::byte const > tweak ) const;
+
+            /// Same as constructing anew with `raw_key`, in place: F-function reuses its key storage
+            /// (see `basic_thorp_shuffle::rekey`) and reverse cycle walking its step keys. Neither
+            /// this nor `set_domain` may run while the instance is in use.
+            void rekey( gsl::span< gsl::byte const > raw_key );
+
+            /// Same as constructing anew over `domain_size` with the same key, in place. Run time
+            /// domain and cycle walking only, reverse cycle walking keys come from the raw key.
+            void set_domain( value_type domain_size );
+
+            f_function const & get_f_function() const { return _f_function; }
+
+            /// Seed of reverse cycle walking step keys, made once per raw key.
+            static reverse_walk_seed_t derive_reverse_walk_seed( gsl::span< gsl::byte const > raw_key );
+
+            value_type get_domain_size() const { return _layout.domain_size(); }
+            walking get_walking() const { return _walking; }
+            size_t get_rounds() const { return _layout.rounds(); }
 
         public:
-            basic_fpe_feistel( uintmax_t _domain_size, std::string const & raw_key);
+            enum : size_t { batch_lanes = 64 };
+            enum : size_t { reverse_walk_passes = 2 };
+
+        private:
+            /// Tweak of untweaked calls, which take F-function without tweak state.
+            struct untweaked_t {};
+
+        private:
+            /// Passes of F-function rounds `mode` takes.
+            static size_t round_passes( walking mode ) { return mode == reverse_cycle_walking ? reverse_walk_passes : 1; }
+
+            /// Both skip other modes; the first wipes the seed it derives.
+            void derive_reverse_walk_keys( gsl::span< gsl::byte const > raw_key );
+            void derive_reverse_walk_keys( reverse_walk_seed_t const & seed );
 
-            uintmax_t encrypt( uintmax_t value );
-            uintmax_t decrypt( uintmax_t value );
+            void check_value( value_type const & value, std::string const & function ) const;
+            void check_batch( gsl::span< value_type const > values, gsl::span< value_type > results, std::string const & function ) const;
+
+            value_type round_function( value_type const & source, size_t const round, untweaked_t ) const { return _f_function( source, round ); }
+            void round_function( gsl::span< value_type const > sources, size_t const round, gsl::span< value_type > targets, untweaked_t ) const { _f_function( sources, round, targets ); }
+
+            template< class Tweak >
+            value_type round_function( value_type const & source, size_t const round, Tweak const & tweak ) const { return _f_function( source, round, tweak ); }
+            template< class Tweak >
+            void round_function( gsl::span< value_type const > sources, size_t const round, gsl::span< value_type > targets, Tweak const & tweak ) const { _f_function( sources, round, targets, tweak ); }
+
+            template< class Tweak >
+            value_type encrypt_value( value_type value, Tweak const & tweak ) const;
+            template< class Tweak >
+            value_type decrypt_value( value_type value, Tweak const & tweak ) const;
+            template< class Tweak >
+            void encrypt_values( gsl::span< value_type const > values, gsl::span< value_type > results, Tweak const & tweak ) const;
+            template< class Tweak >
+            void decrypt_values( gsl::span< value_type const > values, gsl::span< value_type > results, Tweak const & tweak ) const;
+
+            value_type reverse_walk_source( value_type value, size_t step ) const;
+            template< class Tweak >
+            void reverse_walk( gsl::span< value_type const > values, gsl::span< value_type > results, bool const inverse, Tweak const & tweak ) const;
 
         private:
             f_function _f_function;
 
-            const uintmax_t _domain_size;
+            layout _layout;
 
-            const size_t _source_bits;
-            const size_t _target_bits;
-            const size_t _domain_bits;
+            const walking _walking;
+
+            /// Per step partner keys of reverse cycle walking, nonzero and below 2^domain_bits.
+            std::vector< value_type > _reverse_walk_keys;
         };
 
         typedef basic_fpe_feistel<thorp_shuffle> fpe_feistel;
+        typedef basic_fpe_feistel< basic_thorp_shuffle< vdr::cipher::aes_evp128 > > fpe_feistel_evp;
+        typedef basic_fpe_feistel< basic_thorp_shuffle< vdr::cipher::aes128_bitsliced > > fpe_feistel_bitsliced;
+        typedef basic_fpe_feistel< tabulated_thorp_shuffle > fpe_feistel_tabulated;
+        typedef basic_fpe_feistel< amortised_thorp_shuffle > fpe_feistel_amortised;
+        typedef basic_fpe_feistel< tabulated_amortised_thorp_shuffle > fpe_feistel_tabulated_amortised;
+        typedef basic_fpe_feistel< thorp_shuffle128 > fpe_feistel128;
+        typedef basic_fpe_feistel< thorp_shuffle_wide > fpe_feistel_wide;
+
+        template< uintmax_t DomainSize >
+        using fpe_feistel_fixed = basic_fpe_feistel< thorp_shuffle, DomainSize >;
 
 
 
@@ -185,71 +812,290 @@ namespace vdr
                 return v;
             }
 
-        } // anonymous namespace
+            /// Bit helpers of engine value types: `uintmax_t`, `unsigned __int128` and `vdr::wide_uint`.
+            /// `limb( value, i )` is i-th 64 bit limb, least significant first, zero above the width.
+            template< class Value >
+            struct value_traits;
 
+            template<>
+            struct value_traits< uintmax_t >
+            {
+                enum : size_t { digits = 64 };
+                static uint64_t limb( uintmax_t const value, size_t const i ) { return i == 0 ? value : 0; }
+            };
 
+            template<>
+            struct value_traits< unsigned __int128 >
+            {
+                enum : size_t { digits = 128 };
+                static uint64_t limb( unsigned __int128 const value, size_t const i ) { return i < 2 ? uint64_t( value >> ( i * 64 ) ) : 0; }
+            };
 
+            template< size_t Limbs >
+            struct value_traits< vdr::wide_uint< Limbs > >
+            {
+                enum : size_t { digits = vdr::wide_uint< Limbs >::digits };
+                static uint64_t limb( vdr::wide_uint< Limbs > const & value, size_t const i ) { return i < Limbs ? value.limb( i ) : 0; }
+            };
 
-        thorp_shuffle::thorp_shuffle( uintmax_t domain_size, std::string const & raw_key )
-            : _domain_size( domain_size )
-            , _target_bits( 1 )
-            , _source_bits( int_log2( up_to_pow2( domain_size) ) - _target_bits )
-        {
-            vdr::mac::hmac< vdr::hash::sha256 > mac( gsl::as_bytes( gsl::as_span(raw_key) ) );
+            /// Index of the highest set bit, 0 for 0 as `int_log2`.
+            template< class Value >
+            size_t value_log2( Value const & value )
             {
-                auto derived_key = mac.get_empty_digest();
-                mac
-                    << gsl::as_bytes( gsl::ensure_z("for key") )
-                    >> derived_key;
-                //std::cout << "source key: " << tobin( derived_key ) << "\n";
-                _source_cipher.set_enc_key( derived_key );
-                vdr::wipe( derived_key );
+                for( size_t i = value_traits< Value >::digits / 64; i > 0; --i )
+                {
+                    uint64_t const limb = value_traits< Value >::limb( value, i - 1 );
+                    if( limb != 0 )
+                    {
+                        return ( i - 1 ) * 64 + int_log2( limb );
+                    }
+                }
+                return 0;
             }
+
+            /// Bits to hold values below `domain_size`, same as `int_log2( up_to_pow2( domain_size ) )`.
+            template< class Value >
+            size_t domain_bits_of( Value const & domain_size )
             {
-                auto derived_key = mac.get_empty_digest();
-                mac
-                    << gsl::as_bytes( gsl::ensure_z("for round") )
-                    >> derived_key;
-                //std::cout << "round key: " << tobin( derived_key ) << "\n";
-                _round_cipher.set_enc_key( derived_key );
-                vdr::wipe( derived_key );
+                return domain_size > Value(1) ? value_log2( Value( domain_size - Value(1) ) ) + 1 : 0;
             }
-        }
 
-        uintmax_t thorp_shuffle::operator () ( uintmax_t const source, size_t const round )
-        {
-            //std::cout << "thorp_shuffle(): "  << "              round: " << round << "\n";
+            template< class Value >
+            Value low_mask( size_t const bits )
+            {
+                return bits >= value_traits< Value >::digits ? Value( ~Value(0) ) : Value( ( Value(1) << bits ) - Value(1) );
+            }
 
-            block_t const & round_block = round_to_block( round );
-            //std::cout << "thorp_shuffle(): "  << "        round block: " << tobin( round_block ) << "\n";
+            template< class Value >
+            bool low_bit( Value const & value )
+            {
+                return value_traits< Value >::limb( value, 0 ) & 1;
+            }
 
-            block_t round_cipher;
-            _round_cipher.enc( gsl::as_bytes( gsl::as_span( round_block ) ), gsl::as_writeable_bytes( gsl::as_span( round_cipher ) ) );
-            //std::cout << "thorp_shuffle(): "  << "       round cipher: " << tobin( round_cipher ) << "\n";
+            /// Xors little endian `value` into the first bytes of `block`, as far as it fits.
+            template< class Value, size_t Bytes >
+            void xor_into_block( std::array< uint8_t, Bytes > & block, Value const & value )
+            {
+                for( size_t i = 0; i < value_traits< Value >::digits / 64 and ( i + 1 ) * sizeof( uint64_t ) <= Bytes; ++i )
+                {
+                    uint64_t const limb = value_traits< Value >::limb( value, i );
+                #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+                    uint64_t word;
+                    std::memcpy( &word, block.data() + i * sizeof( word ), sizeof( word ) );
+                    word ^= limb;
+                    std::memcpy( block.data() + i * sizeof( word ), &word, sizeof( word ) );
+                #else
+                    for( size_t j = 0; j < sizeof( limb ); ++j )
+                    {
+                        block[ i * sizeof( limb ) + j ] ^= ( limb >> ( j * bits_in_byte ) ) & 0xff;
+                    }
+                #endif
+                }
+            }
 
+            /// `vector.resize( size )` which leaves no copy of secret elements behind: dropped tail is
+            /// wiped, and on growth past capacity elements move to new storage and the old is wiped.
+            template< class Type >
+            void wiping_resize( std::vector< Type > & vector, size_t const size )
+            {
+                if( size < vector.size() )
+                {
+                    vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( vector ).subspan( size ) ) );
+                }
+                else if( size > vector.capacity() )
+                {
+                    std::vector< Type > grown( size );
+                    std::copy( vector.begin(), vector.end(), grown.begin() );
+                    vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( vector ) ) );
+                    vector.swap( grown );
+                    return;
+                }
+                vector.resize( size );
+            }
 
-            //std::cout << "thorp_shuffle(): "  << "             source: " << source << "\n";
+            /// `value % modulus` for 128 bit `value`, without generic 128 bit division on x86-64.
+            inline uint64_t wide_mod( unsigned __int128 const value, uint64_t const modulus )
+            {
+            #if defined( __x86_64__ )
+                uint64_t const high = uint64_t( value >> 64 ) % modulus;
+                uint64_t quotient;
+                uint64_t remainder;
+                asm( "divq %4" : "=a"( quotient ), "=d"( remainder ) : "a"( uint64_t( value ) ), "d"( high ), "rm"( modulus ) );
+                return remainder;
+            #else
+                return uint64_t( value % modulus );
+            #endif
+            }
 
-            block_t const & source_block = source_to_block( source );
-            //std::cout << "thorp_shuffle(): "  << "       source block: " << tobin( source_block ) << "\n";
+            /// `base ^ exponent`, or max of `uintmax_t` if it may not fit.
+            inline uintmax_t saturated_pow( uintmax_t base, size_t exponent )
+            {
+                uintmax_t const saturated = std::numeric_limits< uintmax_t >::max();
+                uintmax_t result = 1;
+                for( size_t i = 0; i < exponent; ++i )
+                {
+                    if( result >= saturated / base )
+                    {
+                        return saturated;
+                    }
+                    result *= base;
+                }
+                return result;
+            }
 
-            block_t masked_source_block = source_block ^ round_cipher;
-            //std::cout << "thorp_shuffle(): "  << "masked source block: " << tobin( masked_source_block ) << "\n";
+        } // anonymous namespace
 
-            block_t target_block;
-            _source_cipher.enc( gsl::as_bytes( gsl::as_span( masked_source_block ) ), gsl::as_writeable_bytes( gsl::as_span( target_block ) ) );
-            //std::cout << "thorp_shuffle(): "  << "      source cipher: " << tobin( target_block ) << "\n";
 
-            uintmax_t const target = block_to_target( target_block );
-            //std::cout << "thorp_shuffle(): "  << "        full target: " << target << "\n";
 
-            uintmax_t const target_bit = target & uintmax_t(1);
-            //std::cout << "thorp_shuffle(): "  << "             target: " << target_bit << "\n";
 
-            return target_bit;
+        template< class BlockCipher >
+        basic_thorp_shuffle_key<BlockCipher>::basic_thorp_shuffle_key( std::string const & raw_key, size_t rounds )
+            : basic_thorp_shuffle_key( gsl::as_bytes( gsl::as_span( raw_key ) ), rounds )
+        {
         }
 
-        thorp_shuffle::block_t thorp_shuffle::round_to_block( size_t const round )
+        template< class BlockCipher >
+        basic_thorp_shuffle_key<BlockCipher>::basic_thorp_shuffle_key( gsl::span< gsl::byte const > raw_key, size_t rounds )
+            : _source_cipher( unkeyed )
+            , _round_cipher( unkeyed )
+            , _tweak_cipher( unkeyed )
+        {
+            seed_t seed = derive_seed( raw_key );
+            expand( seed, rounds );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &seed, 1 ) ) );
+        }
+
+        template< class BlockCipher >
+        basic_thorp_shuffle_key<BlockCipher>::basic_thorp_shuffle_key( seed_t const & seed, size_t rounds )
+            : _source_cipher( unkeyed )
+            , _round_cipher( unkeyed )
+            , _tweak_cipher( unkeyed )
+        {
+            expand( seed, rounds );
+        }
+
+        /// Block cipher keys are the leading bytes of HMAC-SHA256 of the raw key and a label.
+        template< class BlockCipher >
+        typename basic_thorp_shuffle_key<BlockCipher>::seed_t basic_thorp_shuffle_key<BlockCipher>::derive_seed( gsl::span< gsl::byte const > raw_key )
+        {
+            static_assert( size_t( block_cipher::key_bytes ) <= size_t( vdr::hash::sha256::digest_bytes ), "" );
+
+            seed_t seed;
+            vdr::mac::hmac< vdr::hash::sha256 > mac( raw_key );
+            {
+                auto derived_key = mac.get_empty_digest();
+                mac
+                    << gsl::as_bytes( gsl::ensure_z("for key") )
+                    >> derived_key;
+                //std::cout << "source key: " << tobin( derived_key ) << "\n";
+                std::copy( derived_key.begin(), derived_key.begin() + seed.source_key.size(), seed.source_key.begin() );
+                vdr::wipe( derived_key );
+            }
+            {
+                auto derived_key = mac.get_empty_digest();
+                mac
+                    << gsl::as_bytes( gsl::ensure_z("for round") )
+                    >> derived_key;
+                //std::cout << "round key: " << tobin( derived_key ) << "\n";
+                std::copy( derived_key.begin(), derived_key.begin() + seed.round_key.size(), seed.round_key.begin() );
+                vdr::wipe( derived_key );
+            }
+            {
+                auto derived_key = mac.get_empty_digest();
+                mac
+                    << gsl::as_bytes( gsl::ensure_z("for tweak") )
+                    >> derived_key;
+                std::copy( derived_key.begin(), derived_key.begin() + seed.tweak_key.size(), seed.tweak_key.begin() );
+                vdr::wipe( derived_key );
+            }
+            return seed;
+        }
+
+        template< class BlockCipher >
+        void basic_thorp_shuffle_key<BlockCipher>::rekey( gsl::span< gsl::byte const > raw_key, size_t rounds )
+        {
+            seed_t seed = derive_seed( raw_key );
+            expand( seed, rounds );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( &seed, 1 ) ) );
+        }
+
+        template< class BlockCipher >
+        void basic_thorp_shuffle_key<BlockCipher>::set_rounds( size_t rounds )
+        {
+            fill_round_masks( std::min( rounds, _round_masks.size() ), rounds );
+        }
+
+        template< class BlockCipher >
+        void basic_thorp_shuffle_key<BlockCipher>::expand( seed_t const & seed, size_t rounds )
+        {
+            _source_cipher.set_enc_key( seed.source_key );
+            _round_cipher.set_enc_key( seed.round_key );
+            _tweak_cipher.set_enc_key( seed.tweak_key );
+
+            fill_round_masks( 0, rounds );
+        }
+
+        /// Untweaked masks of rounds [first, rounds), masks of rounds from `rounds` on are wiped.
+        template< class BlockCipher >
+        void basic_thorp_shuffle_key<BlockCipher>::fill_round_masks( size_t first, size_t rounds )
+        {
+            wiping_resize( _round_masks, rounds );
+
+            if( first < rounds )
+            {
+                // All rounds in one go, so block cipher latency is overlapped.
+                auto const masks = gsl::as_span( _round_masks ).subspan( first );
+                for( size_t i = 0; i < size_t( masks.size() ); ++i )
+                {
+                    masks[ i ] = round_to_block( first + i );
+                }
+                _round_cipher.enc_blocks( gsl::as_bytes( masks ), gsl::as_writeable_bytes( masks ) );
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_thorp_shuffle_key<BlockCipher>::get_tweak_masks( gsl::span< gsl::byte const > tweak, gsl::span< block_t > masks ) const
+        {
+            block_t tweak_block;
+            std::fill( tweak_block.begin(), tweak_block.end(), 0 );
+            if( tweak.size() != 0 )
+            {
+                // Length first, so CBC-MAC of tweaks of any length is a PRF.
+                static_assert( sizeof( tweak_block ) >= sizeof( uint64_t ), "" );
+                for( size_t i = 0; i < sizeof( uint64_t ); ++i )
+                {
+                    tweak_block[ i ] = uint8_t( uint64_t( tweak.size() ) >> ( i * bits_in_byte ) );
+                }
+                _tweak_cipher.enc( gsl::as_bytes( gsl::as_span( tweak_block ) ), gsl::as_writeable_bytes( gsl::as_span( tweak_block ) ) );
+
+                for( size_t first = 0; first < size_t( tweak.size() ); first += tweak_block.size() )
+                {
+                    size_t const count = std::min< size_t >( tweak_block.size(), tweak.size() - first );
+                    for( size_t i = 0; i < count; ++i )
+                    {
+                        tweak_block[ i ] ^= uint8_t( tweak[ first + i ] );
+                    }
+                    _tweak_cipher.enc( gsl::as_bytes( gsl::as_span( tweak_block ) ), gsl::as_writeable_bytes( gsl::as_span( tweak_block ) ) );
+                }
+            }
+
+            // All rounds in one go, so block cipher latency is overlapped.
+            for( size_t round = 0; round < size_t( masks.size() ); ++round )
+            {
+                masks[ round ] = round_to_block( round ) ^ tweak_block;
+            }
+            _round_cipher.enc_blocks( gsl::as_bytes( masks ), gsl::as_writeable_bytes( masks ) );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( tweak_block ) ) );
+        }
+
+        template< class BlockCipher >
+        basic_thorp_shuffle_key<BlockCipher>::~basic_thorp_shuffle_key()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _round_masks ) ) );
+        }
+
+        template< class BlockCipher >
+        typename basic_thorp_shuffle_key<BlockCipher>::block_t basic_thorp_shuffle_key<BlockCipher>::round_to_block( size_t const round )
         {
             block_t block;
             std::fill( block.begin(), block.end(), 0 );
@@ -263,126 +1109,1105 @@ namespace vdr
             return block;
         }
 
-        thorp_shuffle::block_t thorp_shuffle::source_to_block( uintmax_t const source )
+
+
+        template< class BlockCipher, class Value >
+        basic_thorp_shuffle<BlockCipher, Value>::basic_thorp_shuffle( value_type domain_size, std::string const & raw_key, size_t target_bits, size_t round_passes )
+            : basic_thorp_shuffle( domain_size, std::make_shared< key_type >( raw_key, key_rounds( domain_size, target_bits, round_passes ) ), target_bits, round_passes )
         {
-            block_t block;
-            std::fill( block.begin(), block.end(), 0 );
+            _own_key = std::const_pointer_cast< key_type >( _key );
+        }
 
-            static_assert( sizeof( block ) >= sizeof( source ), "" );
-            static_assert( std::is_same< block_t::value_type, uint8_t >::value, "" );
-            for( size_t i = 0; i < sizeof( source ); ++i )
+        template< class BlockCipher, class Value >
+        basic_thorp_shuffle<BlockCipher, Value>::basic_thorp_shuffle( value_type domain_size, std::shared_ptr< key_type const > key, size_t target_bits, size_t round_passes )
+            : _domain_size( domain_size )
+            , _asked_target_bits( target_bits )
+            , _target_bits( clamp_target_bits( domain_size, target_bits ) )
+            , _source_bits( domain_bits_of( domain_size ) - _target_bits )
+            , _rounds( key_rounds( domain_size, target_bits ) )
+            , _round_passes( round_passes )
+            , _key( std::move( key ) )
+        {
+            check_layout( domain_size, target_bits, __FUNCTION__ );
+            if( round_passes == 0 )
+            {
+                throw std::invalid_argument( TO_STR( basic_thorp_shuffle ) "::" + std::string( __FUNCTION__ ) + ": round passes must be positive" );
+            }
+            if( _key == nullptr or _key->get_rounds() < served_rounds() )
+            {
+                throw std::invalid_argument( TO_STR( basic_thorp_shuffle ) "::" + std::string( __FUNCTION__ ) + ": key does not cover all rounds" );
+            }
+        }
+
+        template< class BlockCipher, class Value >
+        void basic_thorp_shuffle<BlockCipher, Value>::rekey( gsl::span< gsl::byte const > raw_key )
+        {
+            if( owns_key_alone() )
+            {
+                _own_key->rekey( raw_key, served_rounds() );
+            }
+            else
+            {
+                _own_key = std::make_shared< key_type >( raw_key, served_rounds() );
+                _key = _own_key;
+            }
+            _tweak_cache.clear();
+        }
+
+        template< class BlockCipher, class Value >
+        void basic_thorp_shuffle<BlockCipher, Value>::set_domain( value_type domain_size )
+        {
+            check_layout( domain_size, _asked_target_bits, __FUNCTION__ );
+
+            size_t const rounds = key_rounds( domain_size, _asked_target_bits );
+            if( _key->get_rounds() < rounds * _round_passes )
+            {
+                if( not owns_key_alone() )
+                {
+                    throw std::invalid_argument( TO_STR( basic_thorp_shuffle ) "::" + std::string( __FUNCTION__ ) + ": key does not cover all rounds" );
+                }
+                _own_key->set_rounds( rounds * _round_passes );
+            }
+
+            _domain_size = domain_size;
+            _target_bits = clamp_target_bits( domain_size, _asked_target_bits );
+            _source_bits = domain_bits_of( domain_size ) - _target_bits;
+            _rounds = rounds;
+            _tweak_cache.clear();
+        }
+
+        template< class BlockCipher, class Value >
+        void basic_thorp_shuffle<BlockCipher, Value>::check_layout( value_type const & domain_size, size_t target_bits, std::string const & function )
+        {
+            if( target_bits == 0 )
+            {
+                throw std::invalid_argument( TO_STR( basic_thorp_shuffle ) "::" + function + ": target bits must be positive" );
+            }
+            size_t const clamped_target_bits = clamp_target_bits( domain_size, target_bits );
+            if( domain_bits_of( domain_size ) - clamped_target_bits > block_cipher_t::block_bytes * bits_in_byte or clamped_target_bits > std::numeric_limits< uintmax_t >::digits )
+            {
+                throw std::invalid_argument( TO_STR( basic_thorp_shuffle ) "::" + function + ": domain does not fit one block" );
+            }
+        }
+
+        template< class BlockCipher, class Value >
+        size_t basic_thorp_shuffle<BlockCipher, Value>::rounds( size_t domain_bits, size_t target_bits )
+        {
+            return ( ( domain_bits + target_bits - 1 ) / target_bits ) * 4;
+        }
+
+        /// Zero is kept for the constructor to throw on.
+        template< class BlockCipher, class Value >
+        size_t basic_thorp_shuffle<BlockCipher, Value>::clamp_target_bits( value_type const & domain_size, size_t target_bits )
+        {
+            return std::min( target_bits, std::max< size_t >( 1, domain_bits_of( domain_size ) / 2 ) );
+        }
+
+        template< class BlockCipher, class Value >
+        size_t basic_thorp_shuffle<BlockCipher, Value>::max_rounds( size_t round_passes )
+        {
+            return rounds( value_traits< value_type >::digits, 1 ) * round_passes;
+        }
+
+        template< class BlockCipher, class Value >
+        size_t basic_thorp_shuffle<BlockCipher, Value>::key_rounds( value_type const & domain_size, size_t target_bits, size_t round_passes )
+        {
+            // Zero target bits throw in the constructor, the key of one bit is never used then.
+            return rounds( domain_bits_of( domain_size ), std::max< size_t >( 1, clamp_target_bits( domain_size, target_bits ) ) ) * round_passes;
+        }
+
+        template< class BlockCipher, class Value >
+        basic_thorp_shuffle<BlockCipher, Value>::tweak_entry_t::~tweak_entry_t()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( tweak ) ) );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( masks ) ) );
+        }
+
+        /// Not while the instance is in use. Entries still held by tweak states are wiped after them.
+        template< class BlockCipher, class Value >
+        void basic_thorp_shuffle<BlockCipher, Value>::tweak_cache_t::clear()
+        {
+            for( size_t i = 0; i < tweak_cache_entries; ++i )
+            {
+                std::atomic_store( &entries[ i ], std::shared_ptr< tweak_entry_t const >() );
+                fingerprints[ i ].store( 0, std::memory_order_relaxed );
+            }
+        }
+
+        /// FNV-1a, only to skip slots of other tweaks; a match is checked byte by byte.
+        template< class BlockCipher, class Value >
+        uint64_t basic_thorp_shuffle<BlockCipher, Value>::tweak_fingerprint( gsl::span< gsl::byte const > tweak )
+        {
+            uint64_t fingerprint = 14695981039346656037ull;
+            for( auto const byte : tweak )
+            {
+                fingerprint = ( fingerprint ^ uint8_t( byte ) ) * 1099511628211ull;
+            }
+            return fingerprint;
+        }
+
+        template< class BlockCipher, class Value >
+        typename basic_thorp_shuffle<BlockCipher, Value>::tweak_state basic_thorp_shuffle<BlockCipher, Value>::tweak( gsl::span< gsl::byte const > tweak ) const
+        {
+            if( tweak.size() == 0 )
             {
-                block[ i ] = ( source >> ( i * bits_in_byte ) ) & 0xff;
+                return tweak_state( gsl::as_span( _key->get_round_masks().data(), served_rounds() ) );
+            }
+
+            uint64_t const fingerprint = tweak_fingerprint( tweak );
+            for( size_t i = 0; i < tweak_cache_entries; ++i )
+            {
+                if( _tweak_cache.fingerprints[ i ].load( std::memory_order_acquire ) != fingerprint )
+                {
+                    continue;
+                }
+                // Slot may have been replaced since, the entry tells its own tweak.
+                auto entry = std::atomic_load( &_tweak_cache.entries[ i ] );
+                if( entry != nullptr and std::equal( tweak.begin(), tweak.end(), entry->tweak.begin(), entry->tweak.end() ) )
+                {
+                    auto const masks = gsl::as_span( entry->masks );
+                    return tweak_state( masks, std::move( entry ) );
+                }
             }
 
+            auto entry = std::make_shared< tweak_entry_t >();
+            entry->tweak.assign( tweak.begin(), tweak.end() );
+            entry->masks.resize( served_rounds() );
+            _key->get_tweak_masks( tweak, gsl::as_span( entry->masks ) );
+
+            // Entry first, so a reader matching the new fingerprint never takes the old entry for it.
+            size_t const slot = _tweak_cache.next.fetch_add( 1, std::memory_order_relaxed ) % tweak_cache_entries;
+            std::atomic_store( &_tweak_cache.entries[ slot ], std::shared_ptr< tweak_entry_t const >( entry ) );
+            _tweak_cache.fingerprints[ slot ].store( fingerprint, std::memory_order_release );
+
+            auto const masks = gsl::as_span( entry->masks );
+            return tweak_state( masks, std::move( entry ) );
+        }
+
+        template< class BlockCipher, class Value >
+        typename basic_thorp_shuffle<BlockCipher, Value>::value_type basic_thorp_shuffle<BlockCipher, Value>::operator () ( value_type const source, size_t const round ) const
+        {
+            return ( *this )( source, round, tweak_state( gsl::as_span( _key->get_round_masks().data(), served_rounds() ) ) );
+        }
+
+        template< class BlockCipher, class Value >
+        void basic_thorp_shuffle<BlockCipher, Value>::operator () ( gsl::span< value_type const > sources, size_t const round, gsl::span< value_type > targets ) const
+        {
+            ( *this )( sources, round, targets, tweak_state( gsl::as_span( _key->get_round_masks().data(), served_rounds() ) ) );
+        }
+
+        template< class BlockCipher, class Value >
+        typename basic_thorp_shuffle<BlockCipher, Value>::value_type basic_thorp_shuffle<BlockCipher, Value>::operator () ( value_type const source, size_t const round, tweak_state const & tweak ) const
+        {
+            //std::cout << "thorp_shuffle(): "  << "              round: " << round << "\n";
+
+            block_t const & round_cipher = tweak[ round ];
+            //std::cout << "thorp_shuffle(): "  << "       round cipher: " << tobin( round_cipher ) << "\n";
+
+
+            //std::cout << "thorp_shuffle(): "  << "             source: " << source << "\n";
+
+            block_t const & source_block = source_to_block( source );
+            //std::cout << "thorp_shuffle(): "  << "       source block: " << tobin( source_block ) << "\n";
+
+            block_t masked_source_block = source_block ^ round_cipher;
+            //std::cout << "thorp_shuffle(): "  << "masked source block: " << tobin( masked_source_block ) << "\n";
+
+            block_t target_block;
+            _key->get_source_cipher().enc( gsl::as_bytes( gsl::as_span( masked_source_block ) ), gsl::as_writeable_bytes( gsl::as_span( target_block ) ) );
+            //std::cout << "thorp_shuffle(): "  << "      source cipher: " << tobin( target_block ) << "\n";
+
+            uintmax_t const target = block_to_target( target_block );
+            //std::cout << "thorp_shuffle(): "  << "        full target: " << target << "\n";
+
+            uintmax_t const target_bits = target & low_mask< uintmax_t >( _target_bits );
+            //std::cout << "thorp_shuffle(): "  << "             target: " << target_bits << "\n";
+
+            return value_type( target_bits );
+        }
+
+        template< class BlockCipher, class Value >
+        void basic_thorp_shuffle<BlockCipher, Value>::operator () ( gsl::span< value_type const > sources, size_t const round, gsl::span< value_type > targets, tweak_state const & tweak ) const
+        {
+            block_t const & round_cipher = tweak[ round ];
+            uintmax_t const target_mask = low_mask< uintmax_t >( _target_bits );
+
+            std::array< block_t, batch_blocks > masked_source_blocks;
+            std::array< block_t, batch_blocks > target_blocks;
+
+            for( size_t first = 0; first < sources.size(); first += batch_blocks )
+            {
+                size_t const count = std::min< size_t >( batch_blocks, sources.size() - first );
+
+                for( size_t i = 0; i < count; ++i )
+                {
+                    masked_source_blocks[ i ] = masked_source_block( sources[ first + i ], round_cipher );
+                }
+
+                _key->get_source_cipher().enc_blocks(
+                    gsl::as_bytes( gsl::as_span( masked_source_blocks ).first( count ) ),
+                    gsl::as_writeable_bytes( gsl::as_span( target_blocks ).first( count ) )
+                );
+
+                for( size_t i = 0; i < count; ++i )
+                {
+                    targets[ first + i ] = value_type( block_to_target( target_blocks[ i ] ) & target_mask );
+                }
+            }
+        }
+
+        template< class BlockCipher, class Value >
+        typename basic_thorp_shuffle<BlockCipher, Value>::block_t basic_thorp_shuffle<BlockCipher, Value>::source_to_block( value_type const source ) const
+        {
+            block_t block;
+            std::fill( block.begin(), block.end(), 0 );
+
+            static_assert( std::is_same< typename block_t::value_type, uint8_t >::value, "" );
+            xor_into_block( block, source );
+
             return block;
         }
 
-        uintmax_t thorp_shuffle::block_to_target( block_t const & block )
+        /// Same as `source_to_block( source ) ^ mask`, without byte by byte work on little endian hosts.
+        template< class BlockCipher, class Value >
+        typename basic_thorp_shuffle<BlockCipher, Value>::block_t basic_thorp_shuffle<BlockCipher, Value>::masked_source_block( value_type const source, block_t const & mask ) const
+        {
+            block_t block = mask;
+            xor_into_block( block, source );
+            return block;
+        }
+
+        template< class BlockCipher, class Value >
+        uintmax_t basic_thorp_shuffle<BlockCipher, Value>::block_to_target( block_t const & block ) const
         {
             uintmax_t result = 0;
 
             static_assert( sizeof( block ) >= sizeof( result ), "" );
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            std::memcpy( &result, block.data(), sizeof( result ) );
+        #else
             for( size_t i = 0; i < sizeof(result); ++i)
             {
                 result |= uintmax_t( block[ i ] ) << ( i * bits_in_byte );
             }
+        #endif
 
             return result;
         }
 
 
 
+        template< class BlockCipher >
+        basic_amortised_thorp_shuffle<BlockCipher>::basic_amortised_thorp_shuffle( uintmax_t domain_size, std::string const & raw_key, size_t target_bits, size_t round_passes )
+            : _domain_size( domain_size )
+            , _target_bits( checked_target_bits( domain_size, target_bits ) )
+            , _source_bits( int_log2( up_to_pow2( domain_size) ) - _target_bits )
+            , _rounds( basic_thorp_shuffle< BlockCipher >::rounds( _source_bits + _target_bits, _target_bits ) )
+            , _round_passes( round_passes )
+            , _rounds_per_block( block_cipher_t::block_bytes * bits_in_byte / _target_bits )
+            , _source_cipher( unkeyed )
+        {
+            if( round_passes == 0 )
+            {
+                throw std::invalid_argument( TO_STR( basic_amortised_thorp_shuffle ) "::" + std::string( __FUNCTION__ ) + ": round passes must be positive" );
+            }
+
+            vdr::mac::hmac< vdr::hash::sha256 > mac( gsl::as_bytes( gsl::as_span(raw_key) ) );
+            {
+                auto derived_key = mac.get_empty_digest();
+                mac
+                    << gsl::as_bytes( gsl::ensure_z("for amortised key") )
+                    >> derived_key;
+                _source_cipher.set_enc_key( derived_key );
+                vdr::wipe( derived_key );
+            }
+            {
+                block_cipher_t group_cipher( unkeyed );
+                {
+                    auto derived_key = mac.get_empty_digest();
+                    mac
+                        << gsl::as_bytes( gsl::ensure_z("for amortised group") )
+                        >> derived_key;
+                    group_cipher.set_enc_key( derived_key );
+                    vdr::wipe( derived_key );
+                }
+
+                _group_masks.resize( ( _rounds * _round_passes + _rounds_per_block - 1 ) / _rounds_per_block );
+                for( size_t group = 0; group < _group_masks.size(); ++group )
+                {
+                    block_t group_block;
+                    std::fill( group_block.begin(), group_block.end(), 0 );
+                    for( size_t i = 0; i < sizeof( group ); ++i )
+                    {
+                        group_block[ i ] = ( group >> ( i * bits_in_byte ) ) & 0xff;
+                    }
+                    group_cipher.enc( gsl::as_bytes( gsl::as_span( group_block ) ), gsl::as_writeable_bytes( gsl::as_span( _group_masks[ group ] ) ) );
+                }
+            }
+        }
+
+        template< class BlockCipher >
+        size_t basic_amortised_thorp_shuffle<BlockCipher>::checked_target_bits( uintmax_t domain_size, size_t target_bits )
+        {
+            basic_thorp_shuffle< BlockCipher >::check_layout( domain_size, target_bits, TO_STR( basic_amortised_thorp_shuffle ) );
+            return std::min( target_bits, std::max< size_t >( 1, int_log2( up_to_pow2( domain_size ) ) / 2 ) );
+        }
+
+        template< class BlockCipher >
+        basic_amortised_thorp_shuffle<BlockCipher>::~basic_amortised_thorp_shuffle()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _group_masks ) ) );
+        }
+
+        template< class BlockCipher >
+        basic_amortised_thorp_shuffle<BlockCipher>::memo_t::~memo_t()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( blocks ) ) );
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_amortised_thorp_shuffle<BlockCipher>::operator () ( uintmax_t const source, size_t const round ) const
+        {
+            size_t const group = round / _rounds_per_block;
+            block_t const masked_block = masked_source_block( source, group );
+            block_t target_block;
+            _source_cipher.enc( gsl::as_bytes( gsl::as_span( masked_block ) ), gsl::as_writeable_bytes( gsl::as_span( target_block ) ) );
+            return uintmax_t( to_wide( target_block ) >> ( ( round % _rounds_per_block ) * _target_bits ) ) & ( ( uintmax_t(1) << _target_bits ) - 1 );
+        }
+
+        template< class BlockCipher >
+        void basic_amortised_thorp_shuffle<BlockCipher>::operator () ( gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets ) const
+        {
+            size_t const group = round / _rounds_per_block;
+            size_t const first_bit = ( round % _rounds_per_block ) * _target_bits;
+            uintmax_t const target_mask = ( uintmax_t(1) << _target_bits ) - 1;
+
+            std::array< block_t, batch_blocks > blocks;
+            for( size_t first = 0; first < size_t( sources.size() ); first += batch_blocks )
+            {
+                size_t const count = std::min< size_t >( batch_blocks, sources.size() - first );
+                for( size_t i = 0; i < count; ++i )
+                {
+                    blocks[ i ] = masked_source_block( sources[ first + i ], group );
+                }
+                auto const chunk = gsl::as_span( blocks ).first( count );
+                _source_cipher.enc_blocks( gsl::as_bytes( chunk ), gsl::as_writeable_bytes( chunk ) );
+                for( size_t i = 0; i < count; ++i )
+                {
+                    targets[ first + i ] = uintmax_t( to_wide( blocks[ i ] ) >> first_bit ) & target_mask;
+                }
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_amortised_thorp_shuffle<BlockCipher>::operator () ( gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets, memo_t & memo ) const
+        {
+            size_t const group = round / _rounds_per_block;
+
+            if( memo.sources.size() < size_t( sources.size() ) )
+            {
+                memo.sources.resize( sources.size(), 0 );
+                memo.groups.resize( sources.size(), no_group );
+                wiping_resize( memo.blocks, sources.size() );
+            }
+
+            std::array< block_t, batch_blocks > masked_source_blocks;
+            std::array< block_t, batch_blocks > target_blocks;
+            std::array< size_t, batch_blocks > positions;
+
+            size_t count = 0;
+            auto const flush = [ & ]()
+            {
+                _source_cipher.enc_blocks(
+                    gsl::as_bytes( gsl::as_span( masked_source_blocks ).first( count ) ),
+                    gsl::as_writeable_bytes( gsl::as_span( target_blocks ).first( count ) )
+                );
+                for( size_t i = 0; i < count; ++i )
+                {
+                    memo.blocks[ positions[ i ] ] = to_wide( target_blocks[ i ] );
+                }
+                count = 0;
+            };
+
+            for( size_t i = 0; i < size_t( sources.size() ); ++i )
+            {
+                if( memo.sources[ i ] == sources[ i ] and memo.groups[ i ] == group )
+                {
+                    continue;
+                }
+                memo.sources[ i ] = sources[ i ];
+                memo.groups[ i ] = group;
+
+                masked_source_blocks[ count ] = masked_source_block( sources[ i ], group );
+                positions[ count ] = i;
+                if( ++count == batch_blocks )
+                {
+                    flush();
+                }
+            }
+            if( count != 0 )
+            {
+                flush();
+            }
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( target_blocks ) ) );
+
+            size_t const first_bit = ( round % _rounds_per_block ) * _target_bits;
+            uintmax_t const target_mask = ( uintmax_t(1) << _target_bits ) - 1;
+            for( size_t i = 0; i < size_t( sources.size() ); ++i )
+            {
+                targets[ i ] = uintmax_t( memo.blocks[ i ] >> first_bit ) & target_mask;
+            }
+        }
+
+        template< class BlockCipher >
+        typename basic_amortised_thorp_shuffle<BlockCipher>::block_t basic_amortised_thorp_shuffle<BlockCipher>::masked_source_block( uintmax_t const source, size_t const group ) const
+        {
+            block_t block = _group_masks[ group ];
+
+            static_assert( sizeof( block ) >= sizeof( source ), "" );
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            uintmax_t word;
+            std::memcpy( &word, block.data(), sizeof( word ) );
+            word ^= source;
+            std::memcpy( block.data(), &word, sizeof( word ) );
+        #else
+            for( size_t i = 0; i < sizeof( source ); ++i )
+            {
+                block[ i ] ^= ( source >> ( i * bits_in_byte ) ) & 0xff;
+            }
+        #endif
+
+            return block;
+        }
+
+        template< class BlockCipher >
+        typename basic_amortised_thorp_shuffle<BlockCipher>::wide_t basic_amortised_thorp_shuffle<BlockCipher>::to_wide( block_t const & block )
+        {
+            static_assert( sizeof( block ) == sizeof( wide_t ), "" );
+            wide_t result = 0;
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            std::memcpy( &result, block.data(), sizeof( result ) );
+        #else
+            for( size_t i = 0; i < block.size(); ++i )
+            {
+                result |= wide_t( block[ i ] ) << ( i * bits_in_byte );
+            }
+        #endif
+            return result;
+        }
+
+
+
+        template< class FFunction >
+        basic_tabulated_f_function<FFunction>::basic_tabulated_f_function( uintmax_t domain_size, std::string const & raw_key, size_t target_bits, size_t round_passes )
+        {
+            f_function f( domain_size, raw_key, target_bits, round_passes );
+            _domain_size = f.get_domain_size();
+            _target_bits = f.get_target_bits();
+            _source_bits = f.get_source_bits();
+            _rounds = f.get_rounds();
+            _round_passes = f.get_round_passes();
+            _words_per_round = words_per_round( _source_bits );
+
+            if( _target_bits != 1 or _source_bits > max_source_bits )
+            {
+                throw std::invalid_argument( TO_STR( basic_tabulated_f_function ) "::" + std::string( __FUNCTION__ ) + ": F-function can not be tabulated" );
+            }
+
+            uintmax_t const sources_count = uintmax_t(1) << _source_bits;
+            _bits.assign( _rounds * _round_passes * _words_per_round, 0 );
+
+            // Rounds of one chunk go back to back, so F-functions which share work between rounds
+            // of one source (see `basic_amortised_thorp_shuffle`) can reuse it through `memo`.
+            std::vector< uintmax_t > sources( build_chunk );
+            std::vector< uintmax_t > targets( build_chunk );
+            f_function_memo memo;
+            for( uintmax_t first = 0; first < sources_count; first += build_chunk )
+            {
+                size_t const count = std::min< uintmax_t >( build_chunk, sources_count - first );
+                for( size_t i = 0; i < count; ++i )
+                {
+                    sources[ i ] = first + i;
+                }
+                for( size_t round = 0; round < _rounds * _round_passes; ++round )
+                {
+                    word_t * const round_bits = _bits.data() + round * _words_per_round;
+                    call( f, gsl::as_span( sources ).first( count ), round, gsl::as_span( targets ).first( count ), memo );
+                    for( size_t i = 0; i < count; ++i )
+                    {
+                        round_bits[ ( first + i ) / word_bits ] |= word_t( targets[ i ] ) << ( ( first + i ) % word_bits );
+                    }
+                }
+            }
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( targets ) ) );
+        }
+
+        template< class FFunction >
+        basic_tabulated_f_function<FFunction>::~basic_tabulated_f_function()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _bits ) ) );
+        }
+
+        template< class FFunction >
+        size_t basic_tabulated_f_function<FFunction>::words_per_round( size_t source_bits )
+        {
+            return ( ( size_t(1) << source_bits ) + word_bits - 1 ) / word_bits;
+        }
+
+        template< class FFunction >
+        void basic_tabulated_f_function<FFunction>::call( f_function const & f, gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets, no_memo_t & )
+        {
+            f( sources, round, targets );
+        }
+
+        template< class FFunction >
+        template< class Memo >
+        void basic_tabulated_f_function<FFunction>::call( f_function const & f, gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets, Memo & memo )
+        {
+            f( sources, round, targets, memo );
+        }
+
+        template< class FFunction >
+        size_t basic_tabulated_f_function<FFunction>::table_bytes( uintmax_t domain_size, size_t round_passes )
+        {
+            size_t const domain_bits = int_log2( up_to_pow2( domain_size ) );
+            return domain_bits * 4 * round_passes * words_per_round( domain_bits - 1 ) * sizeof( word_t );
+        }
+
+        template< class FFunction >
+        uintmax_t basic_tabulated_f_function<FFunction>::operator () ( uintmax_t const source, size_t const round ) const
+        {
+            word_t const word = _bits[ round * _words_per_round + source / word_bits ];
+            return ( word >> ( source % word_bits ) ) & word_t(1);
+        }
+
+        template< class FFunction >
+        void basic_tabulated_f_function<FFunction>::operator () ( gsl::span< uintmax_t const > sources, size_t const round, gsl::span< uintmax_t > targets ) const
+        {
+            word_t const * const round_bits = _bits.data() + round * _words_per_round;
+            for( size_t i = 0; i < size_t( sources.size() ); ++i )
+            {
+                targets[ i ] = ( round_bits[ sources[ i ] / word_bits ] >> ( sources[ i ] % word_bits ) ) & word_t(1);
+            }
+        }
+
+
+
+        template< class Value, uintmax_t DomainSize >
+        basic_feistel_layout<Value, DomainSize>::basic_feistel_layout( Value domain_size, size_t source_bits, size_t target_bits, size_t rounds )
+        {
+            if( domain_size != DomainSize or source_bits != this->source_bits() or target_bits != this->target_bits() or rounds != this->rounds() )
+            {
+                throw std::invalid_argument( TO_STR( basic_feistel_layout ) "::" + std::string( __FUNCTION__ ) + ": F-function does not match compile time domain" );
+            }
+        }
+
+
+
+        template< class FFunction >
+        basic_fpe_key<FFunction>::basic_fpe_key( std::string const & raw_key )
+            : _reverse_walk_seed( basic_fpe_feistel< f_function >::derive_reverse_walk_seed( gsl::as_bytes( gsl::as_span( raw_key ) ) ) )
+        {
+            try
+            {
+                _f_function_key = std::make_shared< f_function_key const >( gsl::as_bytes( gsl::as_span( raw_key ) ), f_function::max_rounds( basic_fpe_feistel< f_function >::reverse_walk_passes ) );
+            }
+            catch( ... )
+            {
+                vdr::wipe( _reverse_walk_seed );
+                throw;
+            }
+        }
+
         template< class FFunction >
-        basic_fpe_feistel<FFunction>::basic_fpe_feistel( uintmax_t _domain_size, std::string const & raw_key)
-            : _f_function( _domain_size, raw_key )
-            , _domain_size( _f_function.get_domain_size() )
-            , _source_bits( _f_function.get_source_bits() )
-            , _target_bits( _f_function.get_target_bits() )
-            , _domain_bits( _source_bits + _target_bits )
-        {}
+        basic_fpe_key<FFunction>::~basic_fpe_key()
+        {
+            vdr::wipe( _reverse_walk_seed );
+        }
+
+
+
+        template< class FFunction, uintmax_t DomainSize >
+        basic_fpe_feistel<FFunction, DomainSize>::basic_fpe_feistel( std::string const & raw_key, walking mode )
+            : basic_fpe_feistel( DomainSize, raw_key, mode )
+        {
+            static_assert( DomainSize != 0, "Domain size is not known at compile time." );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        basic_fpe_feistel<FFunction, DomainSize>::basic_fpe_feistel( value_type domain_size, std::string const & raw_key, walking mode, size_t target_bits )
+            : _f_function( domain_size, raw_key, target_bits, round_passes( mode ) )
+            , _layout( _f_function.get_domain_size(), _f_function.get_source_bits(), _f_function.get_target_bits(), _f_function.get_rounds() )
+            , _walking( mode )
+        {
+            derive_reverse_walk_keys( gsl::as_bytes( gsl::as_span( raw_key ) ) );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        basic_fpe_feistel<FFunction, DomainSize>::basic_fpe_feistel( value_type domain_size, key_type const & key, walking mode, size_t target_bits )
+            : _f_function( domain_size, key.get_f_function_key(), target_bits, round_passes( mode ) )
+            , _layout( _f_function.get_domain_size(), _f_function.get_source_bits(), _f_function.get_target_bits(), _f_function.get_rounds() )
+            , _walking( mode )
+        {
+            derive_reverse_walk_keys( key.get_reverse_walk_seed() );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        basic_fpe_feistel<FFunction, DomainSize>::basic_fpe_feistel( value_type domain_size, std::shared_ptr< typename f_function_key_of< f_function >::type const > f_function_key, size_t target_bits )
+            : _f_function( domain_size, std::move( f_function_key ), target_bits )
+            , _layout( _f_function.get_domain_size(), _f_function.get_source_bits(), _f_function.get_target_bits(), _f_function.get_rounds() )
+            , _walking( cycle_walking )
+        {
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::rekey( gsl::span< gsl::byte const > raw_key )
+        {
+            _f_function.rekey( raw_key );
+            derive_reverse_walk_keys( raw_key );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::set_domain( value_type domain_size )
+        {
+            static_assert( DomainSize == 0, "Domain size is fixed at compile time." );
+
+            if( _walking == reverse_cycle_walking )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_feistel ) "::" + std::string( __FUNCTION__ ) + ": reverse cycle walking needs the raw key, construct anew" );
+            }
+
+            _f_function.set_domain( domain_size );
+            _layout = layout( _f_function.get_domain_size(), _f_function.get_source_bits(), _f_function.get_target_bits(), _f_function.get_rounds() );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        reverse_walk_seed_t basic_fpe_feistel<FFunction, DomainSize>::derive_reverse_walk_seed( gsl::span< gsl::byte const > raw_key )
+        {
+            vdr::mac::hmac< vdr::hash::sha256 > mac( raw_key );
+            reverse_walk_seed_t seed = mac.get_empty_digest();
+            mac
+                << gsl::as_bytes( gsl::ensure_z("for reverse walk seed") )
+                >> seed;
+            return seed;
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::derive_reverse_walk_keys( gsl::span< gsl::byte const > raw_key )
+        {
+            if( _walking != reverse_cycle_walking )
+            {
+                return;
+            }
+
+            reverse_walk_seed_t seed = derive_reverse_walk_seed( raw_key );
+            try
+            {
+                derive_reverse_walk_keys( seed );
+            }
+            catch( ... )
+            {
+                vdr::wipe( seed );
+                throw;
+            }
+            vdr::wipe( seed );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::derive_reverse_walk_keys( reverse_walk_seed_t const & seed )
+        {
+            if( _walking != reverse_cycle_walking or _layout.domain_bits() == 0 )
+            {
+                return;
+            }
+
+            if( _layout.target_bits() != 1 )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_feistel ) "::" + std::string( __FUNCTION__ ) + ": reverse cycle walking needs one target bit per round" );
+            }
+
+            value_type const domain_mask = low_mask< value_type >( _layout.domain_bits() );
+
+            vdr::mac::hmac< vdr::hash::sha256 > mac( gsl::as_span( seed ) );
+            wiping_resize( _reverse_walk_keys, reverse_walk_passes * _layout.rounds() );
+            for( size_t step = 0; step < _reverse_walk_keys.size(); ++step )
+            {
+                std::array< uint8_t, sizeof( uint64_t ) > step_bytes;
+                for( size_t i = 0; i < step_bytes.size(); ++i )
+                {
+                    step_bytes[ i ] = uint8_t( uint64_t( step ) >> ( i * bits_in_byte ) );
+                }
+
+                auto derived_key = mac.get_empty_digest();
+                mac
+                    << gsl::as_bytes( gsl::ensure_z("for reverse walk") )
+                    << gsl::as_bytes( gsl::as_span( step_bytes ) )
+                    >> derived_key;
+
+                value_type key = 0;
+                for( size_t i = std::min< size_t >( value_traits< value_type >::digits / bits_in_byte, derived_key.size() ); i > 0; --i )
+                {
+                    key = ( key << bits_in_byte ) | value_type( uint8_t( derived_key[ i - 1 ] ) );
+                }
+                vdr::wipe( derived_key );
+
+                key &= domain_mask;
+                _reverse_walk_keys[ step ] = key != value_type(0) ? key : value_type(1);
+            }
+        }
 
 
         /// [[target][source]]
         /// [[source][target ^ f_function(source)]]
 
-        template< class FFunction >
-        uintmax_t basic_fpe_feistel<FFunction>::encrypt( uintmax_t value )
+        template< class FFunction, uintmax_t DomainSize >
+        typename basic_fpe_feistel<FFunction, DomainSize>::value_type basic_fpe_feistel<FFunction, DomainSize>::encrypt( value_type value ) const
         {
-            if( value >= _domain_size )
+            check_value( value, __FUNCTION__ );
+            return encrypt_value( value, untweaked_t() );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        typename basic_fpe_feistel<FFunction, DomainSize>::value_type basic_fpe_feistel<FFunction, DomainSize>::decrypt( value_type value ) const
+        {
+            check_value( value, __FUNCTION__ );
+            return decrypt_value( value, untweaked_t() );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        typename basic_fpe_feistel<FFunction, DomainSize>::value_type basic_fpe_feistel<FFunction, DomainSize>::encrypt( value_type value, gsl::span< gsl::byte const > tweak ) const
+        {
+            check_value( value, __FUNCTION__ );
+            return encrypt_value( value, _f_function.tweak( tweak ) );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        typename basic_fpe_feistel<FFunction, DomainSize>::value_type basic_fpe_feistel<FFunction, DomainSize>::decrypt( value_type value, gsl::span< gsl::byte const > tweak ) const
+        {
+            check_value( value, __FUNCTION__ );
+            return decrypt_value( value, _f_function.tweak( tweak ) );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        template< class Tweak >
+        typename basic_fpe_feistel<FFunction, DomainSize>::value_type basic_fpe_feistel<FFunction, DomainSize>::encrypt_value( value_type value, Tweak const & tweak ) const
+        {
+            if( _walking == reverse_cycle_walking )
             {
-                throw std::overflow_error( TO_STR( basic_fpe_feistel ) "::" + std::string( __FUNCTION__ ) + ": value is out of domain" );
+                reverse_walk( gsl::span< value_type const >( &value, 1 ), gsl::span< value_type >( &value, 1 ), false, tweak );
+                return value;
             }
 
             do
             {
-                for( size_t round = 0; round < _domain_bits * 4; ++round )
+                for( size_t round = 0; round < _layout.rounds(); ++round )
                 {
                     //std::cout << "      value: " << ::tobin( value ) << "\n";
 
-                    uintmax_t const source = value & ( ( uintmax_t(1) << _source_bits ) - 1 );
+                    value_type const source = value & low_mask< value_type >( _layout.source_bits() );
                     //std::cout << "     source: " << ::tobin( source ) << "\n";
 
-                    uintmax_t target = value >> _source_bits;
+                    value_type target = value >> _layout.source_bits();
                     //std::cout << "     target: " << ::tobin( target ) << "\n";
 
-                    target ^= _f_function( source, round );
-                    value = ( source << _target_bits ) | target;
+                    target ^= round_function( source, round, tweak );
+                    value = ( source << _layout.target_bits() ) | target;
                     //std::cout << "     result: " << ::tobin( value ) << "\n";
 
                     //std::cout << "\n";
                 }
-                if( value >= _domain_size )
+                if( value >= _layout.domain_size() )
                 {
                     //std::cout << "domain size: " << ::tobin( domain_size ) << "\n";
                     //std::cout << "value >= domain size, apply F-function again" << "\n";
                 }
             }
-            while( value >= _domain_size );
+            while( value >= _layout.domain_size() );
 
 
             return value;
         }
 
-        template< class FFunction >
-        uintmax_t basic_fpe_feistel<FFunction>::decrypt( uintmax_t value )
+        template< class FFunction, uintmax_t DomainSize >
+        template< class Tweak >
+        typename basic_fpe_feistel<FFunction, DomainSize>::value_type basic_fpe_feistel<FFunction, DomainSize>::decrypt_value( value_type value, Tweak const & tweak ) const
         {
-            if( value >= _domain_size )
+            if( _walking == reverse_cycle_walking )
             {
-                throw std::overflow_error( TO_STR( basic_fpe_feistel ) ": value is out of domain" );
+                reverse_walk( gsl::span< value_type const >( &value, 1 ), gsl::span< value_type >( &value, 1 ), true, tweak );
+                return value;
             }
 
             do
             {
-                for( ssize_t round = _domain_bits * 4 - 1; round >= 0; --round )
+                for( ssize_t round = _layout.rounds() - 1; round >= 0; --round )
                 {
                     //std::cout << "      value: " << ::tobin( value ) << "\n";
                     //std::cout << " orig value: " << ::tobin( value ) << "\n";
 
-                    //uintmax_t const source = value & ( ( uintmax_t( 1 ) << source_bits ) - 1 );
-                    uintmax_t const source = value >> _target_bits;
+                    //value_type const source = value & ( ( value_type( 1 ) << source_bits ) - 1 );
+                    value_type const source = value >> _layout.target_bits();
                     //std::cout << "     source: " << ::tobin( source ) << "\n";
 
-                    uintmax_t target = value & ( ( uintmax_t(1) << _target_bits ) - 1 );
+                    value_type target = value & low_mask< value_type >( _layout.target_bits() );
                     //std::cout << "     target: " << ::tobin( target ) << "\n";
 
-                    target ^= _f_function( source, round );
-                    value = source | ( target << _source_bits );
+                    target ^= round_function( source, round, tweak );
+                    value = source | ( target << _layout.source_bits() );
                     //std::cout << "     result: " << ::tobin( value ) << "\n";
 
                     //std::cout << "\n";
                 }
-                if( value >= _domain_size )
+                if( value >= _layout.domain_size() )
                 {
                     //std::cout << "domain size: " << ::tobin( domain_size ) << "\n";
                     //std::cout << "value >= domain size, apply F-function again" << "\n";
                 }
             }
-            while( value >= _domain_size );
+            while( value >= _layout.domain_size() );
             return value;
         }
 
 
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::check_value( value_type const & value, std::string const & function ) const
+        {
+            if( value >= _layout.domain_size() )
+            {
+                throw std::overflow_error( TO_STR( basic_fpe_feistel ) "::" + function + ": value is out of domain" );
+            }
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::check_batch( gsl::span< value_type const > values, gsl::span< value_type > results, std::string const & function ) const
+        {
+            if( values.size() != results.size() )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_feistel ) "::" + function + ": values and results sizes differ" );
+            }
+
+            for( auto const value : values )
+            {
+                if( value >= _layout.domain_size() )
+                {
+                    throw std::overflow_error( TO_STR( basic_fpe_feistel ) "::" + function + ": value is out of domain" );
+                }
+            }
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::encrypt( gsl::span< value_type const > values, gsl::span< value_type > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+            encrypt_values( values, results, untweaked_t() );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::encrypt( gsl::span< value_type const > values, gsl::span< value_type > results, gsl::span< gsl::byte const > tweak ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+            encrypt_values( values, results, _f_function.tweak( tweak ) );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        template< class Tweak >
+        void basic_fpe_feistel<FFunction, DomainSize>::encrypt_values( gsl::span< value_type const > values, gsl::span< value_type > results, Tweak const & tweak ) const
+        {
+            if( _walking == reverse_cycle_walking )
+            {
+                reverse_walk( values, results, false, tweak );
+                return;
+            }
+
+            std::array< value_type, batch_lanes > lane_values;
+            std::array< size_t, batch_lanes > lane_indexes;
+            std::array< value_type, batch_lanes > sources;
+            std::array< value_type, batch_lanes > targets;
+
+            value_type const source_mask = low_mask< value_type >( _layout.source_bits() );
+
+            size_t lanes = 0;
+            size_t next = 0;
+            while( lanes != 0 or next != values.size() )
+            {
+                for( ; lanes < batch_lanes and next < values.size(); ++lanes, ++next )
+                {
+                    lane_values[ lanes ] = values[ next ];
+                    lane_indexes[ lanes ] = next;
+                }
+
+                for( size_t round = 0; round < _layout.rounds(); ++round )
+                {
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        sources[ lane ] = lane_values[ lane ] & source_mask;
+                    }
+
+                    round_function( gsl::as_span( sources ).first( lanes ), round, gsl::as_span( targets ).first( lanes ), tweak );
+
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        value_type const target = ( lane_values[ lane ] >> _layout.source_bits() ) ^ targets[ lane ];
+                        lane_values[ lane ] = ( sources[ lane ] << _layout.target_bits() ) | target;
+                    }
+                }
+
+                // Retire lanes which walked into the domain, the rest walk one more cycle.
+                size_t walking = 0;
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    if( lane_values[ lane ] < _layout.domain_size() )
+                    {
+                        results[ lane_indexes[ lane ] ] = lane_values[ lane ];
+                    }
+                    else
+                    {
+                        lane_values[ walking ] = lane_values[ lane ];
+                        lane_indexes[ walking ] = lane_indexes[ lane ];
+                        ++walking;
+                    }
+                }
+                lanes = walking;
+            }
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::decrypt( gsl::span< value_type const > values, gsl::span< value_type > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+            decrypt_values( values, results, untweaked_t() );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        void basic_fpe_feistel<FFunction, DomainSize>::decrypt( gsl::span< value_type const > values, gsl::span< value_type > results, gsl::span< gsl::byte const > tweak ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+            decrypt_values( values, results, _f_function.tweak( tweak ) );
+        }
+
+        template< class FFunction, uintmax_t DomainSize >
+        template< class Tweak >
+        void basic_fpe_feistel<FFunction, DomainSize>::decrypt_values( gsl::span< value_type const > values, gsl::span< value_type > results, Tweak const & tweak ) const
+        {
+            if( _walking == reverse_cycle_walking )
+            {
+                reverse_walk( values, results, true, tweak );
+                return;
+            }
+
+            std::array< value_type, batch_lanes > lane_values;
+            std::array< size_t, batch_lanes > lane_indexes;
+            std::array< value_type, batch_lanes > sources;
+            std::array< value_type, batch_lanes > targets;
+
+            value_type const target_mask = low_mask< value_type >( _layout.target_bits() );
+
+            size_t lanes = 0;
+            size_t next = 0;
+            while( lanes != 0 or next != values.size() )
+            {
+                for( ; lanes < batch_lanes and next < values.size(); ++lanes, ++next )
+                {
+                    lane_values[ lanes ] = values[ next ];
+                    lane_indexes[ lanes ] = next;
+                }
+
+                for( ssize_t round = _layout.rounds() - 1; round >= 0; --round )
+                {
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        sources[ lane ] = lane_values[ lane ] >> _layout.target_bits();
+                    }
+
+                    round_function( gsl::as_span( sources ).first( lanes ), round, gsl::as_span( targets ).first( lanes ), tweak );
+
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        value_type const target = ( lane_values[ lane ] & target_mask ) ^ targets[ lane ];
+                        lane_values[ lane ] = sources[ lane ] | ( target << _layout.source_bits() );
+                    }
+                }
+
+                // Retire lanes which walked into the domain, the rest walk one more cycle.
+                size_t walking = 0;
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    if( lane_values[ lane ] < _layout.domain_size() )
+                    {
+                        results[ lane_indexes[ lane ] ] = lane_values[ lane ];
+                    }
+                    else
+                    {
+                        lane_values[ walking ] = lane_values[ lane ];
+                        lane_indexes[ walking ] = lane_indexes[ lane ];
+                        ++walking;
+                    }
+                }
+                lanes = walking;
+            }
+        }
+
+
+        /// Pair {value, value ^ key} is named by the member with top bit of key cleared; that bit
+        /// is dropped, so both members give the same `domain_bits - 1` bit F-function source.
+        template< class FFunction, uintmax_t DomainSize >
+        typename basic_fpe_feistel<FFunction, DomainSize>::value_type basic_fpe_feistel<FFunction, DomainSize>::reverse_walk_source( value_type value, size_t step ) const
+        {
+            value_type const key = _reverse_walk_keys[ step ];
+            size_t const top = value_log2( key );
+
+            value_type const pair = low_bit( value_type( value >> top ) ) ? value_type( value ^ key ) : value;
+            return ( ( pair >> ( top + 1 ) ) << top ) | ( pair & low_mask< value_type >( top ) );
+        }
+
+        /// All values run every step in lockstep, there is nothing to retire. Decryption is the same
+        /// steps in reverse order.
+        template< class FFunction, uintmax_t DomainSize >
+        template< class Tweak >
+        void basic_fpe_feistel<FFunction, DomainSize>::reverse_walk( gsl::span< value_type const > values, gsl::span< value_type > results, bool const inverse, Tweak const & tweak ) const
+        {
+            std::array< value_type, batch_lanes > lane_values;
+            std::array< value_type, batch_lanes > sources;
+            std::array< value_type, batch_lanes > targets;
+
+            size_t const steps = _reverse_walk_keys.size();
+
+            for( size_t first = 0; first < size_t( values.size() ); first += batch_lanes )
+            {
+                size_t const lanes = std::min< size_t >( batch_lanes, values.size() - first );
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    lane_values[ lane ] = values[ first + lane ];
+                }
+
+                for( size_t i = 0; i < steps; ++i )
+                {
+                    size_t const step = inverse ? steps - 1 - i : i;
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        sources[ lane ] = reverse_walk_source( lane_values[ lane ], step );
+                    }
+
+                    round_function( gsl::as_span( sources ).first( lanes ), step, gsl::as_span( targets ).first( lanes ), tweak );
+
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        value_type const partner = lane_values[ lane ] ^ _reverse_walk_keys[ step ];
+                        if( low_bit( targets[ lane ] ) and partner < _layout.domain_size() )
+                        {
+                            lane_values[ lane ] = partner;
+                        }
+                    }
+                }
+
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    results[ first + lane ] = lane_values[ lane ];
+                }
+            }
+        }
+
+
 
 
     }
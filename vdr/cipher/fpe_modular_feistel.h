@@ -0,0 +1,457 @@
+#ifndef INCLUDED__VDR_CIPHER_FPE_MODULAR_FEISTEL_H
+#define INCLUDED__VDR_CIPHER_FPE_MODULAR_FEISTEL_H
+
+#include "vdr/cipher/fpe_feistel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// Balanced Feistel over Z_a x Z_b with a * b >= domain_size picked as tight as possible near
+        /// sqrt( domain_size ). Rounds add F output modulo a and b in turn instead of xor-ing bits, so
+        /// there is no rounding up to a power of two and cycle walking is left only for the few values
+        /// in [domain_size, a * b).
+        ///
+        /// F( B, round ) = AES( B ^ round mask ) reduced modulo a or b. Same key derivation scheme
+        /// and same integer surface as `basic_fpe_feistel`.
+        ///
+        /// BlockCipher is a policy with `aes`-like interface, see `basic_thorp_shuffle`.
+        template< class BlockCipher = vdr::cipher::aes128 >
+        class basic_fpe_modular_feistel
+        {
+        public:
+            typedef BlockCipher block_cipher;
+            typedef uintmax_t value_type;
+
+        public:
+            enum : size_t { default_rounds = 10 };
+            enum : size_t { batch_lanes = 64 };
+            enum : uintmax_t { min_domain_size = 4 };
+            /// How many `a` candidates above sqrt( domain_size ) are tried for the tightest `a * b`.
+            /// `a` stays under 2 * sqrt( domain_size ), so both halves keep about half of the bits.
+            enum : uintmax_t { radix_candidates = 4096 };
+
+        public:
+            /// `rounds` must be even and at least 4, small domains may want more than the default.
+            basic_fpe_modular_feistel( uintmax_t domain_size, std::string const & raw_key, size_t rounds = default_rounds );
+            ~basic_fpe_modular_feistel();
+
+            /// Const and safe to call from many threads on one instance.
+            uintmax_t encrypt( uintmax_t value ) const;
+            uintmax_t decrypt( uintmax_t value ) const;
+
+            /// Batch versions, same contract as in `basic_fpe_feistel`.
+            void encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+            void decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+
+            uintmax_t get_domain_size() const { return _domain_size; }
+            size_t get_rounds() const { return _rounds; }
+
+            /// Value is `left * get_right_radix() + right`, left in Z_a and right in Z_b.
+            uint64_t get_left_radix() const { return _radices.first; }
+            uint64_t get_right_radix() const { return _radices.second; }
+
+        private:
+            typedef block_cipher block_cipher_t;
+            typedef std::array< uint8_t, block_cipher_t::block_bytes > block_t;
+            typedef std::pair< uint64_t, uint64_t > radices_t;
+            typedef unsigned __int128 wide_t;
+
+        private:
+            static radices_t make_radices( uintmax_t domain_size );
+
+            block_t round_to_block( size_t const round ) const;
+            block_t masked_block( uint64_t const half, size_t const round ) const;
+            static wide_t block_to_wide( block_t const & block );
+
+            uint64_t round_radix( size_t const round ) const { return round % 2 == 0 ? _radices.first : _radices.second; }
+
+            void check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const;
+
+        private:
+            const uintmax_t _domain_size;
+            const size_t _rounds;
+            const radices_t _radices;
+
+            block_cipher_t _cipher;
+
+            /// Round cipher output depends on round only, so it is computed once for every round.
+            std::vector< block_t > _round_masks;
+        };
+
+        typedef basic_fpe_modular_feistel< vdr::cipher::aes128 > fpe_modular_feistel;
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        #define TO_STR(x) #x
+
+        template< class BlockCipher >
+        basic_fpe_modular_feistel<BlockCipher>::basic_fpe_modular_feistel( uintmax_t domain_size, std::string const & raw_key, size_t rounds )
+            : _domain_size( domain_size )
+            , _rounds( rounds )
+            , _radices( make_radices( domain_size ) )
+            , _cipher( unkeyed )
+        {
+            if( _rounds < 4 or _rounds % 2 != 0 )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_modular_feistel ) "::" + std::string( __FUNCTION__ ) + ": rounds must be even and at least 4" );
+            }
+
+            vdr::mac::hmac< vdr::hash::sha256 > mac( gsl::as_bytes( gsl::as_span(raw_key) ) );
+            {
+                auto derived_key = mac.get_empty_digest();
+                mac
+                    << gsl::as_bytes( gsl::ensure_z("for modular key") )
+                    >> derived_key;
+                _cipher.set_enc_key( derived_key );
+                vdr::wipe( derived_key );
+            }
+            {
+                block_cipher_t round_cipher( unkeyed );
+                {
+                    auto derived_key = mac.get_empty_digest();
+                    mac
+                        << gsl::as_bytes( gsl::ensure_z("for modular round") )
+                        >> derived_key;
+                    round_cipher.set_enc_key( derived_key );
+                    vdr::wipe( derived_key );
+                }
+
+                _round_masks.resize( _rounds );
+                for( size_t round = 0; round < _round_masks.size(); ++round )
+                {
+                    block_t const & round_block = round_to_block( round );
+                    round_cipher.enc( gsl::as_bytes( gsl::as_span( round_block ) ), gsl::as_writeable_bytes( gsl::as_span( _round_masks[ round ] ) ) );
+                }
+            }
+        }
+
+        template< class BlockCipher >
+        basic_fpe_modular_feistel<BlockCipher>::~basic_fpe_modular_feistel()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _round_masks ) ) );
+        }
+
+        /// a = ceil( sqrt( domain_size ) ) or a bit more, whichever leaves the fewest values to walk.
+        /// Always a * b - domain_size < a, and b >= 2, else odd rounds add nothing and the whole
+        /// cipher is a keyed rotation of Z_a.
+        template< class BlockCipher >
+        typename basic_fpe_modular_feistel<BlockCipher>::radices_t basic_fpe_modular_feistel<BlockCipher>::make_radices( uintmax_t domain_size )
+        {
+            if( domain_size < min_domain_size or domain_size > ( uintmax_t(1) << ( std::numeric_limits< uintmax_t >::digits - 1 ) ) )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_modular_feistel ) "::" + std::string( __FUNCTION__ ) + ": domain size is out of range" );
+            }
+
+            uint64_t root = uint64_t( std::sqrt( static_cast< long double >( domain_size ) ) );
+            while( wide_t( root ) * root > domain_size )
+            {
+                --root;
+            }
+            while( wide_t( root ) * root < domain_size )
+            {
+                ++root;
+            }
+
+            radices_t best( root, ( domain_size + root - 1 ) / root );
+            uint64_t const last = std::min< uint64_t >( root + std::min< uint64_t >( root, radix_candidates ), domain_size / 2 );
+            for( uint64_t a = root + 1; a <= last and best.first * best.second != domain_size; ++a )
+            {
+                uint64_t const b = ( domain_size + a - 1 ) / a;
+                if( a * b < best.first * best.second )
+                {
+                    best = radices_t( a, b );
+                }
+            }
+            return best;
+        }
+
+
+        template< class BlockCipher >
+        typename basic_fpe_modular_feistel<BlockCipher>::block_t basic_fpe_modular_feistel<BlockCipher>::round_to_block( size_t const round ) const
+        {
+            block_t block;
+            std::fill( block.begin(), block.end(), 0 );
+
+            static_assert( sizeof( block ) >= sizeof( round ), "" );
+            for( size_t i = 0; i < sizeof( round ); ++i )
+            {
+                block[ i ] = ( round >> ( i * bits_in_byte ) ) & 0xff;
+            }
+
+            return block;
+        }
+
+        template< class BlockCipher >
+        typename basic_fpe_modular_feistel<BlockCipher>::block_t basic_fpe_modular_feistel<BlockCipher>::masked_block( uint64_t const half, size_t const round ) const
+        {
+            block_t block = _round_masks[ round ];
+
+            static_assert( sizeof( block ) >= sizeof( half ), "" );
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            uint64_t word;
+            std::memcpy( &word, block.data(), sizeof( word ) );
+            word ^= half;
+            std::memcpy( block.data(), &word, sizeof( word ) );
+        #else
+            for( size_t i = 0; i < sizeof( half ); ++i )
+            {
+                block[ i ] ^= ( half >> ( i * bits_in_byte ) ) & 0xff;
+            }
+        #endif
+
+            return block;
+        }
+
+        template< class BlockCipher >
+        typename basic_fpe_modular_feistel<BlockCipher>::wide_t basic_fpe_modular_feistel<BlockCipher>::block_to_wide( block_t const & block )
+        {
+            wide_t result = 0;
+
+            static_assert( sizeof( block ) >= sizeof( result ), "" );
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            std::memcpy( &result, block.data(), sizeof( result ) );
+        #else
+            for( size_t i = sizeof( result ); i > 0; --i )
+            {
+                result = ( result << bits_in_byte ) | block[ i - 1 ];
+            }
+        #endif
+
+            return result;
+        }
+
+
+        /// [[left][right]]
+        /// [[right][(left + F(right)) mod radix]], radix is a on even rounds and b on odd ones.
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_modular_feistel<BlockCipher>::encrypt( uintmax_t value ) const
+        {
+            if( value >= _domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_fpe_modular_feistel ) "::" + std::string( __FUNCTION__ ) + ": value is out of domain" );
+            }
+
+            do
+            {
+                uint64_t left = value / _radices.second;
+                uint64_t right = value % _radices.second;
+                for( size_t round = 0; round < _rounds; ++round )
+                {
+                    block_t block = masked_block( right, round );
+                    _cipher.enc( gsl::as_bytes( gsl::as_span( block ) ), gsl::as_writeable_bytes( gsl::as_span( block ) ) );
+
+                    uint64_t const radix = round_radix( round );
+                    uint64_t const target = ( left + wide_mod( block_to_wide( block ), radix ) ) % radix;
+                    left = right;
+                    right = target;
+                }
+                value = left * _radices.second + right;
+            }
+            while( value >= _domain_size );
+
+            return value;
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_fpe_modular_feistel<BlockCipher>::decrypt( uintmax_t value ) const
+        {
+            if( value >= _domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_fpe_modular_feistel ) "::" + std::string( __FUNCTION__ ) + ": value is out of domain" );
+            }
+
+            do
+            {
+                uint64_t left = value / _radices.second;
+                uint64_t right = value % _radices.second;
+                for( ssize_t round = _rounds - 1; round >= 0; --round )
+                {
+                    block_t block = masked_block( left, round );
+                    _cipher.enc( gsl::as_bytes( gsl::as_span( block ) ), gsl::as_writeable_bytes( gsl::as_span( block ) ) );
+
+                    uint64_t const radix = round_radix( round );
+                    uint64_t const source = ( right + radix - wide_mod( block_to_wide( block ), radix ) ) % radix;
+                    right = left;
+                    left = source;
+                }
+                value = left * _radices.second + right;
+            }
+            while( value >= _domain_size );
+
+            return value;
+        }
+
+
+        template< class BlockCipher >
+        void basic_fpe_modular_feistel<BlockCipher>::check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const
+        {
+            if( values.size() != results.size() )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_modular_feistel ) "::" + function + ": values and results sizes differ" );
+            }
+
+            for( auto const value : values )
+            {
+                if( value >= _domain_size )
+                {
+                    throw std::overflow_error( TO_STR( basic_fpe_modular_feistel ) "::" + function + ": value is out of domain" );
+                }
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_modular_feistel<BlockCipher>::encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+
+            std::array< uint64_t, batch_lanes > lefts;
+            std::array< uint64_t, batch_lanes > rights;
+            std::array< size_t, batch_lanes > lane_indexes;
+            std::array< block_t, batch_lanes > blocks;
+
+            size_t lanes = 0;
+            size_t next = 0;
+            while( lanes != 0 or next != values.size() )
+            {
+                for( ; lanes < batch_lanes and next < values.size(); ++lanes, ++next )
+                {
+                    lefts[ lanes ] = values[ next ] / _radices.second;
+                    rights[ lanes ] = values[ next ] % _radices.second;
+                    lane_indexes[ lanes ] = next;
+                }
+
+                for( size_t round = 0; round < _rounds; ++round )
+                {
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        blocks[ lane ] = masked_block( rights[ lane ], round );
+                    }
+
+                    _cipher.enc_blocks(
+                        gsl::as_bytes( gsl::as_span( blocks ).first( lanes ) ),
+                        gsl::as_writeable_bytes( gsl::as_span( blocks ).first( lanes ) )
+                    );
+
+                    uint64_t const radix = round_radix( round );
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        uint64_t const target = ( lefts[ lane ] + wide_mod( block_to_wide( blocks[ lane ] ), radix ) ) % radix;
+                        lefts[ lane ] = rights[ lane ];
+                        rights[ lane ] = target;
+                    }
+                }
+
+                // Retire lanes which walked into the domain, the rest walk one more cycle.
+                size_t walking = 0;
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    uintmax_t const value = lefts[ lane ] * _radices.second + rights[ lane ];
+                    if( value < _domain_size )
+                    {
+                        results[ lane_indexes[ lane ] ] = value;
+                    }
+                    else
+                    {
+                        lefts[ walking ] = lefts[ lane ];
+                        rights[ walking ] = rights[ lane ];
+                        lane_indexes[ walking ] = lane_indexes[ lane ];
+                        ++walking;
+                    }
+                }
+                lanes = walking;
+            }
+
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( blocks ) ) );
+        }
+
+        template< class BlockCipher >
+        void basic_fpe_modular_feistel<BlockCipher>::decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+
+            std::array< uint64_t, batch_lanes > lefts;
+            std::array< uint64_t, batch_lanes > rights;
+            std::array< size_t, batch_lanes > lane_indexes;
+            std::array< block_t, batch_lanes > blocks;
+
+            size_t lanes = 0;
+            size_t next = 0;
+            while( lanes != 0 or next != values.size() )
+            {
+                for( ; lanes < batch_lanes and next < values.size(); ++lanes, ++next )
+                {
+                    lefts[ lanes ] = values[ next ] / _radices.second;
+                    rights[ lanes ] = values[ next ] % _radices.second;
+                    lane_indexes[ lanes ] = next;
+                }
+
+                for( ssize_t round = _rounds - 1; round >= 0; --round )
+                {
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        blocks[ lane ] = masked_block( lefts[ lane ], round );
+                    }
+
+                    _cipher.enc_blocks(
+                        gsl::as_bytes( gsl::as_span( blocks ).first( lanes ) ),
+                        gsl::as_writeable_bytes( gsl::as_span( blocks ).first( lanes ) )
+                    );
+
+                    uint64_t const radix = round_radix( round );
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        uint64_t const source = ( rights[ lane ] + radix - wide_mod( block_to_wide( blocks[ lane ] ), radix ) ) % radix;
+                        rights[ lane ] = lefts[ lane ];
+                        lefts[ lane ] = source;
+                    }
+                }
+
+                // Retire lanes which walked into the domain, the rest walk one more cycle.
+                size_t walking = 0;
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    uintmax_t const value = lefts[ lane ] * _radices.second + rights[ lane ];
+                    if( value < _domain_size )
+                    {
+                        results[ lane_indexes[ lane ] ] = value;
+                    }
+                    else
+                    {
+                        lefts[ walking ] = lefts[ lane ];
+                        rights[ walking ] = rights[ lane ];
+                        lane_indexes[ walking ] = lane_indexes[ lane ];
+                        ++walking;
+                    }
+                }
+                lanes = walking;
+            }
+
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( blocks ) ) );
+        }
+
+    }
+}
+
+
+#undef TO_STR
+
+#endif // INCLUDED__VDR_CIPHER_FPE_MODULAR_FEISTEL_H
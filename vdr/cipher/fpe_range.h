@@ -0,0 +1,100 @@
+#ifndef INCLUDED__VDR_CIPHER_FPE_RANGE_H
+#define INCLUDED__VDR_CIPHER_FPE_RANGE_H
+
+#include "vdr/parallel.h"
+#include "vdr/wipe.h"
+
+#include "microsoft/gsl.h"
+
+#include <array>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        enum : size_t { range_chunk = 4096 };
+
+        /// `results[ i ] = engine.encrypt( first + i )` for every i below `results.size()`, that is
+        /// the permutation of [first, first + results.size()), written straight into `results`.
+        ///
+        /// The range is split into `range_chunk` values long chunks over `threads` threads (0 means
+        /// all cores) by `vdr::parallel_for`, each chunk goes through batch `encrypt` of the one
+        /// shared engine, which therefore must be const (see `basic_fpe_feistel`). `Result` is any
+        /// integer type which holds domain values, e.g. `uint32_t` for a shuffled id map of 2^32.
+        ///
+        /// Out of domain values throw as in `Engine`, after all threads have stopped.
+        template< class Engine, class Result >
+        void encrypt_range( Engine const & engine, typename Engine::value_type first, gsl::span< Result > results, size_t threads = 0 );
+
+        /// Same as above with `decrypt`.
+        template< class Engine, class Result >
+        void decrypt_range( Engine const & engine, typename Engine::value_type first, gsl::span< Result > results, size_t threads = 0 );
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        namespace
+        {
+
+            template< class Engine, class Result >
+            void transform_range( Engine const & engine, typename Engine::value_type first, gsl::span< Result > results, size_t threads, bool const inverse )
+            {
+                typedef typename Engine::value_type value_type;
+
+                vdr::parallel_for( 0, uintmax_t( results.size() ), range_chunk, threads, [ & ]( uintmax_t const chunk_first, uintmax_t const chunk_last )
+                {
+                    size_t const count = chunk_last - chunk_first;
+
+                    std::array< value_type, range_chunk > values;
+                    std::array< value_type, range_chunk > chunk_results;
+                    for( size_t i = 0; i < count; ++i )
+                    {
+                        values[ i ] = first + value_type( chunk_first + i );
+                    }
+
+                    auto const chunk_values = gsl::as_span( values ).first( count );
+                    if( inverse )
+                    {
+                        engine.decrypt( chunk_values, gsl::as_span( chunk_results ).first( count ) );
+                    }
+                    else
+                    {
+                        engine.encrypt( chunk_values, gsl::as_span( chunk_results ).first( count ) );
+                    }
+
+                    for( size_t i = 0; i < count; ++i )
+                    {
+                        results[ chunk_first + i ] = Result( chunk_results[ i ] );
+                    }
+                    vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( chunk_results ) ) );
+                } );
+            }
+
+        } // anonymous namespace
+
+
+        template< class Engine, class Result >
+        void encrypt_range( Engine const & engine, typename Engine::value_type first, gsl::span< Result > results, size_t threads )
+        {
+            transform_range( engine, first, results, threads, false );
+        }
+
+        template< class Engine, class Result >
+        void decrypt_range( Engine const & engine, typename Engine::value_type first, gsl::span< Result > results, size_t threads )
+        {
+            transform_range( engine, first, results, threads, true );
+        }
+
+    }
+}
+
+#endif // INCLUDED__VDR_CIPHER_FPE_RANGE_H
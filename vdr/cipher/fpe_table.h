@@ -0,0 +1,273 @@
+#ifndef INCLUDED__VDR_CIPHER_FPE_TABLE_H
+#define INCLUDED__VDR_CIPHER_FPE_TABLE_H
+
+#include "vdr/cipher/fpe_feistel.h"
+#include "vdr/cipher/fpe_range.h"
+#include "vdr/parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// Whole permutation of a small domain and its inverse, materialised once with `Engine`, so
+        /// `encrypt`/`decrypt` are a single array load. Entries are 1, 2 or 4 bytes wide, whichever
+        /// is the smallest to hold `domain_size - 1`.
+        ///
+        /// Domains are capped at `max_domain_size` = 2^24 values, which take 128 MiB of tables;
+        /// larger ones throw before anything is allocated. Past that a table stops fitting any
+        /// cache and the engine itself is the better choice.
+        ///
+        /// Engine is anything with `basic_fpe_feistel` interface, const batch `encrypt` and
+        /// `( domain_size, raw_key )` constructor. One engine is shared by all build threads.
+        template< class Engine = vdr::cipher::fpe_feistel >
+        class basic_fpe_table
+        {
+        public:
+            typedef Engine engine;
+
+        public:
+            enum : uintmax_t { max_domain_size = uintmax_t(1) << 24 };
+            enum : size_t { build_chunk = 4096 };
+
+        public:
+            /// `threads == 0` means `std::thread::hardware_concurrency()`.
+            basic_fpe_table( uintmax_t domain_size, std::string const & raw_key, size_t threads = 0 );
+            ~basic_fpe_table();
+
+            uintmax_t encrypt( uintmax_t value ) const;
+            uintmax_t decrypt( uintmax_t value ) const;
+
+            /// Batch versions, same contract as in `basic_fpe_feistel`.
+            void encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+            void decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+
+            uintmax_t get_domain_size() const { return _domain_size; }
+
+            /// Width of one table entry and memory taken by both tables, in bytes.
+            size_t get_value_bytes() const { return _value_bytes; }
+            size_t get_table_bytes() const { return 2 * _domain_size * _value_bytes; }
+
+        private:
+            template< class Value >
+            struct tables_t
+            {
+                std::vector< Value > forward;
+                std::vector< Value > inverse;
+            };
+
+        private:
+            static size_t value_bytes( uintmax_t domain_size );
+
+            template< class Value >
+            void build( tables_t< Value > & tables, std::string const & raw_key, size_t threads );
+
+            template< class Value >
+            static void wipe( tables_t< Value > & tables );
+
+            template< class Value >
+            static void lookup( std::vector< Value > const & table, gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results );
+
+            void check( uintmax_t value, std::string const & function ) const;
+            void check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const;
+
+        private:
+            const uintmax_t _domain_size;
+            const size_t _value_bytes;
+
+            /// Only the one of `_value_bytes` width is filled.
+            tables_t< uint8_t > _tables8;
+            tables_t< uint16_t > _tables16;
+            tables_t< uint32_t > _tables32;
+        };
+
+        typedef basic_fpe_table< vdr::cipher::fpe_feistel > fpe_table;
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        #define TO_STR(x) #x
+
+        template< class Engine >
+        basic_fpe_table<Engine>::basic_fpe_table( uintmax_t domain_size, std::string const & raw_key, size_t threads )
+            : _domain_size( domain_size )
+            , _value_bytes( value_bytes( domain_size ) )
+        {
+            if( threads == 0 )
+            {
+                threads = std::max< size_t >( 1, std::thread::hardware_concurrency() );
+            }
+
+            switch( _value_bytes )
+            {
+                case sizeof( uint8_t ): build( _tables8, raw_key, threads ); break;
+                case sizeof( uint16_t ): build( _tables16, raw_key, threads ); break;
+                default: build( _tables32, raw_key, threads ); break;
+            }
+        }
+
+        template< class Engine >
+        basic_fpe_table<Engine>::~basic_fpe_table()
+        {
+            wipe( _tables8 );
+            wipe( _tables16 );
+            wipe( _tables32 );
+        }
+
+        template< class Engine >
+        size_t basic_fpe_table<Engine>::value_bytes( uintmax_t domain_size )
+        {
+            if( domain_size == 0 or domain_size > max_domain_size )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_table ) "::" + std::string( __FUNCTION__ ) + ": domain size is out of table range" );
+            }
+
+            uintmax_t const max_value = domain_size - 1;
+            if( max_value <= std::numeric_limits< uint8_t >::max() )
+            {
+                return sizeof( uint8_t );
+            }
+            if( max_value <= std::numeric_limits< uint16_t >::max() )
+            {
+                return sizeof( uint16_t );
+            }
+            return sizeof( uint32_t );
+        }
+
+        /// Forward table is `encrypt_range` of the whole domain. Inverse is scattered from forward
+        /// after it is done, every index is written once.
+        template< class Engine >
+        template< class Value >
+        void basic_fpe_table<Engine>::build( tables_t< Value > & tables, std::string const & raw_key, size_t threads )
+        {
+            tables.forward.resize( _domain_size );
+            tables.inverse.resize( _domain_size );
+
+            engine const fpe( _domain_size, raw_key );
+            encrypt_range( fpe, 0, gsl::as_span( tables.forward ), threads );
+
+            vdr::parallel_for( 0, _domain_size, build_chunk, threads, [ & ]( uintmax_t const first, uintmax_t const last )
+            {
+                for( uintmax_t value = first; value < last; ++value )
+                {
+                    tables.inverse[ tables.forward[ value ] ] = Value( value );
+                }
+            } );
+        }
+
+        template< class Engine >
+        template< class Value >
+        void basic_fpe_table<Engine>::wipe( tables_t< Value > & tables )
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( tables.forward ) ) );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( tables.inverse ) ) );
+        }
+
+
+        template< class Engine >
+        uintmax_t basic_fpe_table<Engine>::encrypt( uintmax_t value ) const
+        {
+            check( value, __FUNCTION__ );
+
+            switch( _value_bytes )
+            {
+                case sizeof( uint8_t ): return _tables8.forward[ value ];
+                case sizeof( uint16_t ): return _tables16.forward[ value ];
+                default: return _tables32.forward[ value ];
+            }
+        }
+
+        template< class Engine >
+        uintmax_t basic_fpe_table<Engine>::decrypt( uintmax_t value ) const
+        {
+            check( value, __FUNCTION__ );
+
+            switch( _value_bytes )
+            {
+                case sizeof( uint8_t ): return _tables8.inverse[ value ];
+                case sizeof( uint16_t ): return _tables16.inverse[ value ];
+                default: return _tables32.inverse[ value ];
+            }
+        }
+
+        template< class Engine >
+        void basic_fpe_table<Engine>::encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+
+            switch( _value_bytes )
+            {
+                case sizeof( uint8_t ): lookup( _tables8.forward, values, results ); break;
+                case sizeof( uint16_t ): lookup( _tables16.forward, values, results ); break;
+                default: lookup( _tables32.forward, values, results ); break;
+            }
+        }
+
+        template< class Engine >
+        void basic_fpe_table<Engine>::decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+
+            switch( _value_bytes )
+            {
+                case sizeof( uint8_t ): lookup( _tables8.inverse, values, results ); break;
+                case sizeof( uint16_t ): lookup( _tables16.inverse, values, results ); break;
+                default: lookup( _tables32.inverse, values, results ); break;
+            }
+        }
+
+        template< class Engine >
+        template< class Value >
+        void basic_fpe_table<Engine>::lookup( std::vector< Value > const & table, gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results )
+        {
+            for( size_t i = 0; i < size_t( values.size() ); ++i )
+            {
+                results[ i ] = table[ values[ i ] ];
+            }
+        }
+
+
+        template< class Engine >
+        void basic_fpe_table<Engine>::check( uintmax_t value, std::string const & function ) const
+        {
+            if( value >= _domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_fpe_table ) "::" + function + ": value is out of domain" );
+            }
+        }
+
+        template< class Engine >
+        void basic_fpe_table<Engine>::check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const
+        {
+            if( values.size() != results.size() )
+            {
+                throw std::invalid_argument( TO_STR( basic_fpe_table ) "::" + function + ": values and results sizes differ" );
+            }
+
+            for( auto const value : values )
+            {
+                check( value, function );
+            }
+        }
+
+    }
+}
+
+
+#undef TO_STR
+
+#endif // INCLUDED__VDR_CIPHER_FPE_TABLE_H
@@ -0,0 +1,198 @@
+#ifndef INCLUDED__VDR_CIPHER_PERMUTATION_VIEW_H
+#define INCLUDED__VDR_CIPHER_PERMUTATION_VIEW_H
+
+#include "vdr/cipher/fpe_feistel.h"
+
+#include "microsoft/gsl.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// Random order enumeration of 0 .. size - 1: element i is `engine.encrypt( i )`. Nothing is
+        /// stored, elements are computed on demand; every iterator keeps a window of the next
+        /// `prefetch_values` elements, filled by one batch `encrypt`, so walking keeps the block
+        /// cipher pipeline full. Jumping anywhere (`begin() + n`, `view[ n ]`) is O(1), so a walk
+        /// can be resumed from a saved position or split between workers by position ranges.
+        ///
+        /// Engine is only referred to and must outlive the view and its iterators; its batch
+        /// `encrypt` must be const, then many threads may walk one view, each with its own iterators.
+        /// `size` is at most `get_domain_size()` of the engine, otherwise construction throws.
+        template< class Engine = vdr::cipher::fpe_feistel >
+        class basic_permutation_view
+        {
+        public:
+            typedef Engine engine;
+            typedef typename engine::value_type value_type;
+
+            enum : size_t { prefetch_values = 64 };
+
+            class iterator;
+            typedef iterator const_iterator;
+
+        public:
+            basic_permutation_view( engine const & fpe, uintmax_t size );
+
+            iterator begin() const { return iterator( _engine, 0, _size ); }
+            iterator end() const { return iterator( _engine, _size, _size ); }
+
+            /// Single element, without prefetch.
+            value_type operator [] ( uintmax_t position ) const;
+
+            uintmax_t size() const { return _size; }
+            bool empty() const { return _size == 0; }
+
+        private:
+            engine const * _engine;
+            uintmax_t _size;
+        };
+
+
+        /// Random access iterator over positions of a `basic_permutation_view`. Dereferencing gives
+        /// a value, not a reference, like `std::vector< bool >` iterators. Positions out of the
+        /// window refill it from the new position on, or up to it when walking backwards.
+        template< class Engine >
+        class basic_permutation_view<Engine>::iterator
+        {
+        public:
+            typedef std::random_access_iterator_tag iterator_category;
+            typedef typename basic_permutation_view<Engine>::value_type value_type;
+            typedef ptrdiff_t difference_type;
+            typedef value_type const * pointer;
+            typedef value_type reference;
+
+        public:
+            iterator() : _engine( nullptr ), _position( 0 ), _size( 0 ), _window_first( 0 ), _window_size( 0 ) {}
+
+            value_type operator * () const;
+            value_type operator [] ( difference_type offset ) const { return *( *this + offset ); }
+
+            /// Position in the view, the argument of `encrypt`.
+            uintmax_t position() const { return _position; }
+
+            iterator & operator ++ () { ++_position; return *this; }
+            iterator & operator -- () { --_position; return *this; }
+            iterator operator ++ ( int ) { iterator result = *this; ++_position; return result; }
+            iterator operator -- ( int ) { iterator result = *this; --_position; return result; }
+
+            iterator & operator += ( difference_type offset ) { _position += offset; return *this; }
+            iterator & operator -= ( difference_type offset ) { _position -= offset; return *this; }
+
+            friend iterator operator + ( iterator it, difference_type offset ) { return it += offset; }
+            friend iterator operator + ( difference_type offset, iterator it ) { return it += offset; }
+            friend iterator operator - ( iterator it, difference_type offset ) { return it -= offset; }
+            friend difference_type operator - ( iterator const & left, iterator const & right ) { return difference_type( left._position - right._position ); }
+
+            friend bool operator == ( iterator const & left, iterator const & right ) { return left._position == right._position; }
+            friend bool operator != ( iterator const & left, iterator const & right ) { return left._position != right._position; }
+            friend bool operator < ( iterator const & left, iterator const & right ) { return left._position < right._position; }
+            friend bool operator > ( iterator const & left, iterator const & right ) { return left._position > right._position; }
+            friend bool operator <= ( iterator const & left, iterator const & right ) { return left._position <= right._position; }
+            friend bool operator >= ( iterator const & left, iterator const & right ) { return left._position >= right._position; }
+
+        private:
+            friend class basic_permutation_view<Engine>;
+
+            iterator( engine const * fpe, uintmax_t position, uintmax_t size )
+                : _engine( fpe ), _position( position ), _size( size ), _window_first( 0 ), _window_size( 0 )
+            {}
+
+            void fill_window() const;
+
+        private:
+            engine const * _engine;
+            uintmax_t _position;
+            uintmax_t _size;
+
+            /// Elements of positions [_window_first, _window_first + _window_size).
+            mutable uintmax_t _window_first;
+            mutable size_t _window_size;
+            mutable std::array< value_type, prefetch_values > _window;
+        };
+
+        typedef basic_permutation_view< vdr::cipher::fpe_feistel > permutation_view;
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        #define TO_STR(x) #x
+
+        template< class Engine >
+        basic_permutation_view<Engine>::basic_permutation_view( engine const & fpe, uintmax_t size )
+            : _engine( &fpe )
+            , _size( size )
+        {
+            if( fpe.get_domain_size() < value_type( size ) )
+            {
+                throw std::invalid_argument( TO_STR( basic_permutation_view ) "::" + std::string( __FUNCTION__ ) + ": view is larger than engine domain" );
+            }
+        }
+
+        template< class Engine >
+        typename basic_permutation_view<Engine>::value_type basic_permutation_view<Engine>::operator [] ( uintmax_t position ) const
+        {
+            if( position >= _size )
+            {
+                throw std::out_of_range( TO_STR( basic_permutation_view ) "::" + std::string( __FUNCTION__ ) + ": position is out of view" );
+            }
+            return _engine->encrypt( value_type( position ) );
+        }
+
+
+        template< class Engine >
+        typename basic_permutation_view<Engine>::value_type basic_permutation_view<Engine>::iterator::operator * () const
+        {
+            if( _position - _window_first >= _window_size )
+            {
+                fill_window();
+            }
+            return _window[ _position - _window_first ];
+        }
+
+        template< class Engine >
+        void basic_permutation_view<Engine>::iterator::fill_window() const
+        {
+            if( _position >= _size )
+            {
+                throw std::out_of_range( TO_STR( basic_permutation_view ) "::iterator::" + std::string( __FUNCTION__ ) + ": position is out of view" );
+            }
+
+            // Walking backwards is a position right before the window, prefetch towards the begin then.
+            bool const backwards = _window_size != 0 and _position < _window_first and _window_first - _position <= prefetch_values;
+            uintmax_t const first = backwards ? _position - std::min< uintmax_t >( _position, prefetch_values - 1 ) : _position;
+            size_t const count = std::min< uintmax_t >( prefetch_values, _size - first );
+
+            std::array< value_type, prefetch_values > positions;
+            for( size_t i = 0; i < count; ++i )
+            {
+                positions[ i ] = value_type( first + i );
+            }
+
+            _window_size = 0;
+            _engine->encrypt( gsl::as_span( positions ).first( count ), gsl::as_span( _window ).first( count ) );
+            _window_first = first;
+            _window_size = count;
+        }
+
+    }
+}
+
+
+#undef TO_STR
+
+#endif // INCLUDED__VDR_CIPHER_PERMUTATION_VIEW_H
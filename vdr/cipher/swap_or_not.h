@@ -0,0 +1,338 @@
+#ifndef INCLUDED__VDR_CIPHER_SWAP_OR_NOT_H
+#define INCLUDED__VDR_CIPHER_SWAP_OR_NOT_H
+
+#include "vdr/cipher/fpe_feistel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// Swap-or-not shuffle of Hoang, Morris and Rogaway over Z_N for any N, no rounding up to a
+        /// power of two and no cycle walking. Round i pairs X with X' = ( K_i - X ) mod N and swaps
+        /// them when F_i( max( X, X' ) ) is 1. Every round is an involution, so decryption runs the
+        /// same rounds backwards, and every value takes exactly `get_rounds()` block cipher calls.
+        ///
+        /// F_i( X ) = low bit of AES( X ^ round mask ), K_i is uniform in Z_N. Same key derivation
+        /// scheme and same integer surface as `basic_fpe_feistel`.
+        ///
+        /// BlockCipher is a policy with `aes`-like interface, see `basic_thorp_shuffle`.
+        template< class BlockCipher = vdr::cipher::aes128 >
+        class basic_swap_or_not
+        {
+        public:
+            typedef BlockCipher block_cipher;
+            typedef uintmax_t value_type;
+
+        public:
+            enum : size_t { batch_lanes = 64 };
+            enum : size_t { min_rounds = 8 };
+            /// Full security needs about 6 lg N rounds (HMR 2012), see `default_rounds`.
+            enum : size_t { rounds_per_domain_bit = 6 };
+
+        public:
+            /// `rounds == 0` means `default_rounds( domain_size )`.
+            basic_swap_or_not( uintmax_t domain_size, std::string const & raw_key, size_t rounds = 0 );
+            ~basic_swap_or_not();
+
+            /// Const, so one instance may be shared by threads, e.g. by `encrypt_range`.
+            uintmax_t encrypt( uintmax_t value ) const;
+            uintmax_t decrypt( uintmax_t value ) const;
+
+            /// Batch versions, same contract as in `basic_fpe_feistel`. All values take the same
+            /// rounds, so lanes run in lockstep without refilling.
+            void encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+            void decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const;
+
+            uintmax_t get_domain_size() const { return _domain_size; }
+            size_t get_rounds() const { return _rounds; }
+
+            static size_t default_rounds( uintmax_t domain_size );
+
+        private:
+            typedef block_cipher block_cipher_t;
+            typedef std::array< uint8_t, block_cipher_t::block_bytes > block_t;
+            typedef unsigned __int128 wide_t;
+
+        private:
+            block_t round_to_block( size_t const round ) const;
+            block_t masked_block( uintmax_t const value, size_t const round ) const;
+            static wide_t block_to_wide( block_t const & block );
+
+            uintmax_t partner( uintmax_t const value, size_t const round ) const;
+            void run( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, bool const inverse ) const;
+
+            void check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const;
+
+        private:
+            const uintmax_t _domain_size;
+            const size_t _rounds;
+
+            block_cipher_t _cipher;
+
+            /// Round cipher output depends on round only, so it is computed once for every round.
+            std::vector< block_t > _round_masks;
+            std::vector< uintmax_t > _round_keys;
+        };
+
+        typedef basic_swap_or_not< vdr::cipher::aes128 > swap_or_not;
+
+    }
+}
+
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        #define TO_STR(x) #x
+
+        template< class BlockCipher >
+        basic_swap_or_not<BlockCipher>::basic_swap_or_not( uintmax_t domain_size, std::string const & raw_key, size_t rounds )
+            : _domain_size( domain_size )
+            , _rounds( rounds != 0 ? rounds : default_rounds( domain_size ) )
+            , _cipher( unkeyed )
+        {
+            if( _domain_size == 0 )
+            {
+                throw std::invalid_argument( TO_STR( basic_swap_or_not ) "::" + std::string( __FUNCTION__ ) + ": domain size is out of range" );
+            }
+
+            vdr::mac::hmac< vdr::hash::sha256 > mac( gsl::as_bytes( gsl::as_span(raw_key) ) );
+            {
+                auto derived_key = mac.get_empty_digest();
+                mac
+                    << gsl::as_bytes( gsl::ensure_z("for swap-or-not key") )
+                    >> derived_key;
+                _cipher.set_enc_key( derived_key );
+                vdr::wipe( derived_key );
+            }
+            {
+                block_cipher_t round_cipher( unkeyed );
+                block_cipher_t partner_cipher( unkeyed );
+                {
+                    auto derived_key = mac.get_empty_digest();
+                    mac
+                        << gsl::as_bytes( gsl::ensure_z("for swap-or-not round") )
+                        >> derived_key;
+                    round_cipher.set_enc_key( derived_key );
+                    mac
+                        << gsl::as_bytes( gsl::ensure_z("for swap-or-not partner") )
+                        >> derived_key;
+                    partner_cipher.set_enc_key( derived_key );
+                    vdr::wipe( derived_key );
+                }
+
+                _round_masks.resize( _rounds );
+                _round_keys.resize( _rounds );
+                for( size_t round = 0; round < _rounds; ++round )
+                {
+                    block_t const & round_block = round_to_block( round );
+                    round_cipher.enc( gsl::as_bytes( gsl::as_span( round_block ) ), gsl::as_writeable_bytes( gsl::as_span( _round_masks[ round ] ) ) );
+
+                    block_t key_block;
+                    partner_cipher.enc( gsl::as_bytes( gsl::as_span( round_block ) ), gsl::as_writeable_bytes( gsl::as_span( key_block ) ) );
+                    _round_keys[ round ] = wide_mod( block_to_wide( key_block ), _domain_size );
+                    vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( key_block ) ) );
+                }
+            }
+        }
+
+        template< class BlockCipher >
+        basic_swap_or_not<BlockCipher>::~basic_swap_or_not()
+        {
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _round_masks ) ) );
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( _round_keys ) ) );
+        }
+
+        template< class BlockCipher >
+        size_t basic_swap_or_not<BlockCipher>::default_rounds( uintmax_t domain_size )
+        {
+            size_t const domain_bits = domain_size > 1 ? int_log2( domain_size - 1 ) + 1 : 0;
+            return std::max< size_t >( min_rounds, rounds_per_domain_bit * domain_bits );
+        }
+
+
+        template< class BlockCipher >
+        typename basic_swap_or_not<BlockCipher>::block_t basic_swap_or_not<BlockCipher>::round_to_block( size_t const round ) const
+        {
+            block_t block;
+            std::fill( block.begin(), block.end(), 0 );
+
+            static_assert( sizeof( block ) >= sizeof( round ), "" );
+            for( size_t i = 0; i < sizeof( round ); ++i )
+            {
+                block[ i ] = ( round >> ( i * bits_in_byte ) ) & 0xff;
+            }
+
+            return block;
+        }
+
+        template< class BlockCipher >
+        typename basic_swap_or_not<BlockCipher>::block_t basic_swap_or_not<BlockCipher>::masked_block( uintmax_t const value, size_t const round ) const
+        {
+            block_t block = _round_masks[ round ];
+
+            static_assert( sizeof( block ) >= sizeof( value ), "" );
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            uintmax_t word;
+            std::memcpy( &word, block.data(), sizeof( word ) );
+            word ^= value;
+            std::memcpy( block.data(), &word, sizeof( word ) );
+        #else
+            for( size_t i = 0; i < sizeof( value ); ++i )
+            {
+                block[ i ] ^= ( value >> ( i * bits_in_byte ) ) & 0xff;
+            }
+        #endif
+
+            return block;
+        }
+
+        template< class BlockCipher >
+        typename basic_swap_or_not<BlockCipher>::wide_t basic_swap_or_not<BlockCipher>::block_to_wide( block_t const & block )
+        {
+            wide_t result = 0;
+
+            static_assert( sizeof( block ) >= sizeof( result ), "" );
+        #if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            std::memcpy( &result, block.data(), sizeof( result ) );
+        #else
+            for( size_t i = sizeof( result ); i > 0; --i )
+            {
+                result = ( result << bits_in_byte ) | block[ i - 1 ];
+            }
+        #endif
+
+            return result;
+        }
+
+        /// ( K_i - value ) mod N without overflow, value < N.
+        template< class BlockCipher >
+        uintmax_t basic_swap_or_not<BlockCipher>::partner( uintmax_t const value, size_t const round ) const
+        {
+            uintmax_t const key = _round_keys[ round ];
+            return key >= value ? key - value : key + ( _domain_size - value );
+        }
+
+
+        template< class BlockCipher >
+        uintmax_t basic_swap_or_not<BlockCipher>::encrypt( uintmax_t value ) const
+        {
+            if( value >= _domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_swap_or_not ) "::" + std::string( __FUNCTION__ ) + ": value is out of domain" );
+            }
+
+            run( gsl::span< uintmax_t const >( &value, 1 ), gsl::span< uintmax_t >( &value, 1 ), false );
+            return value;
+        }
+
+        template< class BlockCipher >
+        uintmax_t basic_swap_or_not<BlockCipher>::decrypt( uintmax_t value ) const
+        {
+            if( value >= _domain_size )
+            {
+                throw std::overflow_error( TO_STR( basic_swap_or_not ) "::" + std::string( __FUNCTION__ ) + ": value is out of domain" );
+            }
+
+            run( gsl::span< uintmax_t const >( &value, 1 ), gsl::span< uintmax_t >( &value, 1 ), true );
+            return value;
+        }
+
+
+        template< class BlockCipher >
+        void basic_swap_or_not<BlockCipher>::check_batch( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, std::string const & function ) const
+        {
+            if( values.size() != results.size() )
+            {
+                throw std::invalid_argument( TO_STR( basic_swap_or_not ) "::" + function + ": values and results sizes differ" );
+            }
+
+            for( auto const value : values )
+            {
+                if( value >= _domain_size )
+                {
+                    throw std::overflow_error( TO_STR( basic_swap_or_not ) "::" + function + ": value is out of domain" );
+                }
+            }
+        }
+
+        template< class BlockCipher >
+        void basic_swap_or_not<BlockCipher>::encrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+            run( values, results, false );
+        }
+
+        template< class BlockCipher >
+        void basic_swap_or_not<BlockCipher>::decrypt( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results ) const
+        {
+            check_batch( values, results, __FUNCTION__ );
+            run( values, results, true );
+        }
+
+        /// [X] -> [X' = K_i - X] if F_i( max( X, X' ) ), else [X].
+        template< class BlockCipher >
+        void basic_swap_or_not<BlockCipher>::run( gsl::span< uintmax_t const > values, gsl::span< uintmax_t > results, bool const inverse ) const
+        {
+            std::array< uintmax_t, batch_lanes > lane_values;
+            std::array< uintmax_t, batch_lanes > partners;
+            std::array< block_t, batch_lanes > blocks;
+
+            for( size_t first = 0; first < size_t( values.size() ); first += batch_lanes )
+            {
+                size_t const lanes = std::min< size_t >( batch_lanes, values.size() - first );
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    lane_values[ lane ] = values[ first + lane ];
+                }
+
+                for( size_t i = 0; i < _rounds; ++i )
+                {
+                    size_t const round = inverse ? _rounds - 1 - i : i;
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        partners[ lane ] = partner( lane_values[ lane ], round );
+                        blocks[ lane ] = masked_block( std::max( lane_values[ lane ], partners[ lane ] ), round );
+                    }
+
+                    _cipher.enc_blocks(
+                        gsl::as_bytes( gsl::as_span( blocks ).first( lanes ) ),
+                        gsl::as_writeable_bytes( gsl::as_span( blocks ).first( lanes ) )
+                    );
+
+                    for( size_t lane = 0; lane < lanes; ++lane )
+                    {
+                        if( blocks[ lane ][ 0 ] & 1 )
+                        {
+                            lane_values[ lane ] = partners[ lane ];
+                        }
+                    }
+                }
+
+                for( size_t lane = 0; lane < lanes; ++lane )
+                {
+                    results[ first + lane ] = lane_values[ lane ];
+                }
+            }
+
+            vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( blocks ).first( std::min< size_t >( batch_lanes, values.size() ) ) ) );
+        }
+
+    }
+}
+
+
+#undef TO_STR
+
+#endif // INCLUDED__VDR_CIPHER_SWAP_OR_NOT_H
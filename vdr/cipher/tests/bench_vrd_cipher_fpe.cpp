@@ -0,0 +1,258 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/fpe_feistel.h"
+#include "vdr/cipher/ff1.h"
+#include "vdr/cipher/ff3_1.h"
+#include "vdr/cipher/fpe_range.h"
+#include "vdr/cipher/fpe_cache.h"
+#include "vdr/cipher/fpe_compact.h"
+#include "vdr/cipher/swap_or_not.h"
+
+// Rough per value cost of FPE engines on decimal domains, nanoseconds.
+
+
+template< class Engine >
+void bench_fpe( std::string const & name, Engine & engine, uintmax_t domain_size )
+{
+    enum : size_t { scalar_values = 1000 };
+    enum : size_t { batch_values = 20000 };
+
+    std::vector< uintmax_t > values( batch_values );
+    for( size_t i = 0; i < values.size(); ++i )
+    {
+        values[ i ] = ( i * 7919 ) % domain_size;
+    }
+    std::vector< uintmax_t > results( values.size() );
+
+    auto const start = std::chrono::steady_clock::now();
+    uintmax_t sink = 0;
+    for( size_t i = 0; i < scalar_values; ++i )
+    {
+        sink += engine.encrypt( values[ i ] );
+    }
+    auto const middle = std::chrono::steady_clock::now();
+    engine.encrypt( values, results );
+    auto const stop = std::chrono::steady_clock::now();
+
+    std::cout << std::setw( 12 ) << name
+        << std::setw( 12 ) << std::chrono::duration< double, std::nano >( middle - start ).count() / scalar_values
+        << std::setw( 12 ) << std::chrono::duration< double, std::nano >( stop - middle ).count() / batch_values
+        << ( sink == 0 ? " " : "" )
+        << "\n";
+}
+
+
+template< class FFunction >
+void bench_build( std::string const & name, uintmax_t domain_size )
+{
+    auto const start = std::chrono::steady_clock::now();
+    FFunction f_function( domain_size, "secret key" );
+    auto const stop = std::chrono::steady_clock::now();
+
+    std::cout << std::setw( 12 ) << name
+        << std::setw( 12 ) << std::chrono::duration< double, std::milli >( stop - start ).count() << " ms"
+        << "\n";
+}
+
+
+void bench_range( size_t threads, uintmax_t domain_size )
+{
+    vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key" );
+    std::vector< uint32_t > id_map( domain_size );
+
+    auto const start = std::chrono::steady_clock::now();
+    vdr::cipher::encrypt_range( fpe_feistel, 0, gsl::as_span( id_map ), threads );
+    auto const stop = std::chrono::steady_clock::now();
+
+    std::cout << std::setw( 12 ) << threads
+        << std::setw( 12 ) << std::chrono::duration< double, std::nano >( stop - start ).count() / domain_size
+        << "\n";
+}
+
+
+void bench_construct( uintmax_t domain_size )
+{
+    enum : size_t { keys = 1000 };
+
+    auto const start = std::chrono::steady_clock::now();
+    uintmax_t sink = 0;
+    for( size_t i = 0; i < keys; ++i )
+    {
+        vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "key " + std::to_string( i ) );
+        sink += fpe_feistel.get_rounds();
+    }
+    auto const middle = std::chrono::steady_clock::now();
+
+    // Shards fill unevenly, leave some room so that all keys stay cached.
+    vdr::cipher::fpe_cache cache( 2 * keys );
+    for( size_t i = 0; i < keys; ++i )
+    {
+        cache.get( domain_size, "key " + std::to_string( i ) );
+    }
+    auto const filled = std::chrono::steady_clock::now();
+    for( size_t i = 0; i < keys; ++i )
+    {
+        sink += cache.get( domain_size, "key " + std::to_string( i ) )->get_rounds();
+    }
+    auto const stop = std::chrono::steady_clock::now();
+
+    // One key over many domains.
+    vdr::cipher::fpe_key const key( "key" );
+    for( size_t i = 0; i < keys; ++i )
+    {
+        vdr::cipher::fpe_feistel const fpe_feistel( domain_size + i, key );
+        sink += fpe_feistel.get_rounds();
+    }
+    auto const keyed = std::chrono::steady_clock::now();
+
+    // Compact engines of all keys, a pool which holds all of them expanded.
+    vdr::cipher::fpe_pool pool( 2 * keys );
+    std::vector< std::unique_ptr< vdr::cipher::compact_fpe_feistel > > compacts;
+    for( size_t i = 0; i < keys; ++i )
+    {
+        compacts.emplace_back( new vdr::cipher::compact_fpe_feistel( pool, domain_size, "key " + std::to_string( i ) ) );
+    }
+    auto const compacted = std::chrono::steady_clock::now();
+    for( auto const & compact : compacts )
+    {
+        sink += compact->expand()->get_rounds();
+    }
+    auto const first_used = std::chrono::steady_clock::now();
+    for( auto const & compact : compacts )
+    {
+        sink += compact->expand()->get_rounds();
+    }
+    auto const expanded = std::chrono::steady_clock::now();
+
+    // One engine rekeyed in place for every key.
+    vdr::cipher::fpe_feistel rekeyed( domain_size, "key" );
+    for( size_t i = 0; i < keys; ++i )
+    {
+        std::string const raw_key = "key " + std::to_string( i );
+        rekeyed.rekey( gsl::as_bytes( gsl::as_span( raw_key ) ) );
+        sink += rekeyed.get_rounds();
+    }
+    auto const rekeyed_all = std::chrono::steady_clock::now();
+
+    std::cout << std::setw( 12 ) << "construct" << std::setw( 12 ) << std::chrono::duration< double, std::micro >( middle - start ).count() / keys << " us\n";
+    std::cout << std::setw( 12 ) << "cache miss" << std::setw( 12 ) << std::chrono::duration< double, std::micro >( filled - middle ).count() / keys << " us\n";
+    std::cout << std::setw( 12 ) << "cache hit" << std::setw( 12 ) << std::chrono::duration< double, std::micro >( stop - filled ).count() / keys << " us\n";
+    std::cout << std::setw( 12 ) << "from fpe_key" << std::setw( 12 ) << std::chrono::duration< double, std::micro >( keyed - stop ).count() / keys << " us\n";
+    std::cout << std::setw( 12 ) << "compact" << std::setw( 12 ) << std::chrono::duration< double, std::micro >( compacted - keyed ).count() / keys << " us, "
+        << sizeof( vdr::cipher::compact_fpe_feistel ) << " bytes idle\n";
+    std::cout << std::setw( 12 ) << "compact miss" << std::setw( 12 ) << std::chrono::duration< double, std::micro >( first_used - compacted ).count() / keys << " us\n";
+    std::cout << std::setw( 12 ) << "compact hit" << std::setw( 12 ) << std::chrono::duration< double, std::micro >( expanded - first_used ).count() / keys << " us\n";
+    std::cout << std::setw( 12 ) << "rekey" << std::setw( 12 ) << std::chrono::duration< double, std::micro >( rekeyed_all - expanded ).count() / keys << " us"
+        << ( sink == 0 ? " " : "" ) << "\n";
+}
+
+
+void bench_tweak( uintmax_t domain_size )
+{
+    enum : size_t { scalar_values = 1000 };
+
+    vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key" );
+
+    // Tweaks asked round robin: up to the cache size every call hits, above it every call misses.
+    for( size_t const tweak_count : { size_t( 1 ), size_t( vdr::cipher::thorp_shuffle::tweak_cache_entries ), size_t( 4 * vdr::cipher::thorp_shuffle::tweak_cache_entries ) } )
+    {
+        std::vector< std::string > tweaks;
+        for( size_t i = 0; i < tweak_count; ++i )
+        {
+            tweaks.push_back( "tenant " + std::to_string( i ) );
+        }
+
+        auto const start = std::chrono::steady_clock::now();
+        uintmax_t sink = 0;
+        for( size_t i = 0; i < scalar_values; ++i )
+        {
+            sink += fpe_feistel.encrypt( ( i * 7919 ) % domain_size, gsl::as_bytes( gsl::as_span( tweaks[ i % tweak_count ] ) ) );
+        }
+        auto const stop = std::chrono::steady_clock::now();
+
+        std::cout << std::setw( 12 ) << tweak_count
+            << std::setw( 12 ) << std::chrono::duration< double, std::nano >( stop - start ).count() / scalar_values
+            << ( sink == 0 ? " " : "" )
+            << "\n";
+    }
+}
+
+
+int main( int ac, char *av[] )
+{
+    static const uint8_t key[ 16 ] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+
+    std::cout << std::setw( 12 ) << "engine" << std::setw( 12 ) << "scalar" << std::setw( 12 ) << "batch" << "\n";
+    for( size_t digits = 6; digits <= 12; digits += 2 )
+    {
+        uintmax_t domain_size = 1;
+        for( size_t i = 0; i < digits; ++i )
+        {
+            domain_size *= 10;
+        }
+        std::cout << "10^" << digits << ":\n";
+
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key" );
+        bench_fpe( "fpe_feistel", fpe_feistel, domain_size );
+
+        vdr::cipher::fpe_feistel_amortised fpe_feistel_amortised( domain_size, "secret key" );
+        bench_fpe( "amortised", fpe_feistel_amortised, domain_size );
+
+        vdr::cipher::swap_or_not swap_or_not( domain_size, "secret key" );
+        bench_fpe( "swap_or_not", swap_or_not, domain_size );
+
+        vdr::cipher::fpe_ff1 fpe_ff1( 10, digits, gsl::as_bytes( gsl::as_span( key ) ) );
+        bench_fpe( "fpe_ff1", fpe_ff1, domain_size );
+
+        vdr::cipher::fpe_ff3_1 fpe_ff3_1( 10, digits, gsl::as_bytes( gsl::as_span( key ) ) );
+        bench_fpe( "fpe_ff3_1", fpe_ff3_1, domain_size );
+    }
+
+    {
+        enum : uintmax_t { domain_size = 1000000000 };
+        std::cout << "10^9, runtime and compile time domain:\n";
+
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key" );
+        bench_fpe( "runtime", fpe_feistel, domain_size );
+
+        vdr::cipher::fpe_feistel_fixed< domain_size > fpe_feistel_fixed( "secret key" );
+        bench_fpe( "fixed", fpe_feistel_fixed, domain_size );
+    }
+
+    // Tabulation asks every source for all rounds, one block serves up to 128 of them.
+    std::cout << std::setw( 12 ) << "tabulated" << std::setw( 12 ) << "build" << "\n";
+    for( size_t bits = 16; bits <= 20; bits += 4 )
+    {
+        std::cout << "2^" << bits << ":\n";
+        bench_build< vdr::cipher::tabulated_thorp_shuffle >( "thorp", uintmax_t(1) << bits );
+        bench_build< vdr::cipher::tabulated_amortised_thorp_shuffle >( "amortised", uintmax_t(1) << bits );
+    }
+
+    // Whole domain into a caller buffer, per value; all cores should divide one thread's time.
+    std::cout << std::setw( 12 ) << "threads" << std::setw( 12 ) << "range" << "\n";
+    std::cout << "2^24:\n";
+    bench_range( 1, uintmax_t(1) << 24 );
+    bench_range( std::max< size_t >( 1, std::thread::hardware_concurrency() ), uintmax_t(1) << 24 );
+
+    // Engine per tenant key: construction against a warm cache.
+    std::cout << "10^9, per key:\n";
+    bench_construct( 1000000000 );
+
+    // Scalar encryption with a tweak per call, the first row is hits only.
+    std::cout << std::setw( 12 ) << "tweaks" << std::setw( 12 ) << "scalar" << "\n";
+    std::cout << "10^9:\n";
+    bench_tweak( 1000000000 );
+
+    return 0;
+}
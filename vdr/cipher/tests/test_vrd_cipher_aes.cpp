@@ -51,6 +51,103 @@ void test_cipher_aes()
         }
     }
 
+    {
+        // FIPS-197, Appendix C.
+        std::array< gsl::byte, 32 > key;
+        for( size_t i = 0; i < key.size(); ++i )
+        {
+            key[ i ] = gsl::byte( i );
+        }
+        std::array< gsl::byte, 16 > plain;
+        for( size_t i = 0; i < plain.size(); ++i )
+        {
+            plain[ i ] = gsl::byte( i * 0x11 );
+        }
+
+        auto check = [ & ]( auto & aes, std::string const & expected )
+        {
+            aes.set_enc_key( gsl::as_span( key ).first( aes.get_key_bytes() ) );
+
+            auto out = aes.get_empty_block();
+            aes.enc( plain, out );
+
+            std::array< gsl::byte, 4 * 16 > blocks_in;
+            std::array< gsl::byte, 4 * 16 > blocks_out;
+            for( size_t i = 0; i < blocks_in.size(); ++i )
+            {
+                blocks_in[ i ] = plain[ i % plain.size() ];
+            }
+            aes.enc_blocks( blocks_in, blocks_out );
+
+            auto dec_out = aes.get_empty_block();
+            aes.set_dec_key( gsl::as_span( key ).first( aes.get_key_bytes() ) );
+            aes.dec( out, dec_out );
+
+            std::cerr   << "AES-" << aes.get_key_bits() << ( aes.uses_aesni() ? " (AES-NI)" : " (OpenSSL)" ) << "\n"
+                        << "enc out: " << tohex(out) << "\n"
+                        << "expected: " << expected << "\n"
+                        << std::endl;
+
+            if(
+                tohex( out ) != expected
+                or tohex( gsl::as_span( blocks_out ).subspan( 48, 16 ) ) != expected
+                or dec_out != plain
+            )
+            {
+                std::cerr << "mismatch, error." << std::endl;
+            }
+            else
+            {
+                std::cerr << "ok" << std::endl;
+            }
+        };
+
+        vdr::cipher::aes< 128 > aes128;
+        vdr::cipher::aes< 192 > aes192;
+        vdr::cipher::aes< 256 > aes256;
+        check( aes128, "69c4e0d86a7b0430d8cdb78070b4c55a" );
+        check( aes192, "dda97ca4864cdfe06eaf70a0ec0d7191" );
+        check( aes256, "8ea2b7ca516745bfeafc49904b496089" );
+    }
+
+    {
+        // Wide multi-block paths must agree with single block path, including the tail.
+        constexpr const char rawkey[16] = "SomeKeyRightHer";
+
+        vdr::cipher::aes128 aes;
+        aes.set_enc_key( gsl::as_bytes( gsl::as_span( rawkey ) ) );
+
+        std::array< gsl::byte, 37 * 16 > in;
+        for( size_t i = 0; i < in.size(); ++i )
+        {
+            in[ i ] = gsl::byte( i * 7 );
+        }
+        auto out = in;
+        aes.enc_blocks( in, out );
+
+        bool ok = true;
+        for( size_t offset = 0; offset < in.size(); offset += 16 )
+        {
+            auto block = aes.get_empty_block();
+            aes.enc( gsl::as_span( in ).subspan( offset, 16 ), block );
+            ok = ok and tohex( block ) == tohex( gsl::as_span( out ).subspan( offset, 16 ) );
+        }
+
+        auto dec_out = in;
+        aes.set_dec_key( gsl::as_bytes( gsl::as_span( rawkey ) ) );
+        aes.dec_blocks( out, dec_out );
+
+        std::cerr   << "blocks" << ( aes.uses_vaes() ? " (VAES)" : "" ) << "\n" << std::endl;
+        if( not ok or dec_out != in )
+        {
+            std::cerr << "mismatch, error." << std::endl;
+        }
+        else
+        {
+            std::cerr << "ok" << std::endl;
+        }
+    }
+
 }
 
 
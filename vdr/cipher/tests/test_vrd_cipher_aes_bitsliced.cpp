@@ -0,0 +1,120 @@
+#include <iostream>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/aes.h"
+#include "vdr/cipher/aes_bitsliced.h"
+
+
+std::string tohex( gsl::span< gsl::byte const > data );
+std::string tohex( std::string const & data );
+
+
+template< class Word >
+void test_cipher_aes_bitsliced()
+{
+    {
+        // FIPS-197, Appendix C.1.
+        std::array< gsl::byte, 16 > key;
+        std::array< gsl::byte, 16 > plain;
+        for( size_t i = 0; i < key.size(); ++i )
+        {
+            key[ i ] = gsl::byte( i );
+            plain[ i ] = gsl::byte( i * 0x11 );
+        }
+
+        vdr::cipher::aes_bitsliced< Word > aes;
+        aes.set_enc_key( key );
+
+        auto out = aes.get_empty_block();
+        aes.enc( plain, out );
+        std::cerr   << "bitsliced " << aes.lanes << " lanes\n"
+                    << "enc out : " << tohex(out) << "\n"
+                    << "expected: 69c4e0d86a7b0430d8cdb78070b4c55a\n"
+                    << std::endl;
+
+        if( tohex( out ) != "69c4e0d86a7b0430d8cdb78070b4c55a" )
+        {
+            std::cerr << "mismatch, error." << std::endl;
+        }
+        else
+        {
+            std::cerr << "ok" << std::endl;
+        }
+    }
+
+    {
+        // Every lane of full and partial groups must agree with `aes`.
+        constexpr const char rawkey[16] = "SomeKeyRightHer";
+
+        vdr::cipher::aes_bitsliced< Word > aes_bitsliced;
+        aes_bitsliced.set_enc_key( gsl::as_bytes( gsl::as_span( rawkey ) ) );
+
+        vdr::cipher::aes128 aes;
+        aes.set_enc_key( gsl::as_bytes( gsl::as_span( rawkey ) ) );
+
+        std::vector< gsl::byte > in( ( 2 * vdr::cipher::aes_bitsliced< Word >::lanes + 3 ) * 16 );
+        for( size_t i = 0; i < in.size(); ++i )
+        {
+            in[ i ] = gsl::byte( i * 31 + 7 );
+        }
+        auto out = in;
+        auto bitsliced_out = in;
+
+        aes.enc_blocks( in, out );
+        aes_bitsliced.enc_blocks( in, bitsliced_out );
+
+        if( out != bitsliced_out )
+        {
+            std::cerr << "blocks mismatch, error." << std::endl;
+        }
+        else
+        {
+            std::cerr << "blocks ok" << std::endl;
+        }
+    }
+}
+
+
+
+
+
+int main( int ac, char *av[] )
+{
+    test_cipher_aes_bitsliced< uint8_t >();
+    test_cipher_aes_bitsliced< uint32_t >();
+    test_cipher_aes_bitsliced< uint64_t >();
+    return 0;
+}
+
+
+
+std::string tohex( gsl::span< gsl::byte const > data )
+{
+    std::string result;
+    result.reserve( data.size_bytes() * 2 );
+
+    static constexpr char hexes[] = "0123456789abcdef";
+
+    for( auto const rawbyte : data )
+    {
+        uint8_t byte = static_cast< uint8_t >( rawbyte );
+        result += hexes[ byte >> 4  ];
+        result += hexes[ byte & 0xf ];
+    }
+
+    return result;
+}
+
+
+
+std::string tohex( std::string const & data )
+{
+    return tohex( gsl::as_bytes( gsl::as_span( data ) ) );
+}
@@ -0,0 +1,213 @@
+#include <iostream>
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/aes.h"
+#include "vdr/cipher/aes_evp.h"
+
+
+std::string tohex( gsl::span< gsl::byte const > data );
+std::string tohex( std::string const & data );
+
+
+void test_cipher_aes_evp()
+{
+    {
+        constexpr const char rawkey[16] = "SomeKeyRightHer";
+
+        vdr::cipher::aes_evp128 aes;
+        aes.set_enc_key( gsl::as_bytes( gsl::as_span( rawkey ) ) );
+
+        auto in = aes.get_empty_block();
+        auto out = aes.get_empty_block(); 
+
+        aes.enc( in, out );
+        std::cerr   << "enc in : " << tohex(in) << "\n"
+                    << "enc out: " << tohex(out) << "\n"
+                    << std::endl;
+
+        in = out;
+
+        aes.set_dec_key( gsl::as_bytes( gsl::as_span(rawkey) ) );
+
+        aes.dec( in, out );
+        std::cerr   << "dec in : " << tohex(in) << "\n"
+                    << "dec out: " << tohex(out) << "\n"
+                    << std::endl;
+
+        if( out != decltype(out)() )
+        {
+            std::cerr << "mismatch, error." << std::endl;
+        }
+        else
+        {
+            std::cerr << "ok" << std::endl;
+        }
+    }
+
+    {
+        constexpr const char rawkey[16] = "SomeKeyRightHer";
+
+        vdr::cipher::aes128 aes;
+        aes.set_enc_key( gsl::as_bytes( gsl::as_span( rawkey ) ) );
+
+        vdr::cipher::aes_evp128 aes_evp;
+        aes_evp.set_enc_key( gsl::as_bytes( gsl::as_span( rawkey ) ) );
+
+        std::array< gsl::byte, 5 * vdr::cipher::aes128::block_bytes > in;
+        for( size_t i = 0; i < in.size(); ++i )
+        {
+            in[ i ] = gsl::byte( i );
+        }
+        auto out = in;
+        auto evp_out = in;
+
+        aes.enc_blocks( in, out );
+        aes_evp.enc_blocks( in, evp_out );
+        std::cerr   << "blocks enc out    : " << tohex(out) << "\n"
+                    << "blocks evp enc out: " << tohex(evp_out) << "\n"
+                    << std::endl;
+
+        if( out != evp_out )
+        {
+            std::cerr << "mismatch, error." << std::endl;
+        }
+        else
+        {
+            std::cerr << "ok" << std::endl;
+        }
+    }
+
+    {
+        // One thread going round many instances, each rekeyed half way.
+        enum { instances = 12 };
+        std::array< vdr::cipher::aes128, instances > aes;
+        std::array< vdr::cipher::aes_evp128, instances > aes_evp;
+        for( size_t i = 0; i < instances; ++i )
+        {
+            auto key = aes[ i ].get_empty_key();
+            key[ 0 ] = gsl::byte( i );
+            aes[ i ].set_enc_key( key );
+            aes_evp[ i ].set_enc_key( key );
+        }
+
+        bool mismatch = false;
+        for( size_t step = 0; step < 4 * instances; ++step )
+        {
+            size_t const i = ( step < 2 * instances ? step % 3 : step % instances );
+            if( step == 2 * instances )
+            {
+                for( size_t j = 0; j < instances; ++j )
+                {
+                    auto key = aes[ j ].get_empty_key();
+                    key[ 1 ] = gsl::byte( j );
+                    aes[ j ].set_enc_key( key );
+                    aes_evp[ j ].set_enc_key( key );
+                }
+            }
+            auto const in = aes[ i ].get_empty_block();
+            auto out = in;
+            auto evp_out = in;
+            aes[ i ].enc( in, out );
+            aes_evp[ i ].enc( in, evp_out );
+            mismatch = mismatch or out != evp_out;
+        }
+
+        if( mismatch )
+        {
+            std::cerr << "instances mismatch, error." << std::endl;
+        }
+        else
+        {
+            std::cerr << "instances ok" << std::endl;
+        }
+    }
+
+    {
+        // More threads than kept context copies, all on one instance.
+        enum { threads = 24 };
+        vdr::cipher::aes128 aes;
+        vdr::cipher::aes_evp128 aes_evp;
+        auto const key = aes.get_empty_key();
+        aes.set_enc_key( key );
+        aes_evp.set_enc_key( key );
+
+        std::vector< std::thread > workers;
+        std::array< bool, threads > mismatches{};
+        for( size_t t = 0; t < threads; ++t )
+        {
+            workers.emplace_back( [ &, t ]()
+            {
+                auto block = aes.get_empty_block();
+                for( size_t i = 0; i < 1000; ++i )
+                {
+                    block[ 0 ] = gsl::byte( t );
+                    auto out = block;
+                    auto evp_out = block;
+                    aes.enc( block, out );
+                    aes_evp.enc( block, evp_out );
+                    mismatches[ t ] = mismatches[ t ] or out != evp_out;
+                    block = out;
+                }
+            } );
+        }
+        for( auto & worker : workers )
+        {
+            worker.join();
+        }
+
+        if( std::find( mismatches.begin(), mismatches.end(), true ) != mismatches.end() )
+        {
+            std::cerr << "threads mismatch, error." << std::endl;
+        }
+        else
+        {
+            std::cerr << "threads ok" << std::endl;
+        }
+    }
+
+}
+
+
+
+
+
+int main( int ac, char *av[] )
+{
+    test_cipher_aes_evp();
+    return 0;
+}
+
+
+
+std::string tohex( gsl::span< gsl::byte const > data )
+{
+    std::string result;
+    result.reserve( data.size_bytes() * 2 );
+
+    static constexpr char hexes[] = "0123456789abcdef";
+
+    for( auto const rawbyte : data )
+    {
+        uint8_t byte = static_cast< uint8_t >( rawbyte );
+        result += hexes[ byte >> 4  ];
+        result += hexes[ byte & 0xf ];
+    }
+
+    return result;
+}
+
+
+
+std::string tohex( std::string const & data )
+{
+    return tohex( gsl::as_bytes( gsl::as_span( data ) ) );
+}
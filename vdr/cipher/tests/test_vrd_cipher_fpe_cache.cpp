@@ -0,0 +1,137 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/fpe_feistel.h"
+#include "vdr/cipher/fpe_cache.h"
+
+
+int test_cipher_fpe_cache()
+{
+    {
+        // Cached engine is the same permutation as a fresh one, found again by key and domain.
+        vdr::cipher::fpe_cache cache( 4, 1 );
+
+        auto const engine = cache.get( 1000, "secret key" );
+        vdr::cipher::fpe_feistel const fresh( 1000, "secret key" );
+        for( uintmax_t i = 0; i < 1000; ++i )
+        {
+            if( engine->encrypt( i ) != fresh.encrypt( i ) )
+            {
+                std::cout << "error: cached engine mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+
+        if( cache.get( 1000, "secret key" ) != engine or cache.get( 1001, "secret key" ) == engine or cache.get( 1000, "other key" ) == engine )
+        {
+            std::cout << "error: cache lookup mismatch\n" << std::flush;
+            return 1;
+        }
+
+        auto const stats = cache.get_stats();
+        if( stats.hits != 1 or stats.misses != 3 or stats.evictions != 0 or cache.size() != 3 )
+        {
+            std::cout << "error: unexpected cache counters " << stats.hits << "/" << stats.misses << "/" << stats.evictions << "\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        // One shard of capacity 2: least recently used engine goes first, evicted engine stays usable.
+        vdr::cipher::fpe_cache cache( 2, 1 );
+
+        auto const first = cache.get( 1000, "key 1" );
+        cache.get( 1000, "key 2" );
+        cache.get( 1000, "key 1" );
+        cache.get( 1000, "key 3" );
+
+        auto const stats = cache.get_stats();
+        if( stats.evictions != 1 or cache.size() != 2 or cache.get( 1000, "key 1" ) != first or cache.get_stats().hits != 2 )
+        {
+            std::cout << "error: least recently used engine was not evicted\n" << std::flush;
+            return 1;
+        }
+        cache.get( 1000, "key 2" );
+        if( cache.get_stats().misses != 4 )
+        {
+            std::cout << "error: evicted engine was found\n" << std::flush;
+            return 1;
+        }
+
+        cache.clear();
+        if( cache.size() != 0 or first->decrypt( first->encrypt( 7 ) ) != 7 )
+        {
+            std::cout << "error: clear mismatch\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        // Threads asking for overlapping keys all get working engines, capacity is never exceeded.
+        enum : size_t { threads_count = 4, keys = 40 };
+        vdr::cipher::fpe_cache cache( 16 );
+
+        std::vector< int > failures( threads_count, 0 );
+        std::vector< std::thread > threads;
+        for( size_t thread = 0; thread < threads_count; ++thread )
+        {
+            threads.emplace_back( [ &, thread ]()
+            {
+                for( size_t i = 0; i < 200; ++i )
+                {
+                    size_t const key = ( i * 7 + thread ) % keys;
+                    auto const engine = cache.get( 1000, "key " + std::to_string( key ) );
+                    uintmax_t const value = ( i * 13 ) % 1000;
+                    if( engine->decrypt( engine->encrypt( value ) ) != value or cache.size() > cache.get_capacity() )
+                    {
+                        ++failures[ thread ];
+                    }
+                }
+            } );
+        }
+        for( auto & thread : threads )
+        {
+            thread.join();
+        }
+
+        auto const stats = cache.get_stats();
+        std::cerr << "cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions\n";
+        for( auto const failed : failures )
+        {
+            if( failed != 0 or stats.hits + stats.misses != threads_count * 200 )
+            {
+                std::cout << "error: concurrent cache mismatch\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    try
+    {
+        vdr::cipher::fpe_cache cache( 0 );
+        std::cout << "error: empty cache is accepted\n" << std::flush;
+        return 1;
+    }
+    catch( std::invalid_argument const & )
+    {
+    }
+
+    return 0;
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_fpe_cache();
+}
@@ -0,0 +1,145 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+#include <memory>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/fpe_feistel.h"
+#include "vdr/cipher/fpe_compact.h"
+
+
+int test_cipher_fpe_compact()
+{
+    {
+        // Same permutation as a full engine of the same raw key, with and without tweak.
+        vdr::cipher::fpe_pool pool( 4, 2 );
+        for( uintmax_t const domain_size : { uintmax_t(1000), uintmax_t(1000000000) } )
+        {
+            vdr::cipher::compact_fpe_feistel const compact( pool, domain_size, "secret key" );
+            vdr::cipher::fpe_feistel const full( domain_size, "secret key" );
+            auto const tweak = gsl::as_bytes( gsl::ensure_z( "tenant" ) );
+
+            std::vector< uintmax_t > values( 300 );
+            for( size_t i = 0; i < values.size(); ++i )
+            {
+                values[ i ] = ( i * 7919 ) % domain_size;
+            }
+            std::vector< uintmax_t > encrypted( values.size() );
+            compact.encrypt( values, encrypted );
+
+            for( size_t i = 0; i < values.size(); ++i )
+            {
+                if( encrypted[ i ] != full.encrypt( values[ i ] ) or compact.decrypt( encrypted[ i ] ) != values[ i ]
+                    or compact.encrypt( values[ i ], tweak ) != full.encrypt( values[ i ], tweak ) )
+                {
+                    std::cout << "error: compact engine differs over domain " << domain_size << " at " << values[ i ] << "\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+
+        // Destroyed compact engines drop their expanded engines.
+        if( pool.size() != 0 )
+        {
+            std::cout << "error: expanded engines outlive compact ones\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        // More compact engines than the pool holds: evicted ones expand again, still the same permutation.
+        enum : size_t { keys = 10 };
+        vdr::cipher::fpe_pool pool( 3, 1 );
+        std::vector< std::unique_ptr< vdr::cipher::compact_fpe_feistel > > compacts;
+        for( size_t key = 0; key < keys; ++key )
+        {
+            compacts.emplace_back( new vdr::cipher::compact_fpe_feistel( pool, 1000000, "key " + std::to_string( key ) ) );
+        }
+
+        for( size_t pass = 0; pass < 3; ++pass )
+        {
+            for( size_t key = 0; key < keys; ++key )
+            {
+                vdr::cipher::fpe_feistel const full( 1000000, "key " + std::to_string( key ) );
+                uintmax_t const value = ( key * 1000 + pass ) % 1000000;
+                if( compacts[ key ]->encrypt( value ) != full.encrypt( value ) or pool.size() > pool.get_capacity() )
+                {
+                    std::cout << "error: compact engine " << key << " differs after eviction\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+
+        // Evicted engine stays valid while held.
+        auto const held = compacts[ 0 ]->expand();
+        for( size_t key = 1; key < keys; ++key )
+        {
+            compacts[ key ]->expand();
+        }
+        if( held->decrypt( held->encrypt( 42 ) ) != 42 or compacts[ 0 ]->expand() == held )
+        {
+            std::cout << "error: held engine mismatch\n" << std::flush;
+            return 1;
+        }
+
+        auto const stats = pool.get_stats();
+        std::cerr << "pool: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions\n";
+        std::cerr << "compact engine: " << sizeof( vdr::cipher::compact_fpe_feistel ) << " bytes\n";
+        if( stats.evictions == 0 or stats.misses <= keys )
+        {
+            std::cout << "error: unexpected pool counters\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        // Idle keys are not expanded when loaded, the hot engine stays in the pool.
+        vdr::cipher::fpe_pool pool( 2, 1 );
+        vdr::cipher::compact_fpe_feistel const hot( pool, 1000000, "hot key" );
+        uintmax_t const encrypted = hot.encrypt( 42 );
+
+        std::vector< std::unique_ptr< vdr::cipher::compact_fpe_feistel > > idle;
+        for( size_t key = 0; key < 100; ++key )
+        {
+            idle.emplace_back( new vdr::cipher::compact_fpe_feistel( pool, 1000000, "idle key " + std::to_string( key ) ) );
+        }
+
+        auto const loaded = pool.get_stats();
+        if( pool.size() != 1 or loaded.misses != 1 or hot.encrypt( 42 ) != encrypted or pool.get_stats().hits != loaded.hits + 1 )
+        {
+            std::cout << "error: loading idle keys expands them\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        // Parameters are checked at construction.
+        vdr::cipher::fpe_pool pool( 1 );
+        try
+        {
+            vdr::cipher::compact_fpe_feistel const compact( pool, 1000, "secret key", 0 );
+            std::cout << "error: zero target bits are accepted\n" << std::flush;
+            return 1;
+        }
+        catch( std::invalid_argument const & )
+        {
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_fpe_compact();
+}
@@ -6,6 +6,8 @@
 #include <cstdint>
 
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "vdr/byte.h"
 #include "vdr/cipher/fpe_feistel.h"
@@ -60,11 +62,966 @@ int test_cipher_fpe_feistel()
 }
 
 
+int test_cipher_fpe_feistel_known_answer()
+{
+    {
+        // Permutation must not change when F-function internals are optimized.
+        enum { domain_size = 17 };
+        static const uintmax_t expected[ domain_size ] = { 13, 4, 1, 7, 6, 14, 0, 8, 12, 9, 15, 11, 2, 3, 5, 16, 10 };
+
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key" );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( fpe_feistel.encrypt( i ) != expected[ i ] )
+            {
+                std::cout << "error: known answer mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        vdr::cipher::fpe_feistel fpe_feistel( uintmax_t(1) << 40, "secret key" );
+        if( fpe_feistel.encrypt( 1 ) != 828613801569 )
+        {
+            std::cout << "error: known answer mismatch for 40 bit domain\n" << std::flush;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_feistel_batch()
+{
+    for( uintmax_t const domain_size : { uintmax_t(17), uintmax_t(1000), uintmax_t(1) << 40 } )
+    {
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key" );
+
+        std::vector< uintmax_t > values;
+        for( uintmax_t i = 0; i < 1000; ++i )
+        {
+            values.push_back( ( i * 7919 ) % domain_size );
+        }
+
+        std::vector< uintmax_t > encrypted( values.size() );
+        fpe_feistel.encrypt( values, encrypted );
+
+        std::vector< uintmax_t > decrypted = encrypted;
+        fpe_feistel.decrypt( decrypted, decrypted );
+
+        for( size_t i = 0; i < values.size(); ++i )
+        {
+            if( encrypted[ i ] != fpe_feistel.encrypt( values[ i ] ) or decrypted[ i ] != values[ i ] )
+            {
+                std::cout << "error: batch mismatch in domain " << domain_size << ":\n"
+                    << values[ i ] << " -enc-> " << encrypted[ i ] << "\n"
+                    << encrypted[ i ] << " -dec-> " << decrypted[ i ] << "\n"
+                    << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_feistel_backends()
+{
+    {
+        // Backend must not change permutation.
+        enum { domain_size = 1000 };
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key" );
+        vdr::cipher::fpe_feistel_evp fpe_feistel_evp( domain_size, "secret key" );
+        vdr::cipher::fpe_feistel_bitsliced fpe_feistel_bitsliced( domain_size, "secret key" );
+        vdr::cipher::fpe_feistel_tabulated fpe_feistel_tabulated( domain_size, "secret key" );
+
+        std::vector< uintmax_t > values( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            values[ i ] = i;
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        fpe_feistel_evp.encrypt( values, encrypted );
+        std::vector< uintmax_t > bitsliced_encrypted( values.size() );
+        fpe_feistel_bitsliced.encrypt( values, bitsliced_encrypted );
+        std::vector< uintmax_t > tabulated_encrypted( values.size() );
+        fpe_feistel_tabulated.encrypt( values, tabulated_encrypted );
+
+        // 10 domain bits: 40 rounds of 2^9 bit tables.
+        size_t const table_bytes = fpe_feistel_tabulated.get_f_function().get_table_bytes();
+        std::cerr << "tabulated F-function: " << table_bytes << " bytes\n";
+        if( table_bytes != 40 * 512 / 8 or table_bytes != vdr::cipher::tabulated_thorp_shuffle::table_bytes( domain_size ) )
+        {
+            std::cout << "error: unexpected tabulated F-function size " << table_bytes << "\n" << std::flush;
+            return 1;
+        }
+
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( encrypted[ i ] != fpe_feistel.encrypt( i ) or fpe_feistel_evp.decrypt( encrypted[ i ] ) != i )
+            {
+                std::cout << "error: evp backend mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+            if( bitsliced_encrypted[ i ] != encrypted[ i ] )
+            {
+                std::cout << "error: bitsliced backend mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+            if( tabulated_encrypted[ i ] != encrypted[ i ] or fpe_feistel_tabulated.encrypt( i ) != encrypted[ i ] or fpe_feistel_tabulated.decrypt( encrypted[ i ] ) != i )
+            {
+                std::cout << "error: tabulated F-function mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_feistel_reverse_cycle_walking()
+{
+    for( uintmax_t const domain_size : { uintmax_t(2), uintmax_t(17), uintmax_t(1000), ( uintmax_t(1) << 16 ) + 1 } )
+    {
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key", vdr::cipher::reverse_cycle_walking );
+
+        std::vector< uintmax_t > values( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            values[ i ] = i;
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        fpe_feistel.encrypt( values, encrypted );
+
+        std::vector< bool > seen( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( encrypted[ i ] >= domain_size or seen[ encrypted[ i ] ] )
+            {
+                std::cout << "error: not a permutation in domain " << domain_size << " at " << i << " -enc-> " << encrypted[ i ] << "\n" << std::flush;
+                return 1;
+            }
+            seen[ encrypted[ i ] ] = true;
+        }
+
+        std::vector< uintmax_t > decrypted = encrypted;
+        fpe_feistel.decrypt( decrypted, decrypted );
+        for( uintmax_t i = 0; i < domain_size; i += 1 + domain_size / 1000 )
+        {
+            if( encrypted[ i ] != fpe_feistel.encrypt( i ) or fpe_feistel.decrypt( encrypted[ i ] ) != i or decrypted[ i ] != i )
+            {
+                std::cout << "error: reverse cycle walking mismatch in domain " << domain_size << " for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        // Same key in the other mode is a different permutation.
+        enum { domain_size = 1000 };
+        vdr::cipher::fpe_feistel cycle( domain_size, "secret key" );
+        vdr::cipher::fpe_feistel reverse( domain_size, "secret key", vdr::cipher::reverse_cycle_walking );
+
+        size_t same = 0;
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            same += ( cycle.encrypt( i ) == reverse.encrypt( i ) );
+        }
+        std::cerr << "reverse cycle walking: " << same << " of " << domain_size << " values match cycle walking\n";
+        if( same > domain_size / 10 )
+        {
+            std::cout << "error: reverse cycle walking looks like cycle walking\n" << std::flush;
+            return 1;
+        }
+
+        // Second pass of steps has rounds of its own, first pass keeps those of cycle walking.
+        auto const & f = reverse.get_f_function();
+        size_t const rounds = f.get_rounds();
+        if( f.get_round_passes() != vdr::cipher::fpe_feistel::reverse_walk_passes or cycle.get_f_function().get_round_passes() != 1 )
+        {
+            std::cout << "error: reverse cycle walking F-function has " << f.get_round_passes() << " passes of rounds\n" << std::flush;
+            return 1;
+        }
+        for( size_t round = 0; round < rounds; ++round )
+        {
+            size_t reused = 0;
+            for( uintmax_t source = 0; source < 256; ++source )
+            {
+                if( f( source, round ) != cycle.get_f_function()( source, round ) )
+                {
+                    std::cout << "error: first pass of F-function rounds differs at round " << round << "\n" << std::flush;
+                    return 1;
+                }
+                reused += ( f( source, round ) == f( source, round + rounds ) );
+            }
+            if( reused > 200 )
+            {
+                std::cout << "error: round " << round << " is reused by the second pass\n" << std::flush;
+                return 1;
+            }
+        }
+
+        // Every F-function serves both passes the same way.
+        vdr::cipher::fpe_feistel_tabulated tabulated( domain_size, "secret key", vdr::cipher::reverse_cycle_walking );
+        vdr::cipher::fpe_feistel_evp evp( domain_size, "secret key", vdr::cipher::reverse_cycle_walking );
+        vdr::cipher::fpe_feistel_amortised amortised( domain_size, "secret key", vdr::cipher::reverse_cycle_walking );
+        vdr::cipher::fpe_feistel_tabulated_amortised tabulated_amortised( domain_size, "secret key", vdr::cipher::reverse_cycle_walking );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( tabulated.encrypt( i ) != reverse.encrypt( i ) or evp.encrypt( i ) != reverse.encrypt( i )
+                or tabulated_amortised.encrypt( i ) != amortised.encrypt( i ) or amortised.decrypt( amortised.encrypt( i ) ) != i )
+            {
+                std::cout << "error: reverse cycle walking F-functions disagree at " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_feistel_target_bits()
+{
+    for( uintmax_t const domain_size : { uintmax_t(17), uintmax_t(1000), ( uintmax_t(1) << 16 ) + 1 } )
+    {
+        for( size_t const target_bits : { 1, 2, 4, 8 } )
+        {
+            vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key", vdr::cipher::cycle_walking, target_bits );
+
+            // Target bits are clamped to half of domain bits, rounds shrink with them.
+            size_t const domain_bits = fpe_feistel.get_f_function().get_source_bits() + fpe_feistel.get_f_function().get_target_bits();
+            size_t const expected_bits = std::min< size_t >( target_bits, domain_bits / 2 );
+            if( fpe_feistel.get_f_function().get_target_bits() != expected_bits
+                or fpe_feistel.get_rounds() != ( domain_bits + expected_bits - 1 ) / expected_bits * 4 )
+            {
+                std::cout << "error: unexpected round policy for " << target_bits << " target bits in domain " << domain_size << "\n" << std::flush;
+                return 1;
+            }
+
+            std::vector< uintmax_t > values( domain_size );
+            for( uintmax_t i = 0; i < domain_size; ++i )
+            {
+                values[ i ] = i;
+            }
+            std::vector< uintmax_t > encrypted( values.size() );
+            fpe_feistel.encrypt( values, encrypted );
+
+            std::vector< bool > seen( domain_size );
+            for( uintmax_t i = 0; i < domain_size; ++i )
+            {
+                if( encrypted[ i ] >= domain_size or seen[ encrypted[ i ] ] )
+                {
+                    std::cout << "error: not a permutation with " << target_bits << " target bits in domain " << domain_size << " at " << i << "\n" << std::flush;
+                    return 1;
+                }
+                seen[ encrypted[ i ] ] = true;
+            }
+
+            std::vector< uintmax_t > decrypted = encrypted;
+            fpe_feistel.decrypt( decrypted, decrypted );
+            for( uintmax_t i = 0; i < domain_size; i += 1 + domain_size / 1000 )
+            {
+                if( encrypted[ i ] != fpe_feistel.encrypt( i ) or fpe_feistel.decrypt( encrypted[ i ] ) != i or decrypted[ i ] != i )
+                {
+                    std::cout << "error: mismatch with " << target_bits << " target bits in domain " << domain_size << " for " << i << "\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    {
+        // Large domain: 40 bits in 8 bit steps is 20 rounds instead of 160.
+        vdr::cipher::fpe_feistel fpe_feistel( uintmax_t(1) << 40, "secret key", vdr::cipher::cycle_walking, 8 );
+        std::cerr << "8 target bits of 40 domain bits: " << fpe_feistel.get_rounds() << " rounds\n";
+        if( fpe_feistel.get_rounds() != 20 )
+        {
+            std::cout << "error: unexpected rounds " << fpe_feistel.get_rounds() << "\n" << std::flush;
+            return 1;
+        }
+        for( uintmax_t i = 0; i < 1000; ++i )
+        {
+            uintmax_t const value = i * 1099511603;
+            if( fpe_feistel.decrypt( fpe_feistel.encrypt( value ) ) != value )
+            {
+                std::cout << "error: roundtrip mismatch for " << value << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    try
+    {
+        vdr::cipher::fpe_feistel fpe_feistel( 1000, "secret key", vdr::cipher::cycle_walking, 0 );
+        std::cout << "error: zero target bits are accepted\n" << std::flush;
+        return 1;
+    }
+    catch( std::invalid_argument const & )
+    {
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_feistel_amortised()
+{
+    for( size_t const target_bits : { 1, 4 } )
+    {
+        enum { domain_size = 1000 };
+        vdr::cipher::fpe_feistel_amortised fpe_feistel_amortised( domain_size, "secret key", vdr::cipher::cycle_walking, target_bits );
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key", vdr::cipher::cycle_walking, target_bits );
+
+        std::vector< uintmax_t > values( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            values[ i ] = i;
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        fpe_feistel_amortised.encrypt( values, encrypted );
+
+        std::vector< bool > seen( domain_size );
+        size_t same = 0;
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( encrypted[ i ] >= domain_size or seen[ encrypted[ i ] ] )
+            {
+                std::cout << "error: amortised F-function is not a permutation at " << i << "\n" << std::flush;
+                return 1;
+            }
+            seen[ encrypted[ i ] ] = true;
+            if( encrypted[ i ] != fpe_feistel_amortised.encrypt( i ) or fpe_feistel_amortised.decrypt( encrypted[ i ] ) != i )
+            {
+                std::cout << "error: amortised F-function mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+            same += ( encrypted[ i ] == fpe_feistel.encrypt( i ) );
+        }
+        if( same > domain_size / 10 )
+        {
+            std::cout << "error: amortised F-function looks like thorp shuffle\n" << std::flush;
+            return 1;
+        }
+
+        if( target_bits == 1 )
+        {
+            // 40 rounds fit into one block, tables are built from one block per source.
+            vdr::cipher::fpe_feistel_tabulated_amortised fpe_feistel_tabulated( domain_size, "secret key" );
+            for( uintmax_t i = 0; i < domain_size; ++i )
+            {
+                if( fpe_feistel_tabulated.encrypt( i ) != encrypted[ i ] or fpe_feistel_tabulated.decrypt( encrypted[ i ] ) != i )
+                {
+                    std::cout << "error: tabulated amortised F-function mismatch for " << i << "\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    {
+        // Calls with a memo reuse blocks only while source and group stay the same.
+        vdr::cipher::amortised_thorp_shuffle const amortised( 1 << 20, "secret key", 4 );
+        vdr::cipher::amortised_thorp_shuffle::memo_t memo;
+        std::vector< uintmax_t > sources( 100 );
+        std::vector< uintmax_t > targets( sources.size() );
+        std::vector< uintmax_t > expected( sources.size() );
+        for( size_t round = 0; round < amortised.get_rounds(); ++round )
+        {
+            for( size_t i = 0; i < sources.size(); ++i )
+            {
+                sources[ i ] = ( i * 7919 + ( round / 3 ) * ( i % 5 ) ) % ( 1 << 16 );
+            }
+            amortised( sources, round, targets, memo );
+            amortised( sources, round, expected );
+            for( size_t i = 0; i < sources.size(); ++i )
+            {
+                if( targets[ i ] != expected[ i ] or expected[ i ] != amortised( sources[ i ], round ) )
+                {
+                    std::cout << "error: amortised F-function memo mismatch at round " << round << ", position " << i << "\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    for( auto const & bad : { std::make_pair( uintmax_t(1000), size_t(0) ), std::make_pair( uintmax_t(0), size_t(1) ), std::make_pair( uintmax_t(1), size_t(1) ) } )
+    {
+        try
+        {
+            vdr::cipher::amortised_thorp_shuffle const amortised( bad.first, "secret key", bad.second );
+            std::cout << "error: amortised F-function accepts domain " << bad.first << " with " << bad.second << " target bits\n" << std::flush;
+            return 1;
+        }
+        catch( std::invalid_argument const & )
+        {
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_feistel_wide()
+{
+    typedef unsigned __int128 uint128;
+    typedef vdr::cipher::basic_fpe_feistel< vdr::cipher::basic_thorp_shuffle< vdr::cipher::aes128, vdr::wide_uint< 3 > > > fpe_feistel192;
+
+    {
+        // Values below 2^64 are packed into the same block bytes, so narrow domains keep their permutation.
+        enum { domain_size = 1000 };
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key" );
+        vdr::cipher::fpe_feistel128 fpe_feistel128( domain_size, "secret key" );
+        vdr::cipher::fpe_feistel_wide fpe_feistel_wide( domain_size, "secret key" );
+        fpe_feistel192 fpe_feistel192( domain_size, "secret key" );
+
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            uintmax_t const encrypted = fpe_feistel.encrypt( i );
+            if( fpe_feistel128.encrypt( i ) != encrypted
+                or fpe_feistel_wide.encrypt( i ) != vdr::wide_uint< 2 >( encrypted )
+                or fpe_feistel192.encrypt( i ) != vdr::wide_uint< 3 >( encrypted ) )
+            {
+                std::cout << "error: wide value type changes permutation at " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        // UUID sized and 96 bit domains, one F-function call per round.
+        for( uint128 const domain_size : { ~uint128(0), ( uint128(1) << 96 ) + 12345 } )
+        {
+            vdr::cipher::fpe_feistel128 fpe_feistel128( domain_size, "secret key", vdr::cipher::cycle_walking, 8 );
+            vdr::cipher::fpe_feistel_wide fpe_feistel_wide( vdr::wide_uint< 2 >( uint64_t( domain_size ) ) | ( vdr::wide_uint< 2 >( uint64_t( domain_size >> 64 ) ) << 64 ), "secret key", vdr::cipher::cycle_walking, 8 );
+
+            std::vector< uint128 > values;
+            for( uint128 i = 0; i < 200; ++i )
+            {
+                values.push_back( ( i * ( ( uint128(0x9e3779b97f4a7c15) << 64 ) | 0xf39cc0605cedc835 ) ) % domain_size );
+            }
+            std::vector< uint128 > encrypted( values.size() );
+            fpe_feistel128.encrypt( values, encrypted );
+            std::vector< uint128 > decrypted = encrypted;
+            fpe_feistel128.decrypt( decrypted, decrypted );
+
+            for( size_t i = 0; i < values.size(); ++i )
+            {
+                vdr::wide_uint< 2 > const wide_value = vdr::wide_uint< 2 >( uint64_t( values[ i ] ) ) | ( vdr::wide_uint< 2 >( uint64_t( values[ i ] >> 64 ) ) << 64 );
+                vdr::wide_uint< 2 > const wide_encrypted = fpe_feistel_wide.encrypt( wide_value );
+                if( encrypted[ i ] >= domain_size or decrypted[ i ] != values[ i ] or fpe_feistel128.encrypt( values[ i ] ) != encrypted[ i ]
+                    or wide_encrypted.limb( 0 ) != uint64_t( encrypted[ i ] ) or wide_encrypted.limb( 1 ) != uint64_t( encrypted[ i ] >> 64 )
+                    or fpe_feistel_wide.decrypt( wide_encrypted ) != wide_value )
+                {
+                    std::cout << "error: 128 bit domain mismatch at " << i << "\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    {
+        // 2^129 is the widest domain whose source still fits one block.
+        vdr::wide_uint< 3 > const domain_size = vdr::wide_uint< 3 >( 1 ) << 129;
+        fpe_feistel192 fpe( domain_size, "secret key", vdr::cipher::cycle_walking, 1 );
+        vdr::wide_uint< 3 > value = ( vdr::wide_uint< 3 >( 0x0123456789abcdef ) << 70 ) | vdr::wide_uint< 3 >( 42 );
+        if( fpe.get_f_function().get_source_bits() != 128 or fpe.decrypt( fpe.encrypt( value ) ) != value )
+        {
+            std::cout << "error: 129 bit domain mismatch\n" << std::flush;
+            return 1;
+        }
+
+        try
+        {
+            fpe_feistel192 too_wide( domain_size << 1, "secret key" );
+            std::cout << "error: 130 bit domain is accepted\n" << std::flush;
+            return 1;
+        }
+        catch( std::invalid_argument const & )
+        {
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_feistel_fixed()
+{
+    enum : uintmax_t { domain_size = 1000000000 };
+
+    for( auto const mode : { vdr::cipher::cycle_walking, vdr::cipher::reverse_cycle_walking } )
+    {
+        // Compile time domain must not change permutation.
+        vdr::cipher::fpe_feistel_fixed< domain_size > fixed( "secret key", mode );
+        vdr::cipher::fpe_feistel runtime( domain_size, "secret key", mode );
+
+        std::vector< uintmax_t > values;
+        for( uintmax_t i = 0; i < 1000; ++i )
+        {
+            values.push_back( ( i * 999999937 ) % domain_size );
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        fixed.encrypt( values, encrypted );
+        std::vector< uintmax_t > decrypted = encrypted;
+        fixed.decrypt( decrypted, decrypted );
+
+        for( size_t i = 0; i < values.size(); ++i )
+        {
+            if( encrypted[ i ] != runtime.encrypt( values[ i ] ) or fixed.encrypt( values[ i ] ) != encrypted[ i ]
+                or fixed.decrypt( encrypted[ i ] ) != values[ i ] or decrypted[ i ] != values[ i ] )
+            {
+                std::cout << "error: compile time domain mismatch for " << values[ i ] << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    static_assert( vdr::cipher::fpe_feistel_fixed< domain_size >::layout::rounds() == 120, "" );
+
+    try
+    {
+        vdr::cipher::fpe_feistel_fixed< domain_size > fixed( domain_size, "secret key", vdr::cipher::cycle_walking, 4 );
+        std::cout << "error: F-function which does not match compile time domain is accepted\n" << std::flush;
+        return 1;
+    }
+    catch( std::invalid_argument const & )
+    {
+    }
+
+    return 0;
+}
+
+
+
+/// Every thread encrypts and decrypts all values through one const instance, scalar and batch,
+/// and must get what one thread got before.
+template< class FpeFeistel >
+int test_shared( FpeFeistel const & fpe_feistel, std::string const & name )
+{
+    enum : size_t { threads_count = 4 };
+
+    std::vector< uintmax_t > values;
+    for( uintmax_t i = 0; i < 2000; ++i )
+    {
+        values.push_back( ( i * 7919 ) % fpe_feistel.get_f_function().get_domain_size() );
+    }
+    std::vector< uintmax_t > expected( values.size() );
+    fpe_feistel.encrypt( values, expected );
+
+    std::vector< int > failures( threads_count, 0 );
+    std::vector< std::thread > threads;
+    for( size_t thread = 0; thread < threads_count; ++thread )
+    {
+        threads.emplace_back( [ &, thread ]()
+        {
+            std::vector< uintmax_t > encrypted( values.size() );
+            std::vector< uintmax_t > decrypted( values.size() );
+            for( size_t pass = 0; pass < 4; ++pass )
+            {
+                fpe_feistel.encrypt( values, encrypted );
+                fpe_feistel.decrypt( encrypted, decrypted );
+                for( size_t i = thread; i < values.size(); i += threads_count )
+                {
+                    if( encrypted[ i ] != expected[ i ] or decrypted[ i ] != values[ i ]
+                        or fpe_feistel.encrypt( values[ i ] ) != expected[ i ] or fpe_feistel.decrypt( expected[ i ] ) != values[ i ] )
+                    {
+                        ++failures[ thread ];
+                    }
+                }
+            }
+        } );
+    }
+    for( auto & thread : threads )
+    {
+        thread.join();
+    }
+
+    for( auto const failed : failures )
+    {
+        if( failed != 0 )
+        {
+            std::cout << "error: shared " << name << " mismatch in " << failed << " values\n" << std::flush;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int test_cipher_fpe_feistel_shared()
+{
+    enum : uintmax_t { domain_size = 1000000 };
+
+    vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key" );
+    vdr::cipher::fpe_feistel_evp const fpe_feistel_evp( domain_size, "secret key" );
+    vdr::cipher::fpe_feistel_amortised const fpe_feistel_amortised( domain_size, "secret key" );
+    vdr::cipher::fpe_feistel const fpe_feistel_reverse( domain_size, "secret key", vdr::cipher::reverse_cycle_walking );
+
+    return test_shared( fpe_feistel, "fpe_feistel" )
+        or test_shared( fpe_feistel_evp, "fpe_feistel_evp" )
+        or test_shared( fpe_feistel_amortised, "fpe_feistel_amortised" )
+        or test_shared( fpe_feistel_reverse, "reverse cycle walking fpe_feistel" );
+}
+
+
+
+
+int test_cipher_fpe_feistel_key()
+{
+    // Engines of one key over many domains, same permutations as built from the raw key.
+    vdr::cipher::fpe_key const key( "secret key" );
+    for( uintmax_t const domain_size : { uintmax_t(2), uintmax_t(3), uintmax_t(1000), uintmax_t(65536), uintmax_t(1000000), uintmax_t(0xfffffffffff) } )
+    {
+        for( vdr::cipher::feistel_walking const mode : { vdr::cipher::cycle_walking, vdr::cipher::reverse_cycle_walking } )
+        {
+            vdr::cipher::fpe_feistel const from_key( domain_size, key, mode );
+            vdr::cipher::fpe_feistel const from_raw_key( domain_size, "secret key", mode );
+
+            for( uintmax_t i = 0; i < std::min< uintmax_t >( domain_size, 500 ); ++i )
+            {
+                uintmax_t const value = i * 0x9e3779b97f4a7c15ull % domain_size;
+                uintmax_t const encrypted = from_key.encrypt( value );
+                if( encrypted != from_raw_key.encrypt( value ) or from_key.decrypt( encrypted ) != value )
+                {
+                    std::cout << "error: engine from fpe_key differs over domain " << domain_size << " at " << value << "\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    {
+        // Key keeps only the seed an engine derives from the raw key.
+        std::string const raw_key = "secret key";
+        if( key.get_reverse_walk_seed() != vdr::cipher::fpe_feistel::derive_reverse_walk_seed( gsl::as_bytes( gsl::as_span( raw_key ) ) )
+            or key.get_reverse_walk_seed() == vdr::cipher::fpe_key( "other key" ).get_reverse_walk_seed() )
+        {
+            std::cout << "error: fpe_key reverse walk seed mismatch\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        enum : uintmax_t { domain_size = 1000000 };
+        vdr::cipher::fpe_feistel const from_key( domain_size, key, vdr::cipher::cycle_walking, 8 );
+        vdr::cipher::fpe_feistel const from_raw_key( domain_size, "secret key", vdr::cipher::cycle_walking, 8 );
+        for( uintmax_t value = 0; value < 500; ++value )
+        {
+            if( from_key.encrypt( value ) != from_raw_key.encrypt( value ) )
+            {
+                std::cout << "error: engine from fpe_key differs with 8 target bits at " << value << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        typedef unsigned __int128 uint128;
+        uint128 const domain_size = ( uint128(1) << 96 ) + 12345;
+        vdr::cipher::basic_fpe_key< vdr::cipher::thorp_shuffle128 > const key128( "secret key" );
+        vdr::cipher::fpe_feistel128 const from_key( domain_size, key128 );
+        vdr::cipher::fpe_feistel128 const from_raw_key( domain_size, "secret key" );
+        for( uint128 i = 0; i < 100; ++i )
+        {
+            uint128 const value = i * ( ( uint128(0x9e3779b97f4a7c15) << 64 ) | 0xf39cc0605cedc835 ) % domain_size;
+            if( from_key.encrypt( value ) != from_raw_key.encrypt( value ) )
+            {
+                std::cout << "error: 128 bit engine from fpe_key differs at " << uint64_t( i ) << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        // Key of fewer rounds than a domain takes.
+        auto const short_key = std::make_shared< vdr::cipher::thorp_shuffle::key_type const >( "secret key", 3 );
+        try
+        {
+            vdr::cipher::thorp_shuffle thorp_shuffle( 1000000, short_key, 1 );
+            std::cout << "error: thorp shuffle key of 3 rounds is accepted\n" << std::flush;
+            return 1;
+        }
+        catch( std::invalid_argument const & )
+        {
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_feistel_tweak()
+{
+    enum : uintmax_t { domain_size = 1000000 };
+
+    for( vdr::cipher::feistel_walking const mode : { vdr::cipher::cycle_walking, vdr::cipher::reverse_cycle_walking } )
+    {
+        vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key", mode );
+
+        // Empty tweak is the untweaked permutation.
+        for( uintmax_t value = 0; value < 100; ++value )
+        {
+            if( fpe_feistel.encrypt( value, gsl::span< gsl::byte const >() ) != fpe_feistel.encrypt( value ) )
+            {
+                std::cout << "error: empty tweak changes permutation at " << value << "\n" << std::flush;
+                return 1;
+            }
+        }
+
+        // More tweaks than the cache holds, asked round robin, so every call misses and refills.
+        std::vector< std::string > tweaks;
+        for( size_t i = 0; i < vdr::cipher::thorp_shuffle::tweak_cache_entries + 3; ++i )
+        {
+            tweaks.push_back( "column " + std::to_string( i ) );
+        }
+        tweaks.push_back( std::string( 40, 'x' ) );
+        tweaks.push_back( std::string( 40, 'x' ) + '\0' );
+
+        std::vector< std::vector< uintmax_t > > encrypted( tweaks.size() );
+        for( uintmax_t value = 0; value < 200; ++value )
+        {
+            for( size_t t = 0; t < tweaks.size(); ++t )
+            {
+                auto const tweak = gsl::as_bytes( gsl::as_span( tweaks[ t ] ) );
+                uintmax_t const result = fpe_feistel.encrypt( value, tweak );
+                if( result >= domain_size or fpe_feistel.decrypt( result, tweak ) != value )
+                {
+                    std::cout << "error: tweak \"" << tweaks[ t ] << "\" does not decrypt at " << value << "\n" << std::flush;
+                    return 1;
+                }
+                encrypted[ t ].push_back( result );
+            }
+        }
+
+        for( size_t t = 0; t < tweaks.size(); ++t )
+        {
+            auto const tweak = gsl::as_bytes( gsl::as_span( tweaks[ t ] ) );
+
+            std::vector< uintmax_t > values( encrypted[ t ].size() );
+            for( size_t i = 0; i < values.size(); ++i )
+            {
+                values[ i ] = i;
+            }
+            std::vector< uintmax_t > batch( values.size() );
+            fpe_feistel.encrypt( values, batch, tweak );
+            if( batch != encrypted[ t ] )
+            {
+                std::cout << "error: batch and scalar differ with tweak \"" << tweaks[ t ] << "\"\n" << std::flush;
+                return 1;
+            }
+            fpe_feistel.decrypt( batch, batch, tweak );
+            if( batch != values )
+            {
+                std::cout << "error: batch decrypt fails with tweak \"" << tweaks[ t ] << "\"\n" << std::flush;
+                return 1;
+            }
+
+            for( size_t other = 0; other < t; ++other )
+            {
+                if( encrypted[ other ] == encrypted[ t ] )
+                {
+                    std::cout << "error: tweaks \"" << tweaks[ other ] << "\" and \"" << tweaks[ t ] << "\" give the same permutation\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    {
+        // Threads asking more tweaks than one instance caches replace each other's entries.
+        vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key" );
+        std::vector< std::string > tweaks;
+        for( size_t i = 0; i < 2 * vdr::cipher::thorp_shuffle::tweak_cache_entries; ++i )
+        {
+            tweaks.push_back( "column " + std::to_string( i ) );
+        }
+        std::vector< uintmax_t > expected;
+        for( auto const & tweak : tweaks )
+        {
+            expected.push_back( vdr::cipher::fpe_feistel( domain_size, "secret key" ).encrypt( 7, gsl::as_bytes( gsl::as_span( tweak ) ) ) );
+        }
+
+        std::vector< std::thread > threads;
+        std::vector< int > mismatches( 8, 0 );
+        for( size_t t = 0; t < mismatches.size(); ++t )
+        {
+            threads.emplace_back( [ &, t ]()
+            {
+                for( size_t i = 0; i < 500; ++i )
+                {
+                    size_t const k = ( i * ( t + 1 ) ) % tweaks.size();
+                    mismatches[ t ] |= fpe_feistel.encrypt( 7, gsl::as_bytes( gsl::as_span( tweaks[ k ] ) ) ) != expected[ k ];
+                }
+            } );
+        }
+        for( auto & thread : threads )
+        {
+            thread.join();
+        }
+        if( std::count( mismatches.begin(), mismatches.end(), 0 ) != int( mismatches.size() ) )
+        {
+            std::cout << "error: tweak cache mixes masks between threads\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        // Same tweak, different instances and keys do not share cached masks.
+        vdr::cipher::fpe_feistel const first( domain_size, "secret key" );
+        vdr::cipher::fpe_feistel const second( domain_size, "other key" );
+        vdr::cipher::fpe_key const key( "secret key" );
+        vdr::cipher::fpe_feistel const from_key( domain_size, key );
+        auto const tweak = gsl::as_bytes( gsl::ensure_z( "tenant" ) );
+        for( uintmax_t value = 0; value < 100; ++value )
+        {
+            uintmax_t const encrypted = first.encrypt( value, tweak );
+            if( second.decrypt( second.encrypt( value, tweak ), tweak ) != value or from_key.encrypt( value, tweak ) != encrypted )
+            {
+                std::cout << "error: tweak masks mixed between instances at " << value << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+template< class FpeFeistel >
+int test_same_permutation( FpeFeistel const & fpe_feistel, FpeFeistel const & fresh, std::string const & name )
+{
+    auto const tweak = gsl::as_bytes( gsl::ensure_z( "tenant" ) );
+    uintmax_t const domain_size = fresh.get_f_function().get_domain_size();
+    for( uintmax_t i = 0; i < 300; ++i )
+    {
+        uintmax_t const value = i * 0x9e3779b97f4a7c15ull % domain_size;
+        if( fpe_feistel.encrypt( value ) != fresh.encrypt( value ) or fpe_feistel.encrypt( value, tweak ) != fresh.encrypt( value, tweak ) )
+        {
+            std::cout << "error: " << name << " differs from a new engine at " << value << "\n" << std::flush;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int test_cipher_fpe_feistel_rekey()
+{
+    auto const raw_key = []( std::string const & key ) { return gsl::as_bytes( gsl::as_span( key ) ); };
+    std::string const first_key = "secret key";
+    std::string const second_key = "other key";
+    auto const tweak = gsl::as_bytes( gsl::ensure_z( "tenant" ) );
+
+    for( vdr::cipher::feistel_walking const mode : { vdr::cipher::cycle_walking, vdr::cipher::reverse_cycle_walking } )
+    {
+        vdr::cipher::fpe_feistel fpe_feistel( 1000000, first_key, mode );
+        vdr::cipher::fpe_feistel const copy = fpe_feistel;
+        // Tweak masks of the old key are cached by this instance now.
+        fpe_feistel.encrypt( 1, tweak );
+
+        fpe_feistel.rekey( raw_key( second_key ) );
+        if( test_same_permutation( fpe_feistel, vdr::cipher::fpe_feistel( 1000000, second_key, mode ), "rekeyed engine" )
+            or test_same_permutation( copy, vdr::cipher::fpe_feistel( 1000000, first_key, mode ), "copy of rekeyed engine" ) )
+        {
+            return 1;
+        }
+
+        fpe_feistel.rekey( raw_key( first_key ) );
+        if( test_same_permutation( fpe_feistel, copy, "engine keyed back" ) )
+        {
+            return 1;
+        }
+    }
+
+    {
+        // Smaller and larger domains, the larger one takes more masks than the key has.
+        vdr::cipher::fpe_feistel fpe_feistel( 1000, first_key, vdr::cipher::cycle_walking, 8 );
+        for( uintmax_t const domain_size : { uintmax_t(100), uintmax_t(1000000000), uintmax_t(1000000), uintmax_t(0xfffffffffff) } )
+        {
+            fpe_feistel.encrypt( 1, tweak );
+            fpe_feistel.set_domain( domain_size );
+            if( fpe_feistel.get_rounds() != vdr::cipher::fpe_feistel( domain_size, first_key, vdr::cipher::cycle_walking, 8 ).get_rounds()
+                or test_same_permutation( fpe_feistel, vdr::cipher::fpe_feistel( domain_size, first_key, vdr::cipher::cycle_walking, 8 ), "engine of new domain" ) )
+            {
+                return 1;
+            }
+        }
+
+        vdr::cipher::fpe_key const key( first_key );
+        vdr::cipher::fpe_feistel from_key( 1000, key );
+        from_key.set_domain( 1000000000 );
+        if( test_same_permutation( from_key, vdr::cipher::fpe_feistel( 1000000000, first_key ), "engine of fpe_key over new domain" ) )
+        {
+            return 1;
+        }
+    }
+
+    try
+    {
+        // Shared key of a 1000 value domain does not cover a larger one.
+        auto const short_key = std::make_shared< vdr::cipher::thorp_shuffle::key_type const >( first_key, vdr::cipher::thorp_shuffle::key_rounds( 1000, 1 ) );
+        vdr::cipher::thorp_shuffle thorp_shuffle( 1000, short_key );
+        thorp_shuffle.set_domain( 1000000 );
+        std::cout << "error: shared key is extended\n" << std::flush;
+        return 1;
+    }
+    catch( std::invalid_argument const & )
+    {
+    }
+
+    try
+    {
+        vdr::cipher::fpe_feistel fpe_feistel( 1000, first_key, vdr::cipher::reverse_cycle_walking );
+        fpe_feistel.set_domain( 2000 );
+        std::cout << "error: reverse cycle walking domain is changed without raw key\n" << std::flush;
+        return 1;
+    }
+    catch( std::invalid_argument const & )
+    {
+    }
+
+    return 0;
+}
+
+
 
 
 int main( int ac, char *av[] )
 {
-    return test_cipher_fpe_feistel();
+    return test_cipher_fpe_feistel()
+        or test_cipher_fpe_feistel_known_answer()
+        or test_cipher_fpe_feistel_batch()
+        or test_cipher_fpe_feistel_backends()
+        or test_cipher_fpe_feistel_reverse_cycle_walking()
+        or test_cipher_fpe_feistel_target_bits()
+        or test_cipher_fpe_feistel_amortised()
+        or test_cipher_fpe_feistel_wide()
+        or test_cipher_fpe_feistel_fixed()
+        or test_cipher_fpe_feistel_shared()
+        or test_cipher_fpe_feistel_key()
+        or test_cipher_fpe_feistel_tweak()
+        or test_cipher_fpe_feistel_rekey();
 }
 
 
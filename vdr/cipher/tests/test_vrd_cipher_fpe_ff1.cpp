@@ -0,0 +1,222 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/ff1.h"
+
+
+std::vector< uint16_t > to_numerals( std::string const & digits );
+std::string to_digits( std::vector< uint16_t > const & numerals );
+
+
+int test_cipher_fpe_ff1_known_answer()
+{
+    // NIST SP 800-38G examples, FF1 samples 1, 2, 3, 4 and 7.
+    static const uint8_t key128[ 16 ] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+    };
+    static const uint8_t key192[ 24 ] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f,
+    };
+    static const uint8_t key256[ 32 ] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+        0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f, 0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+    };
+    static const uint8_t numeric_tweak[] = { 0x39, 0x38, 0x37, 0x36, 0x35, 0x34, 0x33, 0x32, 0x31, 0x30 };
+    static const uint8_t alphanumeric_tweak[] = { 0x37, 0x37, 0x37, 0x37, 0x70, 0x71, 0x72, 0x73, 0x37, 0x37, 0x37 };
+
+    auto check = [ & ]( auto & ff1, std::string const & plain, gsl::span< gsl::byte const > tweak, std::string const & expected )
+    {
+        std::vector< uint16_t > numerals = to_numerals( plain );
+        ff1.encrypt( numerals, tweak, numerals );
+        std::string const encrypted = to_digits( numerals );
+        ff1.decrypt( numerals, tweak, numerals );
+        std::string const decrypted = to_digits( numerals );
+
+        std::cerr << plain << " -enc-> " << encrypted << " -dec-> " << decrypted << "\n";
+        if( encrypted != expected or decrypted != plain )
+        {
+            std::cout << "error: known answer mismatch, expected " << expected << "\n" << std::flush;
+            return 1;
+        }
+        return 0;
+    };
+
+    {
+        vdr::cipher::fpe_ff1 ff1( 10, 10, gsl::as_bytes( gsl::as_span( key128 ) ) );
+        if( check( ff1, "0123456789", gsl::span< gsl::byte const >(), "2433477484" )
+            or check( ff1, "0123456789", gsl::as_bytes( gsl::as_span( numeric_tweak ) ), "6124200773" ) )
+        {
+            return 1;
+        }
+    }
+
+    {
+        vdr::cipher::fpe_ff1 ff1( 36, 19, gsl::as_bytes( gsl::as_span( key128 ) ) );
+        if( check( ff1, "0123456789abcdefghi", gsl::as_bytes( gsl::as_span( alphanumeric_tweak ) ), "a9tv40mll9kdu509eum" ) )
+        {
+            return 1;
+        }
+    }
+
+    {
+        vdr::cipher::basic_fpe_ff1< vdr::cipher::aes<192> > ff1( 10, 10, gsl::as_bytes( gsl::as_span( key192 ) ) );
+        if( check( ff1, "0123456789", gsl::span< gsl::byte const >(), "2830668132" ) )
+        {
+            return 1;
+        }
+    }
+
+    {
+        vdr::cipher::basic_fpe_ff1< vdr::cipher::aes<256> > ff1( 10, 10, gsl::as_bytes( gsl::as_span( key256 ) ) );
+        if( check( ff1, "0123456789", gsl::span< gsl::byte const >(), "6657667009" ) )
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_ff1_domain()
+{
+    {
+        // Cycle walking must keep the permutation inside a domain which is not a power of two.
+        enum { domain_size = 1000003 };
+        vdr::cipher::fpe_ff1 ff1( domain_size, "secret key" );
+
+        std::vector< uintmax_t > values( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            values[ i ] = i;
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        ff1.encrypt( values, encrypted );
+
+        std::vector< bool > seen( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( encrypted[ i ] >= domain_size or seen[ encrypted[ i ] ] )
+            {
+                std::cout << "error: not a permutation at " << i << " -enc-> " << encrypted[ i ] << "\n" << std::flush;
+                return 1;
+            }
+            seen[ encrypted[ i ] ] = true;
+        }
+
+        std::vector< uintmax_t > decrypted = encrypted;
+        ff1.decrypt( decrypted, decrypted );
+        for( uintmax_t i = 0; i < domain_size; i += 997 )
+        {
+            if( encrypted[ i ] != ff1.encrypt( i ) or ff1.decrypt( encrypted[ i ] ) != i or decrypted[ i ] != i )
+            {
+                std::cout << "error: batch mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        vdr::cipher::fpe_ff1 ff1( uintmax_t(1) << 40, "secret key" );
+        for( uintmax_t i = 0; i < 1000; ++i )
+        {
+            uintmax_t const value = i * 1099511;
+            if( ff1.decrypt( ff1.encrypt( value ) ) != value )
+            {
+                std::cout << "error: roundtrip mismatch for " << value << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        // Halves above 2^63, sums of round must not wrap around 64 bits.
+        static const uint8_t key[ 16 ] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+        for( size_t const length : { 79, 80 } )
+        {
+            vdr::cipher::fpe_ff1 ff1( 3, length, gsl::as_bytes( gsl::as_span( key ) ) );
+            for( size_t i = 0; i < 200; ++i )
+            {
+                std::vector< uint16_t > numerals( length );
+                for( size_t j = 0; j < length; ++j )
+                {
+                    numerals[ j ] = ( i * 7 + j * j * 13 + i * j ) % 3;
+                }
+                std::vector< uint16_t > results( length );
+                ff1.encrypt( numerals, gsl::span< gsl::byte const >(), results );
+                ff1.decrypt( results, gsl::span< gsl::byte const >(), results );
+                if( results != numerals )
+                {
+                    std::cout << "error: roundtrip mismatch at radix 3, length " << length << ", string " << i << "\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    {
+        bool thrown = false;
+        try
+        {
+            vdr::cipher::fpe_ff1 ff1( 1000, "secret key" );
+        }
+        catch( std::invalid_argument const & )
+        {
+            thrown = true;
+        }
+        if( not thrown )
+        {
+            std::cout << "error: domain below FF1 minimum was accepted\n" << std::flush;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_fpe_ff1_known_answer()
+        or test_cipher_fpe_ff1_domain();
+}
+
+
+std::vector< uint16_t > to_numerals( std::string const & digits )
+{
+    static const std::string alphabet = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    std::vector< uint16_t > result;
+    for( auto const digit : digits )
+    {
+        result.push_back( uint16_t( alphabet.find( digit ) ) );
+    }
+    return result;
+}
+
+
+
+std::string to_digits( std::vector< uint16_t > const & numerals )
+{
+    static const std::string alphabet = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    std::string result;
+    for( auto const numeral : numerals )
+    {
+        result += alphabet[ numeral ];
+    }
+    return result;
+}
@@ -0,0 +1,203 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/ff3_1.h"
+
+
+std::vector< uint16_t > to_numerals( std::string const & digits );
+std::string to_digits( std::vector< uint16_t > const & numerals );
+
+
+int test_cipher_fpe_ff3_1_known_answer()
+{
+    auto check = [ & ]( auto & ff3_1, std::string const & plain, gsl::span< gsl::byte const, 7 > tweak, std::string const & expected )
+    {
+        std::vector< uint16_t > numerals = to_numerals( plain );
+        ff3_1.encrypt( numerals, tweak, numerals );
+        std::string const encrypted = to_digits( numerals );
+        ff3_1.decrypt( numerals, tweak, numerals );
+        std::string const decrypted = to_digits( numerals );
+
+        std::cerr << plain << " -enc-> " << encrypted << " -dec-> " << decrypted << "\n";
+        if( encrypted != expected or decrypted != plain )
+        {
+            std::cout << "error: known answer mismatch, expected " << expected << "\n" << std::flush;
+            return 1;
+        }
+        return 0;
+    };
+
+    {
+        // NIST SP 800-38G FF3 sample 4. Zero 64 bit FF3 tweak splits exactly like zero 56 bit FF3-1 tweak.
+        static const uint8_t key[ 16 ] = {
+            0xef, 0x43, 0x59, 0xd8, 0xd5, 0x80, 0xaa, 0x4f, 0x7f, 0x03, 0x6d, 0x6f, 0x04, 0xfc, 0x6a, 0x94,
+        };
+        vdr::cipher::fpe_ff3_1 ff3_1( 10, 29, gsl::as_bytes( gsl::as_span( key ) ) );
+        if( check( ff3_1, "89012123456789000000789000000", ff3_1.get_empty_tweak(), "34695224821734535122613701434" ) )
+        {
+            return 1;
+        }
+    }
+
+    {
+        // FF3-1 vector with 56 bit tweak.
+        static const uint8_t key[ 16 ] = {
+            0x2d, 0xe7, 0x9d, 0x23, 0x2d, 0xf5, 0x58, 0x5d, 0x68, 0xce, 0x47, 0x88, 0x2a, 0xe2, 0x56, 0xd6,
+        };
+        static const uint8_t tweak[ 7 ] = { 0xcb, 0xd0, 0x92, 0x80, 0x97, 0x95, 0x64 };
+        vdr::cipher::fpe_ff3_1 ff3_1( 10, 10, gsl::as_bytes( gsl::as_span( key ) ) );
+        if( check( ff3_1, "3992520240", gsl::as_bytes( gsl::as_span( tweak ) ), "8901801106" ) )
+        {
+            return 1;
+        }
+
+        // Integer interface is NUM_radix of the same numeral string.
+        if( ff3_1.encrypt( 3992520240, gsl::as_bytes( gsl::as_span( tweak ) ) ) != 8901801106
+            or ff3_1.decrypt( 8901801106, gsl::as_bytes( gsl::as_span( tweak ) ) ) != 3992520240 )
+        {
+            std::cout << "error: integer known answer mismatch\n" << std::flush;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_ff3_1_domain()
+{
+    {
+        // Cycle walking must keep the permutation inside a domain which is not a power of two.
+        enum { domain_size = 1000003 };
+        vdr::cipher::fpe_ff3_1 ff3_1( domain_size, "secret key" );
+
+        std::vector< uintmax_t > values( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            values[ i ] = i;
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        ff3_1.encrypt( values, encrypted );
+
+        std::vector< bool > seen( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( encrypted[ i ] >= domain_size or seen[ encrypted[ i ] ] )
+            {
+                std::cout << "error: not a permutation at " << i << " -enc-> " << encrypted[ i ] << "\n" << std::flush;
+                return 1;
+            }
+            seen[ encrypted[ i ] ] = true;
+        }
+
+        std::vector< uintmax_t > decrypted = encrypted;
+        ff3_1.decrypt( decrypted, decrypted );
+        for( uintmax_t i = 0; i < domain_size; i += 997 )
+        {
+            if( encrypted[ i ] != ff3_1.encrypt( i ) or ff3_1.decrypt( encrypted[ i ] ) != i or decrypted[ i ] != i )
+            {
+                std::cout << "error: batch mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        // Decimal domain of 12 digits, tweak must change the permutation.
+        static const uint8_t key[ 16 ] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+        static const uint8_t tweak[ 7 ] = { 1, 2, 3, 4, 5, 6, 7 };
+        vdr::cipher::fpe_ff3_1 ff3_1( 10, 12, gsl::as_bytes( gsl::as_span( key ) ) );
+
+        size_t same = 0;
+        for( uintmax_t i = 0; i < 1000; ++i )
+        {
+            uintmax_t const value = i * 999999937;
+            uintmax_t const encrypted = ff3_1.encrypt( value, gsl::as_bytes( gsl::as_span( tweak ) ) );
+            if( encrypted >= ff3_1.get_domain_size() or ff3_1.decrypt( encrypted, gsl::as_bytes( gsl::as_span( tweak ) ) ) != value )
+            {
+                std::cout << "error: roundtrip mismatch for " << value << "\n" << std::flush;
+                return 1;
+            }
+            same += ( encrypted == ff3_1.encrypt( value ) );
+        }
+        if( same > 1 )
+        {
+            std::cout << "error: tweak does not change permutation\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        // Near the length limit halves exceed 2^63, sums of round must not wrap around 64 bits.
+        static const uint8_t key[ 16 ] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+        static const uint8_t tweak[ 7 ] = { 1, 2, 3, 4, 5, 6, 7 };
+        for( size_t const length : { 78, 79, 80 } )
+        {
+            vdr::cipher::fpe_ff3_1 ff3_1( 3, length, gsl::as_bytes( gsl::as_span( key ) ) );
+            for( size_t i = 0; i < 200; ++i )
+            {
+                std::vector< uint16_t > numerals( length );
+                for( size_t j = 0; j < length; ++j )
+                {
+                    numerals[ j ] = ( i * 7 + j * j * 13 + i * j ) % 3;
+                }
+                std::vector< uint16_t > results( length );
+                ff3_1.encrypt( numerals, gsl::as_bytes( gsl::as_span( tweak ) ), results );
+                ff3_1.decrypt( results, gsl::as_bytes( gsl::as_span( tweak ) ), results );
+                if( results != numerals )
+                {
+                    std::cout << "error: roundtrip mismatch at radix 3, length " << length << ", string " << i << "\n" << std::flush;
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_fpe_ff3_1_known_answer()
+        or test_cipher_fpe_ff3_1_domain();
+}
+
+
+std::vector< uint16_t > to_numerals( std::string const & digits )
+{
+    static const std::string alphabet = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    std::vector< uint16_t > result;
+    for( auto const digit : digits )
+    {
+        result.push_back( uint16_t( alphabet.find( digit ) ) );
+    }
+    return result;
+}
+
+
+
+std::string to_digits( std::vector< uint16_t > const & numerals )
+{
+    static const std::string alphabet = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    std::string result;
+    for( auto const numeral : numerals )
+    {
+        result += alphabet[ numeral ];
+    }
+    return result;
+}
@@ -0,0 +1,87 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/fpe_modular_feistel.h"
+
+
+int test_cipher_fpe_modular_feistel()
+{
+    for( uintmax_t const domain_size : { uintmax_t(4), uintmax_t(5), uintmax_t(7), uintmax_t(17), uintmax_t(1000), ( uintmax_t(1) << 16 ) + 1 } )
+    {
+        vdr::cipher::fpe_modular_feistel fpe( domain_size, "secret key" );
+
+        uintmax_t const radices_size = fpe.get_left_radix() * fpe.get_right_radix();
+        std::cerr << "domain " << domain_size << ": " << fpe.get_left_radix() << " x " << fpe.get_right_radix() << "\n";
+        if( radices_size < domain_size or radices_size - domain_size >= fpe.get_left_radix() or fpe.get_left_radix() > 4 * fpe.get_right_radix() + 4 )
+        {
+            std::cout << "error: radices are not tight for domain " << domain_size << "\n" << std::flush;
+            return 1;
+        }
+        if( fpe.get_right_radix() < 2 )
+        {
+            // Odd rounds would add nothing modulo 1, leaving a keyed rotation.
+            std::cout << "error: degenerate right radix for domain " << domain_size << "\n" << std::flush;
+            return 1;
+        }
+
+        std::vector< uintmax_t > values( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            values[ i ] = i;
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        fpe.encrypt( values, encrypted );
+        std::vector< uintmax_t > decrypted = encrypted;
+        fpe.decrypt( decrypted, decrypted );
+
+        std::vector< bool > seen( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( encrypted[ i ] >= domain_size or seen[ encrypted[ i ] ] )
+            {
+                std::cout << "error: not a permutation at " << i << " -enc-> " << encrypted[ i ] << "\n" << std::flush;
+                return 1;
+            }
+            seen[ encrypted[ i ] ] = true;
+
+            if( encrypted[ i ] != fpe.encrypt( i ) or fpe.decrypt( encrypted[ i ] ) != i or decrypted[ i ] != i )
+            {
+                std::cout << "error: batch mismatch in domain " << domain_size << " for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        uintmax_t const domain_size = ( uintmax_t(1) << 40 ) + 1;
+        vdr::cipher::fpe_modular_feistel fpe( domain_size, "secret key", 12 );
+        for( uintmax_t i = 0; i < 1000; ++i )
+        {
+            uintmax_t const value = i * 1099511627;
+            uintmax_t const encrypted = fpe.encrypt( value );
+            if( encrypted >= domain_size or fpe.decrypt( encrypted ) != value )
+            {
+                std::cout << "error: roundtrip mismatch for " << value << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_fpe_modular_feistel();
+}
@@ -0,0 +1,94 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/fpe_feistel.h"
+#include "vdr/cipher/fpe_range.h"
+
+
+int test_cipher_fpe_range()
+{
+    // Range must be the engine's permutation, whatever the result width, offset and thread count.
+    for( auto const & range : { std::make_tuple( uintmax_t(17), uintmax_t(0), size_t(1) ), std::make_tuple( uintmax_t(100000), uintmax_t(0), size_t(3) ), std::make_tuple( uintmax_t(1) << 40, uintmax_t(12345), size_t(0) ) } )
+    {
+        uintmax_t const domain_size = std::get< 0 >( range );
+        uintmax_t const first = std::get< 1 >( range );
+        size_t const threads = std::get< 2 >( range );
+        size_t const count = std::min< uintmax_t >( domain_size - first, 50000 );
+
+        vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key" );
+
+        std::vector< uintmax_t > encrypted( count );
+        vdr::cipher::encrypt_range( fpe_feistel, first, gsl::as_span( encrypted ), threads );
+        std::vector< uintmax_t > decrypted( count );
+        vdr::cipher::decrypt_range( fpe_feistel, first, gsl::as_span( decrypted ), threads );
+
+        for( size_t i = 0; i < count; ++i )
+        {
+            if( encrypted[ i ] != fpe_feistel.encrypt( first + i ) or decrypted[ i ] != fpe_feistel.decrypt( first + i ) )
+            {
+                std::cout << "error: range mismatch in domain " << domain_size << " for " << first + i << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    {
+        // Narrow results: a shuffled id map of a whole domain.
+        enum : uintmax_t { domain_size = 70000 };
+        vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key" );
+
+        std::vector< uint32_t > id_map( domain_size );
+        vdr::cipher::encrypt_range( fpe_feistel, 0, gsl::as_span( id_map ), 4 );
+
+        std::vector< bool > seen( domain_size, false );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( id_map[ i ] != fpe_feistel.encrypt( i ) or seen[ id_map[ i ] ] )
+            {
+                std::cout << "error: id map mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+            seen[ id_map[ i ] ] = true;
+        }
+    }
+
+    {
+        // Out of domain value in one chunk stops the range and gets to the caller.
+        enum : uintmax_t { domain_size = 100000 };
+        vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key" );
+
+        std::vector< uintmax_t > encrypted( 10000 );
+        bool thrown = false;
+        try
+        {
+            vdr::cipher::encrypt_range( fpe_feistel, domain_size - 5000, gsl::as_span( encrypted ), 4 );
+        }
+        catch( std::overflow_error const & )
+        {
+            thrown = true;
+        }
+        if( not thrown )
+        {
+            std::cout << "error: range out of domain was accepted\n" << std::flush;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_fpe_range();
+}
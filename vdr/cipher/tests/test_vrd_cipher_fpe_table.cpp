@@ -0,0 +1,138 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/fpe_table.h"
+#include "vdr/cipher/ff1.h"
+#include "vdr/cipher/ff3_1.h"
+#include "vdr/cipher/fpe_modular_feistel.h"
+#include "vdr/cipher/swap_or_not.h"
+
+
+int test_cipher_fpe_table()
+{
+    // Table must be the same permutation as its engine, whatever the entry width and thread count.
+    for( auto const & domain : { std::make_tuple( uintmax_t(17), size_t(1), size_t(1) ), std::make_tuple( uintmax_t(1000), size_t(2), size_t(3) ), std::make_tuple( uintmax_t(70000), size_t(4), size_t(0) ) } )
+    {
+        uintmax_t const domain_size = std::get< 0 >( domain );
+        size_t const value_bytes = std::get< 1 >( domain );
+        size_t const threads = std::get< 2 >( domain );
+
+        vdr::cipher::fpe_feistel fpe_feistel( domain_size, "secret key" );
+        vdr::cipher::fpe_table fpe_table( domain_size, "secret key", threads );
+
+        std::cerr << "domain " << domain_size << ": " << fpe_table.get_value_bytes() << " byte entries, " << fpe_table.get_table_bytes() << " bytes\n";
+        if( fpe_table.get_value_bytes() != value_bytes or fpe_table.get_table_bytes() != 2 * domain_size * value_bytes )
+        {
+            std::cout << "error: unexpected table width for domain " << domain_size << "\n" << std::flush;
+            return 1;
+        }
+
+        std::vector< uintmax_t > values;
+        for( uintmax_t i = 0; i < domain_size; i += 1 + domain_size / 1000 )
+        {
+            values.push_back( i );
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        fpe_feistel.encrypt( values, encrypted );
+
+        std::vector< uintmax_t > table_encrypted( values.size() );
+        fpe_table.encrypt( values, table_encrypted );
+        std::vector< uintmax_t > table_decrypted( values.size() );
+        fpe_table.decrypt( table_encrypted, table_decrypted );
+
+        for( size_t i = 0; i < values.size(); ++i )
+        {
+            if( table_encrypted[ i ] != encrypted[ i ] or fpe_table.encrypt( values[ i ] ) != encrypted[ i ]
+                or table_decrypted[ i ] != values[ i ] or fpe_table.decrypt( encrypted[ i ] ) != values[ i ] )
+            {
+                std::cout << "error: table mismatch in domain " << domain_size << ":\n"
+                    << values[ i ] << " -enc-> " << table_encrypted[ i ] << " (engine " << encrypted[ i ] << ")\n"
+                    << table_encrypted[ i ] << " -dec-> " << table_decrypted[ i ] << "\n"
+                    << std::flush;
+                return 1;
+            }
+        }
+
+        bool thrown = false;
+        try
+        {
+            fpe_table.encrypt( domain_size );
+        }
+        catch( std::overflow_error const & )
+        {
+            thrown = true;
+        }
+        if( not thrown )
+        {
+            std::cout << "error: value out of domain was accepted\n" << std::flush;
+            return 1;
+        }
+    }
+
+    for( uintmax_t const domain_size : { uintmax_t(0), uintmax_t( vdr::cipher::fpe_table::max_domain_size ) + 1, uintmax_t(1) << 32 } )
+    {
+        bool thrown = false;
+        try
+        {
+            vdr::cipher::fpe_table const fpe_table( domain_size, "secret key" );
+        }
+        catch( std::invalid_argument const & )
+        {
+            thrown = true;
+        }
+        if( not thrown )
+        {
+            std::cout << "error: table of domain " << domain_size << " was accepted\n" << std::flush;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int test_cipher_fpe_table_engines()
+{
+    // Any engine with const batch `encrypt` builds a table of its own permutation.
+    auto check = [ & ]( auto const & engine, auto const & table, std::string const & name )
+    {
+        uintmax_t const domain_size = engine.get_domain_size();
+        for( uintmax_t i = 0; i < domain_size; i += 1 + domain_size / 1000 )
+        {
+            uintmax_t const encrypted = engine.encrypt( i );
+            if( table.encrypt( i ) != encrypted or table.decrypt( encrypted ) != i )
+            {
+                std::cout << "error: " << name << " table mismatch for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+        return 0;
+    };
+
+    enum : uintmax_t { small_domain_size = 1000 };
+    enum : uintmax_t { ff_domain_size = 1000003 };
+
+    return check( vdr::cipher::swap_or_not( small_domain_size, "secret key" ), vdr::cipher::basic_fpe_table< vdr::cipher::swap_or_not >( small_domain_size, "secret key", 2 ), "swap_or_not" )
+        or check( vdr::cipher::fpe_modular_feistel( small_domain_size, "secret key" ), vdr::cipher::basic_fpe_table< vdr::cipher::fpe_modular_feistel >( small_domain_size, "secret key", 2 ), "fpe_modular_feistel" )
+        or check( vdr::cipher::fpe_ff1( ff_domain_size, "secret key" ), vdr::cipher::basic_fpe_table< vdr::cipher::fpe_ff1 >( ff_domain_size, "secret key" ), "fpe_ff1" )
+        or check( vdr::cipher::fpe_ff3_1( ff_domain_size, "secret key" ), vdr::cipher::basic_fpe_table< vdr::cipher::fpe_ff3_1 >( ff_domain_size, "secret key" ), "fpe_ff3_1" );
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_fpe_table()
+        or test_cipher_fpe_table_engines();
+}
@@ -0,0 +1,146 @@
+#include <iostream>
+#include <iomanip>
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/fpe_feistel.h"
+#include "vdr/cipher/permutation_view.h"
+
+
+int test_cipher_permutation_view()
+{
+    enum : uintmax_t { domain_size = 1000 };
+    vdr::cipher::fpe_feistel const fpe_feistel( domain_size, "secret key" );
+    vdr::cipher::permutation_view const view( fpe_feistel, domain_size );
+
+    {
+        // Forward walk is the permutation, in position order.
+        std::vector< uintmax_t > walked( view.begin(), view.end() );
+        if( walked.size() != domain_size or uintmax_t( std::distance( view.begin(), view.end() ) ) != view.size() )
+        {
+            std::cout << "error: view walk has " << walked.size() << " elements\n" << std::flush;
+            return 1;
+        }
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( walked[ i ] != fpe_feistel.encrypt( i ) or view[ i ] != walked[ i ] )
+            {
+                std::cout << "error: view mismatch at " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+
+        std::vector< uintmax_t > sorted = walked;
+        std::sort( sorted.begin(), sorted.end() );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( sorted[ i ] != i )
+            {
+                std::cout << "error: view is not a permutation\n" << std::flush;
+                return 1;
+            }
+        }
+
+        // Backward walk, seeks and shards give the same elements.
+        auto it = view.end();
+        for( uintmax_t i = domain_size; i > 0; --i )
+        {
+            if( *--it != walked[ i - 1 ] )
+            {
+                std::cout << "error: backward view mismatch at " << i - 1 << "\n" << std::flush;
+                return 1;
+            }
+        }
+        for( uintmax_t i = 0; i < domain_size; i += 37 )
+        {
+            auto const seeked = view.begin() + i;
+            if( seeked.position() != i or *seeked != walked[ i ] or view.begin()[ i ] != walked[ i ] or *( view.end() - ( domain_size - i ) ) != walked[ i ] )
+            {
+                std::cout << "error: seek mismatch at " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+
+        enum : uintmax_t { shards = 7 };
+        std::vector< uintmax_t > sharded;
+        for( uintmax_t shard = 0; shard < shards; ++shard )
+        {
+            sharded.insert( sharded.end(), view.begin() + domain_size * shard / shards, view.begin() + domain_size * ( shard + 1 ) / shards );
+        }
+        if( sharded != walked )
+        {
+            std::cout << "error: sharded walk mismatch\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        // Compile time domain engines and views longer than the window of one batch.
+        enum : uintmax_t { fixed_domain_size = 1000000 };
+        vdr::cipher::fpe_feistel_fixed< fixed_domain_size > const fixed( "secret key" );
+        vdr::cipher::basic_permutation_view< vdr::cipher::fpe_feistel_fixed< fixed_domain_size > > const fixed_view( fixed, fixed_domain_size );
+
+        uintmax_t i = fixed_domain_size / 2;
+        for( auto it = fixed_view.begin() + i; it != fixed_view.begin() + i + 1000; ++it )
+        {
+            if( *it != fixed.encrypt( it.position() ) )
+            {
+                std::cout << "error: fixed view mismatch at " << it.position() << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    for( auto const position : { uintmax_t( domain_size ), uintmax_t( domain_size ) * 2 } )
+    {
+        bool thrown = false;
+        try
+        {
+            view[ position ];
+        }
+        catch( std::out_of_range const & )
+        {
+            thrown = true;
+        }
+        if( not thrown )
+        {
+            std::cout << "error: position out of view was accepted\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        vdr::cipher::fpe_feistel const small( 100, "secret key" );
+        bool thrown = false;
+        try
+        {
+            vdr::cipher::permutation_view const larger( small, 200 );
+        }
+        catch( std::invalid_argument const & )
+        {
+            thrown = true;
+        }
+        if( not thrown )
+        {
+            std::cout << "error: view larger than engine domain was accepted\n" << std::flush;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_permutation_view();
+}
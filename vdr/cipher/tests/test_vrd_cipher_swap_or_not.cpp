@@ -0,0 +1,86 @@
+#include <iostream>
+#include <iomanip>
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "vdr/byte.h"
+#include "vdr/cipher/swap_or_not.h"
+
+
+int test_cipher_swap_or_not()
+{
+    for( uintmax_t const domain_size : { uintmax_t(1), uintmax_t(2), uintmax_t(17), uintmax_t(1000), ( uintmax_t(1) << 16 ) + 1 } )
+    {
+        vdr::cipher::swap_or_not fpe( domain_size, "secret key" );
+        std::cerr << "domain " << domain_size << ": " << fpe.get_rounds() << " rounds\n";
+
+        std::vector< uintmax_t > values( domain_size );
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            values[ i ] = i;
+        }
+        std::vector< uintmax_t > encrypted( values.size() );
+        fpe.encrypt( values, encrypted );
+        std::vector< uintmax_t > decrypted = encrypted;
+        fpe.decrypt( decrypted, decrypted );
+
+        std::vector< bool > seen( domain_size );
+        size_t fixed = 0;
+        for( uintmax_t i = 0; i < domain_size; ++i )
+        {
+            if( encrypted[ i ] >= domain_size or seen[ encrypted[ i ] ] )
+            {
+                std::cout << "error: not a permutation at " << i << " -enc-> " << encrypted[ i ] << "\n" << std::flush;
+                return 1;
+            }
+            seen[ encrypted[ i ] ] = true;
+            fixed += ( encrypted[ i ] == i );
+
+            if( encrypted[ i ] != fpe.encrypt( i ) or fpe.decrypt( encrypted[ i ] ) != i or decrypted[ i ] != i )
+            {
+                std::cout << "error: batch mismatch in domain " << domain_size << " for " << i << "\n" << std::flush;
+                return 1;
+            }
+        }
+        if( domain_size >= 1000 and fixed > domain_size / 100 )
+        {
+            std::cout << "error: " << fixed << " fixed points in domain " << domain_size << "\n" << std::flush;
+            return 1;
+        }
+    }
+
+    {
+        uintmax_t const domain_size = ( uintmax_t(1) << 40 ) + 1;
+        vdr::cipher::swap_or_not fpe( domain_size, "secret key" );
+        if( fpe.get_rounds() != 6 * 41 )
+        {
+            std::cout << "error: unexpected rounds " << fpe.get_rounds() << "\n" << std::flush;
+            return 1;
+        }
+        for( uintmax_t i = 0; i < 1000; ++i )
+        {
+            uintmax_t const value = i * 1099511627;
+            uintmax_t const encrypted = fpe.encrypt( value );
+            if( encrypted >= domain_size or fpe.decrypt( encrypted ) != value )
+            {
+                std::cout << "error: roundtrip mismatch for " << value << "\n" << std::flush;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+
+
+int main( int ac, char *av[] )
+{
+    return test_cipher_swap_or_not();
+}
@@ -0,0 +1,17 @@
+#ifndef INCLUDED__VDR_CIPHER_UNKEYED_H
+#define INCLUDED__VDR_CIPHER_UNKEYED_H
+
+namespace vdr
+{
+    namespace cipher
+    {
+
+        /// Tag of block cipher constructors which do not key the cipher with the all zero key, as
+        /// default constructors do. Such a cipher must get `set_enc_key`/`set_dec_key` before any
+        /// `enc`/`dec`. Saves a key schedule for every cipher which is keyed right away.
+        enum unkeyed_t { unkeyed };
+
+    }
+}
+
+#endif // INCLUDED__VDR_CIPHER_UNKEYED_H
@@ -0,0 +1,109 @@
+#ifndef INCLUDED__VDR_CIPHER_VAES_H
+#define INCLUDED__VDR_CIPHER_VAES_H
+
+#include "vdr/cipher/aesni.h"
+
+#if defined( VDR_CIPHER_HAVE_AESNI )
+    #define VDR_CIPHER_HAVE_VAES 1
+#endif
+
+#ifdef VDR_CIPHER_HAVE_VAES
+
+#include <immintrin.h>
+
+/// Same as `VDR_CIPHER_AESNI_TARGET`, for VAES on 512 bit registers (Ice Lake, Zen 4 and later).
+#define VDR_CIPHER_VAES_TARGET __attribute__(( target( "aes,sse2,avx512f,vaes" ) ))
+
+
+namespace vdr
+{
+    namespace cipher
+    {
+        namespace vaes
+        {
+
+            /// Four blocks per register, four registers in flight.
+            enum : size_t { register_blocks = 4 };
+            enum : size_t { lanes = 4 * register_blocks };
+
+            inline bool is_supported()
+            {
+                #if defined( __VAES__ ) and defined( __AVX512F__ )
+                    return true;
+                #else
+                    static bool const supported = aesni::is_supported() and __builtin_cpu_supports( "avx512f" ) and __builtin_cpu_supports( "vaes" );
+                    return supported;
+                #endif
+            }
+
+            /// ECB over `count` blocks with AES-NI key schedule from `vdr::cipher::aesni`.
+            /// Whole groups of `lanes` blocks go through VAES, the tail through AES-NI.
+            template< size_t KeyBits, bool Encrypt >
+            VDR_CIPHER_VAES_TARGET
+            inline void crypt_blocks( __m128i const * round_keys, uint8_t const * in, uint8_t * out, size_t count )
+            {
+                enum : size_t { rounds = aesni::traits< KeyBits >::rounds };
+                enum : size_t { registers = lanes / register_blocks };
+
+                __m512i wide_keys[ rounds + 1 ];
+                for( size_t round = 0; round <= rounds; ++round )
+                {
+                    wide_keys[ round ] = _mm512_mask_broadcast_i32x4( _mm512_setzero_si512(), 0xffff, round_keys[ round ] );
+                }
+
+                for( ; count >= lanes; count -= lanes, in += lanes * 16, out += lanes * 16 )
+                {
+                    __m512i blocks[ registers ];
+                    for( size_t i = 0; i < registers; ++i )
+                    {
+                        blocks[ i ] = _mm512_xor_si512( _mm512_loadu_si512( in + i * register_blocks * 16 ), wide_keys[ 0 ] );
+                    }
+                    for( size_t round = 1; round < rounds; ++round )
+                    {
+                        for( size_t i = 0; i < registers; ++i )
+                        {
+                            blocks[ i ] = Encrypt
+                                ? _mm512_aesenc_epi128( blocks[ i ], wide_keys[ round ] )
+                                : _mm512_aesdec_epi128( blocks[ i ], wide_keys[ round ] );
+                        }
+                    }
+                    for( size_t i = 0; i < registers; ++i )
+                    {
+                        blocks[ i ] = Encrypt
+                            ? _mm512_aesenclast_epi128( blocks[ i ], wide_keys[ rounds ] )
+                            : _mm512_aesdeclast_epi128( blocks[ i ], wide_keys[ rounds ] );
+                        _mm512_storeu_si512( out + i * register_blocks * 16, blocks[ i ] );
+                    }
+                }
+
+                vdr::wipe( gsl::as_writeable_bytes( gsl::as_span( wide_keys ) ) );
+
+                if( Encrypt )
+                {
+                    aesni::encrypt_blocks< KeyBits >( round_keys, in, out, count );
+                }
+                else
+                {
+                    aesni::decrypt_blocks< KeyBits >( round_keys, in, out, count );
+                }
+            }
+
+            template< size_t KeyBits >
+            inline void encrypt_blocks( __m128i const * round_keys, uint8_t const * in, uint8_t * out, size_t count )
+            {
+                crypt_blocks< KeyBits, true >( round_keys, in, out, count );
+            }
+
+            template< size_t KeyBits >
+            inline void decrypt_blocks( __m128i const * round_keys, uint8_t const * in, uint8_t * out, size_t count )
+            {
+                crypt_blocks< KeyBits, false >( round_keys, in, out, count );
+            }
+
+        }
+    }
+}
+
+#endif // VDR_CIPHER_HAVE_VAES
+
+#endif // INCLUDED__VDR_CIPHER_VAES_H
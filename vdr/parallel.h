@@ -0,0 +1,176 @@
+#ifndef INCLUDED__VDR_PARALLEL_H
+#define INCLUDED__VDR_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+
+namespace vdr
+{
+
+    /// Calls `body( chunk_first, chunk_last )` for every subrange of [first, last), at most `chunk`
+    /// long, on `threads` threads (0 means `std::thread::hardware_concurrency()`), the calling
+    /// thread being one of them.
+    ///
+    /// Every thread starts on its own contiguous share of the range and takes chunks from its
+    /// front. A thread which runs out steals the back half of another share, so chunks of uneven
+    /// cost (cycle walking) do not leave threads idle at the end. Shares are locked only by their
+    /// owner once per chunk and by thieves, so chunks of a few thousand values never contend.
+    ///
+    /// The first exception thrown by `body` stops taking new chunks and is rethrown once all
+    /// threads are joined.
+    template< class Body >
+    void parallel_for( uintmax_t first, uintmax_t last, uintmax_t chunk, size_t threads, Body const & body );
+
+}
+
+
+
+namespace vdr
+{
+
+    namespace
+    {
+
+        /// Not yet taken part [next, last) of one thread's share.
+        struct parallel_share_t
+        {
+            std::mutex mutex;
+            uintmax_t next;
+            uintmax_t last;
+        };
+
+        /// Moves the back half of some other share, chunk aligned, into share `self`. False when
+        /// every other share is empty.
+        inline bool parallel_steal( std::vector< parallel_share_t > & shares, size_t const self, uintmax_t const chunk )
+        {
+            for( size_t i = 1; i < shares.size(); ++i )
+            {
+                parallel_share_t & victim = shares[ ( self + i ) % shares.size() ];
+
+                uintmax_t stolen_first;
+                uintmax_t stolen_last;
+                {
+                    std::lock_guard< std::mutex > lock( victim.mutex );
+                    uintmax_t const left = victim.last - victim.next;
+                    if( left == 0 )
+                    {
+                        continue;
+                    }
+                    stolen_first = victim.next + ( left / 2 ) / chunk * chunk;
+                    stolen_last = victim.last;
+                    victim.last = stolen_first;
+                }
+
+                std::lock_guard< std::mutex > lock( shares[ self ].mutex );
+                shares[ self ].next = stolen_first;
+                shares[ self ].last = stolen_last;
+                return true;
+            }
+            return false;
+        }
+
+    } // anonymous namespace
+
+
+    template< class Body >
+    void parallel_for( uintmax_t first, uintmax_t last, uintmax_t chunk, size_t threads, Body const & body )
+    {
+        if( first >= last )
+        {
+            return;
+        }
+
+        chunk = std::max< uintmax_t >( chunk, 1 );
+        if( threads == 0 )
+        {
+            threads = std::max< size_t >( 1, std::thread::hardware_concurrency() );
+        }
+        threads = std::min< uintmax_t >( threads, ( last - first + chunk - 1 ) / chunk );
+
+        // Shares start chunk aligned, so only the very last chunk is short.
+        uintmax_t const chunks = ( last - first + chunk - 1 ) / chunk;
+        std::vector< parallel_share_t > shares( threads );
+        for( size_t thread = 0; thread < threads; ++thread )
+        {
+            shares[ thread ].next = first + chunks * thread / threads * chunk;
+            shares[ thread ].last = std::min( last, first + chunks * ( thread + 1 ) / threads * chunk );
+        }
+
+        std::atomic< bool > failed( false );
+        std::exception_ptr failure;
+        std::mutex failure_mutex;
+
+        auto const work = [ & ]( size_t const self )
+        {
+            try
+            {
+                while( not failed.load( std::memory_order_relaxed ) )
+                {
+                    uintmax_t chunk_first;
+                    uintmax_t chunk_last;
+                    {
+                        std::lock_guard< std::mutex > lock( shares[ self ].mutex );
+                        chunk_first = shares[ self ].next;
+                        chunk_last = std::min( shares[ self ].last, chunk_first + chunk );
+                        shares[ self ].next = chunk_last;
+                    }
+
+                    if( chunk_first == chunk_last )
+                    {
+                        if( not parallel_steal( shares, self, chunk ) )
+                        {
+                            return;
+                        }
+                        continue;
+                    }
+
+                    body( chunk_first, chunk_last );
+                }
+            }
+            catch( ... )
+            {
+                std::lock_guard< std::mutex > lock( failure_mutex );
+                if( not failed.exchange( true ) )
+                {
+                    failure = std::current_exception();
+                }
+            }
+        };
+
+        std::vector< std::thread > workers;
+        workers.reserve( threads - 1 );
+        for( size_t thread = 1; thread < threads; ++thread )
+        {
+            try
+            {
+                workers.emplace_back( work, thread );
+            }
+            catch( std::system_error const & )
+            {
+                // Shares of threads which did not start are stolen by the others.
+                break;
+            }
+        }
+        work( 0 );
+        for( auto & worker : workers )
+        {
+            worker.join();
+        }
+
+        if( failure )
+        {
+            std::rethrow_exception( failure );
+        }
+    }
+
+}
+
+#endif // INCLUDED__VDR_PARALLEL_H
@@ -0,0 +1,213 @@
+#ifndef INCLUDED__VDR_SHARDED_LRU_H
+#define INCLUDED__VDR_SHARDED_LRU_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+namespace vdr
+{
+
+    /// Bounded map of `Value`s by `Key`, least recently used one is evicted when full.
+    ///
+    /// Keys are spread by `ShardOf` over `shards` LRU lists, each with its own mutex, so threads
+    /// asking for different keys rarely wait for each other. Capacity is split between shards and
+    /// a full shard evicts on its own, so shards fill unevenly. `ShardOf` should use other bits of
+    /// the key than `Hash` does, or shards skew hash buckets.
+    ///
+    /// Values are copied out under the lock, so they should be cheap to copy, e.g. shared pointers.
+    template< class Key, class Value, class Hash = std::hash< Key >, class ShardOf = Hash >
+    class sharded_lru
+    {
+    public:
+        typedef Key key_type;
+        typedef Value value_type;
+
+        enum : size_t { default_shards = 16 };
+
+        struct stats_t
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+        };
+
+    public:
+        /// At most `capacity` values in all; `shards` is clamped to `capacity`.
+        explicit sharded_lru( size_t capacity, size_t shards = default_shards );
+
+        sharded_lru( sharded_lru const & ) = delete;
+        sharded_lru & operator = ( sharded_lru const & ) = delete;
+
+        /// Value of `key`, made by `make()` outside of the shard lock on a miss. When two threads
+        /// miss the same key at once, both make it and the first one stored is returned to both.
+        template< class Make >
+        Value get( Key const & key, Make const & make );
+
+        /// Drops value of `key`, if any.
+        void erase( Key const & key );
+
+        /// Drops all values, counters are kept.
+        void clear();
+
+        size_t size() const;
+        size_t get_capacity() const { return _capacity; }
+
+        /// Counters since construction, each one read atomically.
+        stats_t get_stats() const;
+
+    private:
+        struct entry_t
+        {
+            Key key;
+            Value value;
+        };
+
+        /// Most recently used entry first.
+        struct shard_t
+        {
+            mutable std::mutex mutex;
+            size_t capacity;
+            std::list< entry_t > entries;
+            std::unordered_map< Key, typename std::list< entry_t >::iterator, Hash > index;
+        };
+
+    private:
+        shard_t & shard_of( Key const & key ) { return _shards[ ShardOf()( key ) % _shards.size() ]; }
+
+    private:
+        const size_t _capacity;
+
+        std::vector< shard_t > _shards;
+
+        std::atomic< uint64_t > _hits;
+        std::atomic< uint64_t > _misses;
+        std::atomic< uint64_t > _evictions;
+    };
+
+}
+
+
+
+namespace vdr
+{
+
+    #define TO_STR(x) #x
+
+    template< class Key, class Value, class Hash, class ShardOf >
+    sharded_lru<Key, Value, Hash, ShardOf>::sharded_lru( size_t capacity, size_t shards )
+        : _capacity( capacity )
+        , _shards( std::max< size_t >( 1, std::min( shards, capacity ) ) )
+        , _hits( 0 )
+        , _misses( 0 )
+        , _evictions( 0 )
+    {
+        if( capacity == 0 )
+        {
+            throw std::invalid_argument( TO_STR( sharded_lru ) "::" + std::string( __FUNCTION__ ) + ": capacity must be positive" );
+        }
+
+        for( size_t i = 0; i < _shards.size(); ++i )
+        {
+            _shards[ i ].capacity = capacity / _shards.size() + ( i < capacity % _shards.size() ? 1 : 0 );
+        }
+    }
+
+    template< class Key, class Value, class Hash, class ShardOf >
+    template< class Make >
+    Value sharded_lru<Key, Value, Hash, ShardOf>::get( Key const & key, Make const & make )
+    {
+        shard_t & shard = shard_of( key );
+
+        {
+            std::lock_guard< std::mutex > lock( shard.mutex );
+            auto const found = shard.index.find( key );
+            if( found != shard.index.end() )
+            {
+                shard.entries.splice( shard.entries.begin(), shard.entries, found->second );
+                _hits.fetch_add( 1, std::memory_order_relaxed );
+                return found->second->value;
+            }
+        }
+
+        _misses.fetch_add( 1, std::memory_order_relaxed );
+        Value const value = make();
+
+        std::lock_guard< std::mutex > lock( shard.mutex );
+        auto const found = shard.index.find( key );
+        if( found != shard.index.end() )
+        {
+            // Another thread made it meanwhile, keep one value per key.
+            shard.entries.splice( shard.entries.begin(), shard.entries, found->second );
+            return found->second->value;
+        }
+
+        if( shard.entries.size() == shard.capacity )
+        {
+            shard.index.erase( shard.entries.back().key );
+            shard.entries.pop_back();
+            _evictions.fetch_add( 1, std::memory_order_relaxed );
+        }
+        shard.entries.push_front( entry_t{ key, value } );
+        shard.index.emplace( key, shard.entries.begin() );
+        return value;
+    }
+
+    template< class Key, class Value, class Hash, class ShardOf >
+    void sharded_lru<Key, Value, Hash, ShardOf>::erase( Key const & key )
+    {
+        shard_t & shard = shard_of( key );
+
+        std::lock_guard< std::mutex > lock( shard.mutex );
+        auto const found = shard.index.find( key );
+        if( found != shard.index.end() )
+        {
+            shard.entries.erase( found->second );
+            shard.index.erase( found );
+        }
+    }
+
+    template< class Key, class Value, class Hash, class ShardOf >
+    void sharded_lru<Key, Value, Hash, ShardOf>::clear()
+    {
+        for( auto & shard : _shards )
+        {
+            std::lock_guard< std::mutex > lock( shard.mutex );
+            shard.index.clear();
+            shard.entries.clear();
+        }
+    }
+
+    template< class Key, class Value, class Hash, class ShardOf >
+    size_t sharded_lru<Key, Value, Hash, ShardOf>::size() const
+    {
+        size_t result = 0;
+        for( auto const & shard : _shards )
+        {
+            std::lock_guard< std::mutex > lock( shard.mutex );
+            result += shard.entries.size();
+        }
+        return result;
+    }
+
+    template< class Key, class Value, class Hash, class ShardOf >
+    typename sharded_lru<Key, Value, Hash, ShardOf>::stats_t sharded_lru<Key, Value, Hash, ShardOf>::get_stats() const
+    {
+        return stats_t{ _hits.load( std::memory_order_relaxed ), _misses.load( std::memory_order_relaxed ), _evictions.load( std::memory_order_relaxed ) };
+    }
+
+}
+
+
+#undef TO_STR
+
+#endif // INCLUDED__VDR_SHARDED_LRU_H
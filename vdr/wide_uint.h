@@ -0,0 +1,212 @@
+#ifndef INCLUDED__VDR_WIDE_UINT_H
+#define INCLUDED__VDR_WIDE_UINT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+namespace vdr
+{
+
+    /// Fixed width unsigned integer of `Limbs` 64 bit limbs, least significant limb first.
+    /// Only bit operations, shifts, comparison and +/- are provided, modulo 2 ^ ( 64 * Limbs ),
+    /// enough for FPE engines templated on value type. See `basic_fpe_feistel`.
+    template< size_t Limbs >
+    class wide_uint
+    {
+    public:
+        static_assert( Limbs > 0, "" );
+
+        typedef uint64_t limb_t;
+
+        enum : size_t { limbs = Limbs };
+        enum : size_t { limb_bits = 64 };
+        enum : size_t { digits = limbs * limb_bits };
+
+    public:
+        constexpr wide_uint() : _limbs() {}
+        wide_uint( limb_t value ) : _limbs() { _limbs[ 0 ] = value; }
+
+        limb_t limb( size_t i ) const { return _limbs[ i ]; }
+        limb_t & limb( size_t i ) { return _limbs[ i ]; }
+
+        wide_uint & operator <<= ( size_t shift );
+        wide_uint & operator >>= ( size_t shift );
+        wide_uint & operator &= ( wide_uint const & other );
+        wide_uint & operator |= ( wide_uint const & other );
+        wide_uint & operator ^= ( wide_uint const & other );
+        wide_uint & operator += ( wide_uint const & other );
+        wide_uint & operator -= ( wide_uint const & other );
+
+        wide_uint operator ~ () const;
+
+        friend wide_uint operator << ( wide_uint value, size_t shift ) { return value <<= shift; }
+        friend wide_uint operator >> ( wide_uint value, size_t shift ) { return value >>= shift; }
+        friend wide_uint operator & ( wide_uint left, wide_uint const & right ) { return left &= right; }
+        friend wide_uint operator | ( wide_uint left, wide_uint const & right ) { return left |= right; }
+        friend wide_uint operator ^ ( wide_uint left, wide_uint const & right ) { return left ^= right; }
+        friend wide_uint operator + ( wide_uint left, wide_uint const & right ) { return left += right; }
+        friend wide_uint operator - ( wide_uint left, wide_uint const & right ) { return left -= right; }
+
+        friend bool operator == ( wide_uint const & left, wide_uint const & right ) { return left._limbs == right._limbs; }
+        friend bool operator != ( wide_uint const & left, wide_uint const & right ) { return not ( left == right ); }
+        friend bool operator < ( wide_uint const & left, wide_uint const & right ) { return compare( left, right ) < 0; }
+        friend bool operator > ( wide_uint const & left, wide_uint const & right ) { return compare( left, right ) > 0; }
+        friend bool operator <= ( wide_uint const & left, wide_uint const & right ) { return compare( left, right ) <= 0; }
+        friend bool operator >= ( wide_uint const & left, wide_uint const & right ) { return compare( left, right ) >= 0; }
+
+    private:
+        static int compare( wide_uint const & left, wide_uint const & right );
+
+    private:
+        std::array< limb_t, Limbs > _limbs;
+    };
+
+}
+
+
+
+namespace vdr
+{
+
+    template< size_t Limbs >
+    wide_uint<Limbs> & wide_uint<Limbs>::operator <<= ( size_t shift )
+    {
+        if( shift >= digits )
+        {
+            _limbs.fill( 0 );
+            return *this;
+        }
+
+        size_t const limb_shift = shift / limb_bits;
+        size_t const bit_shift = shift % limb_bits;
+        for( size_t i = limbs; i > 0; --i )
+        {
+            size_t const to = i - 1;
+            limb_t result = 0;
+            if( to >= limb_shift )
+            {
+                result = _limbs[ to - limb_shift ] << bit_shift;
+                if( bit_shift != 0 and to > limb_shift )
+                {
+                    result |= _limbs[ to - limb_shift - 1 ] >> ( limb_bits - bit_shift );
+                }
+            }
+            _limbs[ to ] = result;
+        }
+        return *this;
+    }
+
+    template< size_t Limbs >
+    wide_uint<Limbs> & wide_uint<Limbs>::operator >>= ( size_t shift )
+    {
+        if( shift >= digits )
+        {
+            _limbs.fill( 0 );
+            return *this;
+        }
+
+        size_t const limb_shift = shift / limb_bits;
+        size_t const bit_shift = shift % limb_bits;
+        for( size_t to = 0; to < limbs; ++to )
+        {
+            limb_t result = 0;
+            if( to + limb_shift < limbs )
+            {
+                result = _limbs[ to + limb_shift ] >> bit_shift;
+                if( bit_shift != 0 and to + limb_shift + 1 < limbs )
+                {
+                    result |= _limbs[ to + limb_shift + 1 ] << ( limb_bits - bit_shift );
+                }
+            }
+            _limbs[ to ] = result;
+        }
+        return *this;
+    }
+
+    template< size_t Limbs >
+    wide_uint<Limbs> & wide_uint<Limbs>::operator &= ( wide_uint const & other )
+    {
+        for( size_t i = 0; i < limbs; ++i )
+        {
+            _limbs[ i ] &= other._limbs[ i ];
+        }
+        return *this;
+    }
+
+    template< size_t Limbs >
+    wide_uint<Limbs> & wide_uint<Limbs>::operator |= ( wide_uint const & other )
+    {
+        for( size_t i = 0; i < limbs; ++i )
+        {
+            _limbs[ i ] |= other._limbs[ i ];
+        }
+        return *this;
+    }
+
+    template< size_t Limbs >
+    wide_uint<Limbs> & wide_uint<Limbs>::operator ^= ( wide_uint const & other )
+    {
+        for( size_t i = 0; i < limbs; ++i )
+        {
+            _limbs[ i ] ^= other._limbs[ i ];
+        }
+        return *this;
+    }
+
+    template< size_t Limbs >
+    wide_uint<Limbs> & wide_uint<Limbs>::operator += ( wide_uint const & other )
+    {
+        limb_t carry = 0;
+        for( size_t i = 0; i < limbs; ++i )
+        {
+            limb_t const sum = _limbs[ i ] + other._limbs[ i ];
+            limb_t const result = sum + carry;
+            carry = ( sum < _limbs[ i ] ) | ( result < sum );
+            _limbs[ i ] = result;
+        }
+        return *this;
+    }
+
+    template< size_t Limbs >
+    wide_uint<Limbs> & wide_uint<Limbs>::operator -= ( wide_uint const & other )
+    {
+        limb_t borrow = 0;
+        for( size_t i = 0; i < limbs; ++i )
+        {
+            limb_t const difference = _limbs[ i ] - other._limbs[ i ];
+            limb_t const result = difference - borrow;
+            borrow = ( _limbs[ i ] < other._limbs[ i ] ) | ( difference < borrow );
+            _limbs[ i ] = result;
+        }
+        return *this;
+    }
+
+    template< size_t Limbs >
+    wide_uint<Limbs> wide_uint<Limbs>::operator ~ () const
+    {
+        wide_uint result;
+        for( size_t i = 0; i < limbs; ++i )
+        {
+            result._limbs[ i ] = ~_limbs[ i ];
+        }
+        return result;
+    }
+
+    template< size_t Limbs >
+    int wide_uint<Limbs>::compare( wide_uint const & left, wide_uint const & right )
+    {
+        for( size_t i = limbs; i > 0; --i )
+        {
+            if( left._limbs[ i - 1 ] != right._limbs[ i - 1 ] )
+            {
+                return left._limbs[ i - 1 ] < right._limbs[ i - 1 ] ? -1 : 1;
+            }
+        }
+        return 0;
+    }
+
+}
+
+#endif // INCLUDED__VDR_WIDE_UINT_H